@@ -1,22 +1,22 @@
+#include <chrono>
 #include <cstdlib>
 #include <iostream>
 
 #include "mygl/shader.h"
 #include "mygl/mesh.h"
 #include "mygl/camera.h"
+#include "mygl/commandbuffer.h"
+#include "mygl/drawlist.h"
+#include "mygl/drawdata.h"
+#include "mygl/frame.h"
+#include "mygl/jobs.h"
+#include "mygl/pack.h"
+#include "mygl/renderqueue.h"
+#include "mygl/stats.h"
 
 #include "planet.h"
 #include "plane.h"
 
-struct VectorizedWaveParams 
-{
-    Vector3D amplitude;
-    Vector3D phi;
-    Vector3D omega;
-    Vector3D directionX;
-    Vector3D directionY;
-};
-
 enum eCameraFollow
 {
     PLANE,
@@ -67,14 +67,39 @@ struct
     /* plane */
     Plane plane;
 
-    /* shader */
-    ShaderProgram shaderColor;
-    ShaderProgram shaderNormal;
-    ShaderProgram shaderFlagColor;
-    ShaderProgram shaderFlagNormal;
+    /* plane and planet are loaded on the job system, the scene is drawn once both are uploaded */
+    bool planeLoaded = false;
+    bool planetLoaded = false;
+
+    /* shader permutations per render mode, owned by the permutation cache (see shaderPermutation) */
+    const ShaderProgram* shaderModel[eRenderMode::MODE_COUNT];
+    const ShaderProgram* shaderFlag[eRenderMode::MODE_COUNT];
+    const ShaderProgram* shaderCloth[eRenderMode::MODE_COUNT];
     eRenderMode renderMode;
+
+    /* whether the flag waves are a wind spectrum (see flagSpectrum) instead of the default waves of FlagSim */
+    bool waveSpectrum = false;
 } sScene;
 
+/* shader permutation of the flag for the flag simulation of the plane */
+const ShaderProgram* sceneFlagShader(eRenderMode mode)
+{
+    return sScene.plane.flagSimulation == eFlagSimulation::CLOTH ? sScene.shaderCloth[mode] : sScene.shaderFlag[mode];
+}
+
+/* retained draws of the scene, the first buffer holds the plane, the others chunks of planet parts (see renderScene).
+ * Buffers are only recorded again if the render mode, the loaded models or their revisions change */
+struct
+{
+    DrawList list;
+    eRenderMode mode = eRenderMode::MODE_COUNT;
+    unsigned int planeRevision = 0;
+    unsigned int planetRevision = 0;
+    /* center of the draws of each buffer in the space of the plane or planet transformation, for drawListDepth */
+    std::vector<Vector3D> centers;
+} sDraws;
+const std::size_t planetPartsPerBuffer = 64;
+
 /* struct holding all state variables for input */
 struct
 {
@@ -162,6 +187,20 @@ void keyCallback(GLFWwindow *window, int key, int scancode, int action, int mods
     {
         sScene.renderMode = static_cast<eRenderMode>((static_cast<int>(sScene.renderMode) + 1) % eRenderMode::MODE_COUNT);
     }
+
+    /* toggle the waves of the flag between the three default waves and a wind spectrum */
+    if (key == GLFW_KEY_V && action == GLFW_PRESS && sScene.planeLoaded)
+    {
+        sScene.waveSpectrum = !sScene.waveSpectrum;
+        flagSimSetWaves(sScene.plane.flagSim, sScene.waveSpectrum ? flagSpectrum(FlagSpectrum()) : FlagSim().parameter);
+    }
+
+    /* toggle flag simulation between waves and cloth */
+    if (key == GLFW_KEY_C && action == GLFW_PRESS && sScene.planeLoaded)
+    {
+        bool cloth = sScene.plane.flagSimulation == eFlagSimulation::CLOTH;
+        setFlagSimulation(sScene.plane, cloth ? eFlagSimulation::WAVES : eFlagSimulation::CLOTH);
+    }
 }
 
 /* GLFW callback function for mouse position events */
@@ -203,6 +242,51 @@ void windowResizeCallback(GLFWwindow *window, int width, int height)
     sScene.camera.height = static_cast<float>(height);
 }
 
+/* function to start loading the objects of the scene, runs before the window and opengl context exist */
+void sceneLoad()
+{
+    /* parsing happens on the job system, the opengl buffers for the meshes are created in jobsPoll */
+    planeLoadAsync("assets/plane/cartoon-plane.obj", "assets/plane/flag_uibk.obj", [](Plane plane)
+    {
+        sScene.plane = plane;
+        sScene.planeLoaded = true;
+        drawListInvalidate(sDraws.list);
+    });
+    planetLoadAsync("assets/planet/cute-little-planet.obj", [](Planet planet)
+    {
+        sScene.planet = planet;
+        sScene.planetLoaded = true;
+        drawListInvalidate(sDraws.list);
+    });
+}
+
+/* function to check whether all objects of the scene are loaded */
+bool sceneLoaded()
+{
+    return sScene.planeLoaded && sScene.planetLoaded;
+}
+
+/* defines of the shader permutation that renders the models or the flag in the given render mode, the cloth flag takes
+ * its vertices as they are */
+ShaderDefines renderDefines(eRenderMode mode, bool flag, bool cloth = false)
+{
+    ShaderDefines defines;
+    if (mode == eRenderMode::NORMAL)
+    {
+        defines.push_back({"NORMAL_OUTPUT", ""});
+    }
+    if (flag)
+    {
+        defines.push_back({"FLAG", ""});
+        defines.push_back({"FLAG_MAX_WAVES", std::to_string(flagMaxWaves)});
+    }
+    if (cloth)
+    {
+        defines.push_back({"CLOTH", ""});
+    }
+    return defines;
+}
+
 /* function to setup and initialize the whole scene */
 void sceneInit(float width, float height)
 {
@@ -211,15 +295,14 @@ void sceneInit(float width, float height)
     sScene.cameraFollow = eCameraFollow::PLANE;
     sScene.zoomSpeedMultiplier = 0.05f;
 
-    /* setup objects in scene and create opengl buffers for meshes */
-    sScene.plane = planeLoad("assets/plane/cartoon-plane.obj", "assets/plane/flag_uibk.obj");
-    sScene.planet = planetLoad("assets/planet/cute-little-planet.obj");
-
-    /* load shader from file */
-    sScene.shaderColor = shaderLoad("shader/default.vert", "shader/color.frag");
-    sScene.shaderNormal = shaderLoad("shader/default.vert", "shader/normal.frag");
-    sScene.shaderFlagColor = shaderLoad("shader/flag.vert", "shader/color.frag");
-    sScene.shaderFlagNormal = shaderLoad("shader/flag.vert", "shader/normal.frag");
+    /* start compiling the shader permutations of all render modes, they are finished in the background (see
+     * shaderPermutationsPoll), only the programs of the first frame are waited for once the models are there */
+    for (int mode = 0; mode < eRenderMode::MODE_COUNT; mode++)
+    {
+        sScene.shaderModel[mode] = &shaderPermutationPrefetch("shader/default.vert", "shader/default.frag", renderDefines(static_cast<eRenderMode>(mode), false));
+        sScene.shaderFlag[mode] = &shaderPermutationPrefetch("shader/default.vert", "shader/default.frag", renderDefines(static_cast<eRenderMode>(mode), true));
+        sScene.shaderCloth[mode] = &shaderPermutationPrefetch("shader/default.vert", "shader/default.frag", renderDefines(static_cast<eRenderMode>(mode), true, true));
+    }
 
     sScene.renderMode = eRenderMode::COLOR;
 }
@@ -249,168 +332,172 @@ void sceneUpdate(float dt)
     }
 }
 
-/**
- * function to simplify vectorizing process 
- * converts WaveParams in a vectorized format (used by the GPU)
- */
-VectorizedWaveParams vectorizeWaveParams(WaveParams waveParams[3]) {
-    // - setup
-    const int waveParamCount = 3;
-    VectorizedWaveParams vParams = {
-        .amplitude  = Vector3D(0.0f, 0.0f, 0.0f),
-        .phi        = Vector3D(0.0f, 0.0f, 0.0f),
-        .omega      = Vector3D(0.0f, 0.0f, 0.0f),
-        .directionX = Vector3D(0.0f, 0.0f, 0.0f),
-        .directionY = Vector3D(0.0f, 0.0f, 0.0f)
-    };
-    // - fill values by iterating over waveParams
-    for (int i = 0; i < waveParamCount; i++) 
-    {
-        vParams.amplitude[i] = waveParams[i].amplitude;
-        vParams.phi[i] = waveParams[i].phi;
-        vParams.omega[i] = waveParams[i].omega;
-        vParams.directionX[i] = waveParams[i].direction.x;
-        vParams.directionY[i] = waveParams[i].direction.y;
-    }
-    // - return vectorized values
-    return vParams;
+/* model matrix of a plane part */
+Matrix4D planePartTransformation(std::size_t part)
+{
+    return sScene.plane.transformation * sScene.plane.partTransformations[part];
 }
 
-/* 
- * function to render all objects in the scene using their diffuse colors or their normals
- * (depending on shader program and renderNormal flag)
- */
-void renderColor(ShaderProgram& shader, bool renderNormal) {
-    /* setup camera and model matrices */
-    Matrix4D proj = cameraProjection(sScene.camera);
-    Matrix4D view = cameraView(sScene.camera);
+/* model matrix of the flag, it is needed to position the flag correctly */
+Matrix4D flagTransformation()
+{
+    return sScene.plane.transformation * sScene.plane.flagModelMatrix * sScene.plane.flagNegativeRotation;
+}
 
-    glUseProgram(shader.id);
-    shaderUniform(shader, "uProj",  proj);
-    shaderUniform(shader, "uView",  view);
-    shaderUniform(shader, "uModel",  sScene.plane.transformation);
-    if (renderNormal)
+/* records the draw of a model with the shader permutation of the render mode, see renderItemsSubmit */
+template<eRenderMode Mode>
+void renderModel(CommandBuffer& commands, const ShaderProgram& shader, const Model& model, unsigned int entry)
+{
+    RenderItem item;
+    item.program = &shader;
+    item.vertexArray = meshVertexArray(model.mesh.format);
+    item.model = &model;
+    item.drawEntry = entry;
+    if constexpr (Mode == eRenderMode::COLOR)
     {
-        shaderUniform(shader, "uViewPos", cameraPosition(sScene.camera));
-        shaderUniform(shader, "isFlag", false);
+        /* material properties are looked up per vertex in the material table */
+        item.materialBase = static_cast<int>(model.materialBase);
     }
 
-    /* render plane */
+    /* the retained keys only hold the state, the draws are ordered front to back per buffer (see drawListDepth) */
+    item.key = renderSortKey(eRenderPass::OpaquePass, shader.id, item.vertexArray, std::max(item.materialBase, 0), 0.0f);
+    commandBufferDraw(commands, item);
+}
+
+/* 
+ * function to render the plane parts using their diffuse colors or their normals
+ * (depending on the render mode, which selects the shader permutation at compile time)
+ */
+template<eRenderMode Mode>
+void renderColor(CommandBuffer& commands, const ShaderProgram& shader) {
+    /* camera matrices are read from the FrameData block, model matrices from the DrawData entries */
     for(unsigned int i = 0; i < sScene.plane.partModel.size(); i++)
     {
-        auto& model = sScene.plane.partModel[i];
-        auto& transform = sScene.plane.partTransformations[i];
-        glBindVertexArray(model.mesh.vao);
-
-        shaderUniform(shader, "uModel", sScene.plane.transformation * transform);
-
-        for(auto& material : model.material)
-        {
-            if (!renderNormal)
-            {
-                /* set material properties */
-                shaderUniform(shader, "uMaterial.diffuse", material.diffuse);
-            }
-            glDrawElements(GL_TRIANGLES, material.indexCount, GL_UNSIGNED_INT, (const void*) (material.indexOffset*sizeof(unsigned int)) );
-        }
+        Matrix4D transformation = planePartTransformation(i);
+        unsigned int entry = commandBufferEntry(commands, drawEntry(transformation));
+        renderModel<Mode>(commands, shader, sScene.plane.partModel[i], entry);
     }
+}
 
-    /* render planet */
-    for(unsigned int i=0; i < sScene.planet.partModel.size(); i++)
+/* records a chunk of the planet parts, the parts of a chunk share one entry */
+template<eRenderMode Mode>
+void renderPlanet(CommandBuffer& commands, const ShaderProgram& shader, std::size_t first, std::size_t count)
+{
+    const Matrix4D& transformation = sScene.planet.transformation;
+    unsigned int entry = commandBufferEntry(commands, drawEntry(transformation));
+    for(std::size_t i = first; i < first + count; i++)
     {
-        auto& model = sScene.planet.partModel[i];
-        glBindVertexArray(model.mesh.vao);
-
-        shaderUniform(shader, "uModel", sScene.planet.transformation);
-
-        for(auto& material : model.material)
-        {
-            if (!renderNormal)
-            {
-                /* set material properties */
-                shaderUniform(shader, "uMaterial.diffuse", material.diffuse);
-            }
-            glDrawElements(GL_TRIANGLES, material.indexCount, GL_UNSIGNED_INT, (const void*) (material.indexOffset*sizeof(unsigned int)) );
-        }
+        renderModel<Mode>(commands, shader, sScene.planet.partModel[i], entry);
     }
-
-    /* cleanup opengl state */
-    glBindVertexArray(0);
-    glUseProgram(0);
 }
 
 /**
  * function for rendering the flag using another vertex shader
  * this way, the simulation of the flag is executed on the GPU instead of the CPU
  */
-void renderFlag(ShaderProgram& flagShader, bool renderNormal) {
-    /* setup */
-    Matrix4D proj = cameraProjection(sScene.camera);
-    Matrix4D view = cameraView(sScene.camera);
-    /* shader program and model initializations */
-    glUseProgram(flagShader.id);
-    /* shader uniforms - for MVP matrix (is needed to position the flag correctly) */
-    shaderUniform(flagShader, "uProj", proj);
-    shaderUniform(flagShader, "uView", view);
-    shaderUniform(flagShader, "uModel", sScene.plane.transformation * sScene.plane.flagModelMatrix * sScene.plane.flagNegativeRotation);
-    /* vectorize wave parameters of flag simulation for GPU computation */
-    VectorizedWaveParams waveParams = vectorizeWaveParams(sScene.plane.flagSim.parameter);
-    // shader uniforms - storing parameters of the different waves
-    float accumTime = sScene.plane.flagSim.accumTime;
-    // shaderUniform(flagShader, "uAccumTime", accumTime);
-
-    char* uniforms[8] = { "uProj", "uView", "uModel", "uAmplitude", "uPhi", "uOmega", "uDirectionX", "uDirectionY" };
-    int return_values[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+template<eRenderMode Mode>
+void renderFlag(CommandBuffer& commands, const ShaderProgram& flagShader) {
+    /* the waves and the time of the flag simulation are in the FlagWaves block (see flagWavesUpdate), the model matrix
+     * is in the DrawData entry, view and projection are in the FrameData block */
+    Matrix4D transformation = flagTransformation();
+    unsigned int entry = commandBufferEntry(commands, drawEntry(transformation));
+    renderModel<Mode>(commands, flagShader, sScene.plane.flag.model, entry);
+}
 
-    for (int i = 0; i < 8; i++) {
-        return_values[i] = glGetUniformLocation(flagShader.id, uniforms[i]);
-        std::cout << uniforms[i] << " -- found location -- " << return_values[i] << " -- " << (return_values[i] == -1) << std::endl;
+/*
+ * writes the model matrices of the frame into the entries of the retained draws, in the order renderColor, renderFlag
+ * and renderPlanet added them, and the distance of each buffer to the camera. The draws themselves stay as they are,
+ * the cost only depends on the number of plane parts and planet chunks.
+ */
+void updateEntries()
+{
+    CommandBuffer& plane = sDraws.list.buffers[0];
+    std::size_t parts = sScene.plane.partModel.size();
+    for (std::size_t i = 0; i < parts; i++)
+    {
+        plane.entries[i] = drawEntry(planePartTransformation(i));
     }
+    plane.entries[parts] = drawEntry(flagTransformation());
 
-    GLint numUniforms = 0;
-    glGetProgramiv(flagShader.id, GL_ACTIVE_UNIFORMS, &numUniforms);
-
-    for (GLint i = 0; i < numUniforms; i++) {
-        char name[256];
-        GLsizei length = 0;
-        GLint size = 0;
-        GLenum type = 0;
-
-        glGetActiveUniform(flagShader.id, i, sizeof(name), &length, &size, &type, name);
-        std::cout << "Uniform #" << i << ": " << name << " (type: " << type << ", size: " << size << ")\n";
+    DrawEntry planet = drawEntry(sScene.planet.transformation);
+    for (std::size_t i = 1; i < sDraws.list.buffers.size(); i++)
+    {
+        sDraws.list.buffers[i].entries[0] = planet;
     }
 
+    Vector3D camera = cameraPosition(sScene.camera);
+    drawListDepth(sDraws.list, 0, renderDepth(camera, sScene.plane.transformation, sDraws.centers[0]));
+    for (std::size_t i = 1; i < sDraws.list.buffers.size(); i++)
+    {
+        drawListDepth(sDraws.list, i, renderDepth(camera, sScene.planet.transformation, sDraws.centers[i]));
+    }
+}
 
+/*
+ * renders the scene with the shader permutations of one render mode. The draws are kept in a retained draw list with
+ * one command buffer for the plane and one per chunk of planet parts. Only buffers whose models changed are recorded
+ * again on the job system, every frame only the model matrices of the entries are updated.
+ */
+template<eRenderMode Mode>
+void renderScene()
+{
+    std::size_t planetParts = sScene.planet.partModel.size();
+    std::size_t planetChunks = (planetParts + planetPartsPerBuffer - 1) / planetPartsPerBuffer;
+    drawListResize(sDraws.list, 1 + planetChunks);
 
-    std::cout << std::endl << std::endl;
-
-    // shaderUniform(flagShader, "uAmplitude", waveParams.amplitude);
-    // shaderUniform(flagShader, "uPhi", waveParams.phi);
-    // shaderUniform(flagShader, "uOmega", waveParams.omega);
-    // shaderUniform(flagShader, "uDirectionX", waveParams.directionX);
-    // shaderUniform(flagShader, "uDirectionY", waveParams.directionY);
+    /* the programs of all draws change with the render mode, emission changes only affect the buffers of one model */
+    if (sDraws.mode != Mode)
+    {
+        drawListInvalidate(sDraws.list);
+        sDraws.mode = Mode;
+    }
+    if (sDraws.planeRevision != sScene.plane.revision)
+    {
+        drawListInvalidate(sDraws.list, 0);
+        sDraws.planeRevision = sScene.plane.revision;
+    }
+    if (sDraws.planetRevision != sScene.planet.revision)
+    {
+        for (std::size_t i = 1; i < sDraws.list.buffers.size(); i++)
+        {
+            drawListInvalidate(sDraws.list, i);
+        }
+        sDraws.planetRevision = sScene.planet.revision;
+    }
 
-    /* extract model */
-    auto& model = sScene.plane.flag.model;
-    /* bind model */
-    glBindVertexArray(model.mesh.vao);
-    /* iterate over material */
-    for(auto& material : model.material)
+    sDraws.centers.resize(sDraws.list.buffers.size());
+    drawListRecord(sDraws.list, [planetParts](std::size_t i, CommandBuffer& commands)
     {
-        if (!renderNormal)
+        if (i == 0)
         {
-            /* set material properties */
-            shaderUniform(flagShader, "uMaterial.diffuse", material.diffuse);
+            renderColor<Mode>(commands, *sScene.shaderModel[Mode]);
+            renderFlag<Mode>(commands, *sceneFlagShader(Mode));
+            sDraws.centers[i] = Vector3D(0.0f, 0.0f, 0.0f);
         }
         else
         {
-            shaderUniform(flagShader, "isFlag", true);
+            std::size_t first = (i - 1) * planetPartsPerBuffer;
+            std::size_t count = std::min(planetPartsPerBuffer, planetParts - first);
+            renderPlanet<Mode>(commands, *sScene.shaderModel[Mode], first, count);
+
+            /* the chunk is ordered by the mean of the centers of its parts */
+            Vector3D center(0.0f, 0.0f, 0.0f);
+            for (std::size_t p = first; p < first + count; p++)
+            {
+                center = center + renderCenter(sScene.planet.partModel[p].mesh);
+            }
+            sDraws.centers[i] = center * (1.0f / count);
         }
-        glDrawElements(GL_TRIANGLES, material.indexCount, GL_UNSIGNED_INT, (const void*) (material.indexOffset*sizeof(unsigned int)) );
-    }
-    /* cleanup opengl state */
-    glBindVertexArray(0);
-    glUseProgram(0);
+    });
+    updateEntries();
+
+    /* all model matrices of the frame are written in one pass and uploaded at once */
+    drawDataBegin();
+    drawListReplay(sDraws.list);
+    drawDataUpload();
+
+    /* sorted by state and by the depth of the buffers, redundant state changes are skipped */
+    drawListSubmit(sDraws.list);
 }
 
 /* function to draw all objects in the scene */
@@ -420,19 +507,41 @@ void sceneDraw()
     glClearColor(135.0 / 255, 206.0 / 255, 235.0 / 255, 1.0);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    /* loading frame, only the sky until plane and planet are uploaded */
+    if (!sceneLoaded())
+    {
+        return;
+    }
+
+    /* the programs of a render mode that is still compiling are swapped in once they are ready, until then the scene is
+     * drawn in color, whose programs are waited for */
+    eRenderMode mode = sScene.renderMode;
+    if (!sScene.shaderModel[mode]->ready || !sceneFlagShader(mode)->ready)
+    {
+        mode = eRenderMode::COLOR;
+        shaderPermutationWait(*sScene.shaderModel[mode]);
+        shaderPermutationWait(*sceneFlagShader(mode));
+    }
+
+    /* camera matrices of the frame, shared by all shader programs, and the time and waves of the flag */
+    frameDataUpdate(sScene.camera, static_cast<float>(glfwGetTime()));
+    flagWavesUpdate(sScene.plane.flagSim);
+
     /*------------ render scene -------------*/
+    statsGpuBegin();
     {
-        if (sScene.renderMode == eRenderMode::COLOR)
+        /* the only branch on the render mode, the render functions are instantiated per mode */
+        if (mode == eRenderMode::COLOR)
         {
-            renderColor(sScene.shaderColor, false);
-            renderFlag(sScene.shaderFlagColor, false);
+            renderScene<eRenderMode::COLOR>();
         }
-        else if (sScene.renderMode == eRenderMode::NORMAL)
+        else if (mode == eRenderMode::NORMAL)
         {
-            renderColor(sScene.shaderNormal, true);
-            renderFlag(sScene.shaderFlagNormal, true);
+            renderScene<eRenderMode::NORMAL>();
         }
     }
+    statsGpuEnd();
+    drawDataEnd();
     glCheckError();
 
     /* cleanup opengl state */
@@ -442,12 +551,25 @@ void sceneDraw()
 
 int main(int argc, char **argv)
 {
+    auto startup = std::chrono::steady_clock::now();
+    auto elapsed = [&startup]()
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startup).count();
+    };
+
+    /* start parsing right away, models are taken from the asset pack if it is up to date (see tools/bake.cpp) */
+    packOpen("assets/assets.pack");
+    sceneLoad();
+
     /* create window/context */
     int width = 1280;
     int height = 720;
-    GLFWwindow *window = windowCreate("Assignment 4 - Shader Programming", width, height);
+    const std::string title = "Assignment 4 - Shader Programming";
+    GLFWwindow *window = windowCreate(title, width, height);
     if (!window)
     {
+        jobsShutdown();
+        packClose();
         return EXIT_FAILURE;
     }
 
@@ -461,12 +583,19 @@ int main(int argc, char **argv)
     /*---------- init opengl stuff ------------*/
     glEnable(GL_DEPTH_TEST);
 
-    /* setup scene */
+    /* linked programs of earlier runs are loaded from the program cache */
+    shaderCacheOpen("shader/cache");
+
+    /* setup camera and shaders while the models are loaded */
     sceneInit(static_cast<float>(width), static_cast<float>(height));
 
     /*-------------- main loop ----------------*/
     double timeStamp = glfwGetTime();
     double timeStampNew = 0.0;
+    bool firstFrame = true;
+    bool loading = true;
+    bool firstSceneFrame = false;
+    PackStats pack;
 
     /* loop until user closes window */
     while (!glfwWindowShouldClose(window))
@@ -474,9 +603,27 @@ int main(int argc, char **argv)
         /* poll and process input and window events */
         glfwPollEvents();
 
+        /* shader programs that finished compiling in the background */
+        shaderPermutationsPoll();
+
+        /* upload the models that finished loading */
+        jobsPoll();
+        if (loading && sceneLoaded())
+        {
+            pack = packStats();
+            packClose();
+
+            timeStamp = glfwGetTime();
+            loading = false;
+            firstSceneFrame = true;
+        }
+
         /* update model matrix of cube */
         timeStampNew = glfwGetTime();
-        sceneUpdate(static_cast<float>(timeStampNew - timeStamp));
+        if (!loading)
+        {
+            sceneUpdate(static_cast<float>(timeStampNew - timeStamp));
+        }
         timeStamp = timeStampNew;
 
         /* draw all objects in the scene */
@@ -484,16 +631,40 @@ int main(int argc, char **argv)
 
         /* swap front and back buffer */
         glfwSwapBuffers(window);
+
+        /* the first frame only shows the sky while loading, the first scene frame is the time until the scene is visible */
+        if(firstFrame && loading)
+        {
+            std::cout << "[Main] First loading frame after " << elapsed() << " ms" << std::endl;
+        }
+        firstFrame = false;
+        if(firstSceneFrame)
+        {
+            std::cout << "[Main] First scene frame after " << elapsed() << " ms (" << pack.hits
+                      << " OBJ files from the pack, " << pack.misses << " parsed)" << std::endl;
+            firstSceneFrame = false;
+        }
+
+        /* show frame rate and draw calls in the window title */
+        statsFrameEnd(window, title);
     }
 
     /*-------- cleanup --------*/
+    /* finish loading jobs of an early exit, their models are not uploaded anymore */
+    jobsShutdown();
+    packClose();
+
     /* delete opengl shader and buffers */
-    shaderDelete(sScene.shaderColor);
-    shaderDelete(sScene.shaderNormal);
-    shaderDelete(sScene.shaderFlagColor);
-    shaderDelete(sScene.shaderFlagNormal);
+    shaderPermutationsDelete();
     planeDelete(sScene.plane);
     planetDelete(sScene.planet);
+    frameDataDelete();
+    flagWavesDelete();
+    drawDataDelete();
+    statsDelete();
+    materialTableDelete();
+    instanceTableDelete();
+    meshArenaDelete();
 
     /* cleanup glfw/glcontext */
     windowDelete(window);
@@ -0,0 +1,576 @@
+#include "cloth.h"
+#include "mygl/jobs.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CLOTH_SSE2
+#include <immintrin.h>
+#endif
+
+namespace detail
+{
+
+/* wind, gravity and gusts of one substep */
+struct ClothForces
+{
+    Vector3D wind;
+    Vector3D gravity;
+    /* lateral gust speed and the sine and cosine of its phase at the time of the substep */
+    float gust;
+    float gustSin;
+    float gustCos;
+    float invH;
+    float h2;
+    /* part of the velocity that is kept in the substep */
+    float damping;
+};
+
+/*
+ * Verlet integration of the particles in [first, last) with gravity, the pressure of the relative wind w = wind - v / h
+ * along the normals and its friction along the cloth: v = (x - px) * damping, x += (v + a * h^2) * invMass with
+ * a = gravity + drag * dot(n, w) * n + friction * (w - dot(n, w) * n).
+ */
+void integrateScalar(Cloth& cloth, const ClothForces& forces, std::size_t first, std::size_t last)
+{
+    const ClothSettings& settings = cloth.settings;
+    const Vector3D& lateral = cloth.lateral;
+    for(std::size_t i = first; i < last; i++)
+    {
+        float vx = cloth.x[i] - cloth.px[i];
+        float vy = cloth.y[i] - cloth.py[i];
+        float vz = cloth.z[i] - cloth.pz[i];
+        cloth.px[i] = cloth.x[i];
+        cloth.py[i] = cloth.y[i];
+        cloth.pz[i] = cloth.z[i];
+
+        float gust = forces.gust * (forces.gustSin * cloth.gustCos[i] - forces.gustCos * cloth.gustSin[i]);
+        float wx = forces.wind.x + gust * lateral.x - vx * forces.invH;
+        float wy = forces.wind.y + gust * lateral.y - vy * forces.invH;
+        float wz = forces.wind.z + gust * lateral.z - vz * forces.invH;
+        float pressure = (settings.drag - settings.friction) * (cloth.nx[i] * wx + cloth.ny[i] * wy + cloth.nz[i] * wz);
+
+        float ax = forces.gravity.x + settings.friction * wx + pressure * cloth.nx[i];
+        float ay = forces.gravity.y + settings.friction * wy + pressure * cloth.ny[i];
+        float az = forces.gravity.z + settings.friction * wz + pressure * cloth.nz[i];
+        cloth.x[i] += (vx * forces.damping + ax * forces.h2) * cloth.invMass[i];
+        cloth.y[i] += (vy * forces.damping + ay * forces.h2) * cloth.invMass[i];
+        cloth.z[i] += (vz * forces.damping + az * forces.h2) * cloth.invMass[i];
+    }
+}
+
+#ifdef CLOTH_SSE2
+/* integrateScalar for 4 particles per step, the particle arrays are padded to a multiple of flagKernelBlock */
+void integrateSSE2(Cloth& cloth, const ClothForces& forces, std::size_t first, std::size_t last)
+{
+    const __m128 damping = _mm_set1_ps(forces.damping);
+    const __m128 drag = _mm_set1_ps(cloth.settings.drag - cloth.settings.friction);
+    const __m128 friction = _mm_set1_ps(cloth.settings.friction);
+    const __m128 invH = _mm_set1_ps(forces.invH);
+    const __m128 h2 = _mm_set1_ps(forces.h2);
+    const __m128 gust = _mm_set1_ps(forces.gust);
+    const __m128 gustSin = _mm_set1_ps(forces.gustSin);
+    const __m128 gustCos = _mm_set1_ps(forces.gustCos);
+    const __m128 windX = _mm_set1_ps(forces.wind.x), windY = _mm_set1_ps(forces.wind.y), windZ = _mm_set1_ps(forces.wind.z);
+    const __m128 gravityX = _mm_set1_ps(forces.gravity.x), gravityY = _mm_set1_ps(forces.gravity.y), gravityZ = _mm_set1_ps(forces.gravity.z);
+    const __m128 lateralX = _mm_set1_ps(cloth.lateral.x), lateralY = _mm_set1_ps(cloth.lateral.y), lateralZ = _mm_set1_ps(cloth.lateral.z);
+
+    for(std::size_t i = first; i < last; i += 4)
+    {
+        __m128 x = _mm_load_ps(&cloth.x[i]), y = _mm_load_ps(&cloth.y[i]), z = _mm_load_ps(&cloth.z[i]);
+        __m128 vx = _mm_sub_ps(x, _mm_load_ps(&cloth.px[i]));
+        __m128 vy = _mm_sub_ps(y, _mm_load_ps(&cloth.py[i]));
+        __m128 vz = _mm_sub_ps(z, _mm_load_ps(&cloth.pz[i]));
+        _mm_store_ps(&cloth.px[i], x);
+        _mm_store_ps(&cloth.py[i], y);
+        _mm_store_ps(&cloth.pz[i], z);
+
+        __m128 phase = _mm_sub_ps(_mm_mul_ps(gustSin, _mm_load_ps(&cloth.gustCos[i])), _mm_mul_ps(gustCos, _mm_load_ps(&cloth.gustSin[i])));
+        __m128 g = _mm_mul_ps(gust, phase);
+        __m128 wx = _mm_sub_ps(_mm_add_ps(windX, _mm_mul_ps(g, lateralX)), _mm_mul_ps(vx, invH));
+        __m128 wy = _mm_sub_ps(_mm_add_ps(windY, _mm_mul_ps(g, lateralY)), _mm_mul_ps(vy, invH));
+        __m128 wz = _mm_sub_ps(_mm_add_ps(windZ, _mm_mul_ps(g, lateralZ)), _mm_mul_ps(vz, invH));
+
+        __m128 nx = _mm_load_ps(&cloth.nx[i]), ny = _mm_load_ps(&cloth.ny[i]), nz = _mm_load_ps(&cloth.nz[i]);
+        __m128 pressure = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, wx), _mm_mul_ps(ny, wy)), _mm_mul_ps(nz, wz));
+        pressure = _mm_mul_ps(drag, pressure);
+
+        __m128 ax = _mm_add_ps(_mm_add_ps(gravityX, _mm_mul_ps(friction, wx)), _mm_mul_ps(pressure, nx));
+        __m128 ay = _mm_add_ps(_mm_add_ps(gravityY, _mm_mul_ps(friction, wy)), _mm_mul_ps(pressure, ny));
+        __m128 az = _mm_add_ps(_mm_add_ps(gravityZ, _mm_mul_ps(friction, wz)), _mm_mul_ps(pressure, nz));
+        __m128 invMass = _mm_load_ps(&cloth.invMass[i]);
+        x = _mm_add_ps(x, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(vx, damping), _mm_mul_ps(ax, h2)), invMass));
+        y = _mm_add_ps(y, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(vy, damping), _mm_mul_ps(ay, h2)), invMass));
+        z = _mm_add_ps(z, _mm_mul_ps(_mm_add_ps(_mm_mul_ps(vz, damping), _mm_mul_ps(az, h2)), invMass));
+        _mm_store_ps(&cloth.x[i], x);
+        _mm_store_ps(&cloth.y[i], y);
+        _mm_store_ps(&cloth.z[i], z);
+    }
+}
+#endif
+
+/* projects the constraints in [first, last), which share no particle if they have the same color. One XPBD iteration
+ * per substep, so the Lagrange multipliers start at 0: s = C / (wa + wb + compliance / h^2) */
+void solve(Cloth& cloth, float invH2, std::size_t first, std::size_t last)
+{
+    const ClothConstraints& constraints = cloth.constraints;
+    for(std::size_t c = first; c < last; c++)
+    {
+        unsigned int a = constraints.a[c];
+        unsigned int b = constraints.b[c];
+        float wa = cloth.invMass[a];
+        float wb = cloth.invMass[b];
+
+        float dx = cloth.x[b] - cloth.x[a];
+        float dy = cloth.y[b] - cloth.y[a];
+        float dz = cloth.z[b] - cloth.z[a];
+        float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+        if(length < 1e-9f)
+        {
+            continue;
+        }
+
+        float s = (length - constraints.rest[c]) / ((wa + wb + constraints.compliance[c] * invH2) * length);
+        cloth.x[a] += wa * s * dx;
+        cloth.y[a] += wa * s * dy;
+        cloth.z[a] += wa * s * dz;
+        cloth.x[b] -= wb * s * dx;
+        cloth.y[b] -= wb * s * dy;
+        cloth.z[b] -= wb * s * dz;
+    }
+}
+
+/* moves the particles in [first, last) that are farther from their pinned particles than at rest back onto that distance */
+void tether(Cloth& cloth, std::size_t first, std::size_t last)
+{
+    std::size_t padded = cloth.x.size();
+    for(unsigned int tether = 0; tether < clothTethers; tether++)
+    {
+        const float* tx = &cloth.tetherX[tether * padded];
+        const float* ty = &cloth.tetherY[tether * padded];
+        const float* tz = &cloth.tetherZ[tether * padded];
+        const float* tl = &cloth.tetherLength[tether * padded];
+        for(std::size_t i = first; i < last; i++)
+        {
+            float dx = cloth.x[i] - tx[i];
+            float dy = cloth.y[i] - ty[i];
+            float dz = cloth.z[i] - tz[i];
+            float distance = std::sqrt(dx * dx + dy * dy + dz * dz);
+            if(distance > tl[i])
+            {
+                float s = cloth.invMass[i] * (tl[i] - distance) / distance;
+                cloth.x[i] += s * dx;
+                cloth.y[i] += s * dy;
+                cloth.z[i] += s * dz;
+            }
+        }
+    }
+}
+
+/* area weighted normals of the particles in [first, last), gathered from the adjacent triangles */
+void normals(Cloth& cloth, std::size_t first, std::size_t last)
+{
+    last = std::min(last, cloth.count);
+    for(std::size_t i = first; i < last; i++)
+    {
+        float nx = 0.0f, ny = 0.0f, nz = 0.0f;
+        for(unsigned int t = cloth.triangleOffsets[i]; t < cloth.triangleOffsets[i + 1]; t++)
+        {
+            const unsigned int* corners = &cloth.indices[cloth.vertexTriangles[t] * 3];
+            float ax = cloth.x[corners[1]] - cloth.x[corners[0]];
+            float ay = cloth.y[corners[1]] - cloth.y[corners[0]];
+            float az = cloth.z[corners[1]] - cloth.z[corners[0]];
+            float bx = cloth.x[corners[2]] - cloth.x[corners[0]];
+            float by = cloth.y[corners[2]] - cloth.y[corners[0]];
+            float bz = cloth.z[corners[2]] - cloth.z[corners[0]];
+            nx += ay * bz - az * by;
+            ny += az * bx - ax * bz;
+            nz += ax * by - ay * bx;
+        }
+
+        float length = std::sqrt(nx * nx + ny * ny + nz * nz);
+        if(length > 0.0f)
+        {
+            float scale = cloth.normalSign / length;
+            cloth.nx[i] = nx * scale;
+            cloth.ny[i] = ny * scale;
+            cloth.nz[i] = nz * scale;
+        }
+    }
+}
+
+void addConstraint(ClothConstraints& constraints, const Cloth& cloth, unsigned int a, unsigned int b, float compliance)
+{
+    /* constraints between pinned particles have nothing to move */
+    if(a == b || (cloth.invMass[a] == 0.0f && cloth.invMass[b] == 0.0f))
+    {
+        return;
+    }
+
+    float dx = cloth.rx[b] - cloth.rx[a];
+    float dy = cloth.ry[b] - cloth.ry[a];
+    float dz = cloth.rz[b] - cloth.rz[a];
+    constraints.a.push_back(a);
+    constraints.b.push_back(b);
+    constraints.rest.push_back(std::sqrt(dx * dx + dy * dy + dz * dz));
+    constraints.compliance.push_back(compliance);
+}
+
+/* greedy graph coloring, each constraint gets the lowest color none of the constraints of its particles has */
+ClothConstraints colorConstraints(const ClothConstraints& constraints, std::size_t particles)
+{
+    std::vector<uint64_t> used(particles, 0);
+    std::vector<unsigned int> color(constraints.a.size());
+    unsigned int colors = 0;
+    for(std::size_t c = 0; c < constraints.a.size(); c++)
+    {
+        uint64_t taken = used[constraints.a[c]] | used[constraints.b[c]];
+        if(taken == ~uint64_t(0))
+        {
+            throw std::runtime_error("[Cloth] More than 64 constraint colors needed, a particle has too many neighbours");
+        }
+
+        unsigned int free = 0;
+        while(taken & (uint64_t(1) << free))
+        {
+            free++;
+        }
+        color[c] = free;
+        colors = std::max(colors, free + 1);
+        used[constraints.a[c]] |= uint64_t(1) << free;
+        used[constraints.b[c]] |= uint64_t(1) << free;
+    }
+
+    /* counting sort by color, the order within a color stays the same */
+    ClothConstraints sorted;
+    sorted.colors.assign(colors + 1, 0);
+    for(unsigned int c : color)
+    {
+        sorted.colors[c + 1]++;
+    }
+    for(unsigned int c = 0; c < colors; c++)
+    {
+        sorted.colors[c + 1] += sorted.colors[c];
+    }
+
+    std::vector<std::size_t> next(sorted.colors.begin(), sorted.colors.end() - 1);
+    sorted.a.resize(constraints.a.size());
+    sorted.b.resize(constraints.a.size());
+    sorted.rest.resize(constraints.a.size());
+    sorted.compliance.resize(constraints.a.size());
+    for(std::size_t c = 0; c < constraints.a.size(); c++)
+    {
+        std::size_t index = next[color[c]]++;
+        sorted.a[index] = constraints.a[c];
+        sorted.b[index] = constraints.b[c];
+        sorted.rest[index] = constraints.rest[c];
+        sorted.compliance[index] = constraints.compliance[c];
+    }
+
+    return sorted;
+}
+
+}
+
+Cloth clothCreate(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices,
+                  const std::vector<unsigned int> &pinned, const Vector3D &windAxis, ClothSettings settings)
+{
+    Cloth cloth;
+    cloth.settings = settings;
+    cloth.count = vertices.size();
+    cloth.indices = indices;
+
+    /* padded particles are pinned at the origin and in no constraint */
+    std::size_t padded = (vertices.size() + flagKernelBlock - 1) / flagKernelBlock * flagKernelBlock;
+    for(ClothFloats* values : {&cloth.x, &cloth.y, &cloth.z, &cloth.px, &cloth.py, &cloth.pz, &cloth.invMass, &cloth.nx,
+                               &cloth.ny, &cloth.nz, &cloth.rx, &cloth.ry, &cloth.rz, &cloth.gustSin, &cloth.gustCos,
+                               &cloth.tetherX, &cloth.tetherY, &cloth.tetherZ, &cloth.tetherLength})
+    {
+        values->assign(padded, 0.0f);
+    }
+    for(ClothFloats* values : {&cloth.tetherX, &cloth.tetherY, &cloth.tetherZ, &cloth.tetherLength})
+    {
+        values->assign(padded * clothTethers, 0.0f);
+    }
+
+    Vector3D axis = normalize(windAxis);
+    Vector3D restNormal = {0.0f, 0.0f, 0.0f};
+    float k = 2.0f * static_cast<float>(M_PI) / settings.gustWavelength;
+    for(std::size_t i = 0; i < vertices.size(); i++)
+    {
+        const Vector3D& position = vertices[i].pos;
+        cloth.rx[i] = position.x;
+        cloth.ry[i] = position.y;
+        cloth.rz[i] = position.z;
+        cloth.invMass[i] = 1.0f;
+
+        float distance = dot(position, axis);
+        cloth.gustSin[i] = std::sin(k * distance);
+        cloth.gustCos[i] = std::cos(k * distance);
+        restNormal += Vector3D(vertices[i].normal.x, vertices[i].normal.y, vertices[i].normal.z);
+    }
+    for(unsigned int i : pinned)
+    {
+        cloth.invMass[i] = 0.0f;
+    }
+
+    /* the ends of the pinned particles (e.g. of the pole), the pinned particles farthest apart from each other */
+    unsigned int ends[2] = {0, 0};
+    for(int e = 0; e < 2 && !pinned.empty(); e++)
+    {
+        const Vector3D& from = vertices[e == 0 ? pinned[0] : ends[0]].pos;
+        float farthest = -1.0f;
+        for(unsigned int p : pinned)
+        {
+            float distance = length(vertices[p].pos - from);
+            if(distance > farthest)
+            {
+                farthest = distance;
+                ends[e] = p;
+            }
+        }
+    }
+
+    /* tethers to the nearest pinned particle and to both ends, without pinned particles the tethers never apply */
+    auto setTether = [&cloth, &vertices, padded](unsigned int tether, std::size_t i, unsigned int p)
+    {
+        std::size_t t = tether * padded + i;
+        cloth.tetherX[t] = vertices[p].pos.x;
+        cloth.tetherY[t] = vertices[p].pos.y;
+        cloth.tetherZ[t] = vertices[p].pos.z;
+        cloth.tetherLength[t] = length(vertices[p].pos - Vector3D(cloth.rx[i], cloth.ry[i], cloth.rz[i]));
+    };
+    for(std::size_t i = 0; i < padded; i++)
+    {
+        for(unsigned int tether = 0; tether < clothTethers; tether++)
+        {
+            cloth.tetherLength[tether * padded + i] = std::numeric_limits<float>::max();
+        }
+        if(pinned.empty())
+        {
+            continue;
+        }
+
+        setTether(1, i, ends[0]);
+        setTether(2, i, ends[1]);
+        for(unsigned int p : pinned)
+        {
+            float distance = length(vertices[p].pos - Vector3D(cloth.rx[i], cloth.ry[i], cloth.rz[i]));
+            if(distance < cloth.tetherLength[i])
+            {
+                setTether(0, i, p);
+            }
+        }
+    }
+
+    /* the gusts push along the mean normal, perpendicular to the wind */
+    Vector3D lateral = restNormal - axis * dot(restNormal, axis);
+    cloth.lateral = length(lateral) > 0.0f ? normalize(lateral) : Vector3D(0.0f, 0.0f, 0.0f);
+
+    /* edges with the corners opposite of them, the second one is ~0u for edges of one triangle */
+    std::vector<std::pair<unsigned int, unsigned int>> edges;
+    std::vector<std::pair<unsigned int, unsigned int>> opposite;
+    std::unordered_map<uint64_t, std::size_t> edgeIndex;
+    for(std::size_t t = 0; t + 2 < indices.size(); t += 3)
+    {
+        for(int e = 0; e < 3; e++)
+        {
+            unsigned int a = std::min(indices[t + e], indices[t + (e + 1) % 3]);
+            unsigned int b = std::max(indices[t + e], indices[t + (e + 1) % 3]);
+            unsigned int corner = indices[t + (e + 2) % 3];
+
+            auto [it, inserted] = edgeIndex.emplace((static_cast<uint64_t>(a) << 32) | b, edges.size());
+            if(inserted)
+            {
+                edges.emplace_back(a, b);
+                opposite.emplace_back(corner, ~0u);
+            }
+            else
+            {
+                opposite[it->second].second = corner;
+            }
+        }
+    }
+
+    ClothConstraints constraints;
+    for(std::size_t e = 0; e < edges.size(); e++)
+    {
+        detail::addConstraint(constraints, cloth, edges[e].first, edges[e].second, settings.distanceCompliance);
+    }
+    for(std::size_t e = 0; e < edges.size(); e++)
+    {
+        if(opposite[e].second != ~0u)
+        {
+            detail::addConstraint(constraints, cloth, opposite[e].first, opposite[e].second, settings.bendingCompliance);
+        }
+    }
+
+    /* the corrections of a substep travel a few edges, the longest tether in edges decides the substeps */
+    float edgeLength = 0.0f;
+    for(std::size_t e = 0; e < edges.size(); e++)
+    {
+        edgeLength += length(vertices[edges[e].second].pos - vertices[edges[e].first].pos) / edges.size();
+    }
+    float tetherLength = 0.0f;
+    for(std::size_t i = 0; i < cloth.count && !pinned.empty(); i++)
+    {
+        tetherLength = std::max(tetherLength, cloth.tetherLength[i]);
+    }
+    float tetherEdges = edgeLength > 0.0f ? tetherLength / edgeLength : 0.0f;
+    cloth.substeps = std::max(settings.minSubsteps, static_cast<unsigned int>(std::ceil(settings.substepsPerEdge * tetherEdges)));
+    cloth.constraints = detail::colorConstraints(constraints, cloth.count);
+
+    /* adjacent triangles of each particle for the normals */
+    cloth.triangleOffsets.assign(cloth.count + 1, 0);
+    for(unsigned int index : indices)
+    {
+        cloth.triangleOffsets[index + 1]++;
+    }
+    for(std::size_t i = 0; i < cloth.count; i++)
+    {
+        cloth.triangleOffsets[i + 1] += cloth.triangleOffsets[i];
+    }
+    cloth.vertexTriangles.resize(indices.size());
+    std::vector<unsigned int> next(cloth.triangleOffsets.begin(), cloth.triangleOffsets.end() - 1);
+    for(std::size_t i = 0; i < indices.size(); i++)
+    {
+        cloth.vertexTriangles[next[indices[i]]++] = static_cast<unsigned int>(i / 3);
+    }
+
+    clothReset(cloth);
+
+    /* the winding of the triangles decides the side of the normals, they have to face like the given normals */
+    float facing = 0.0f;
+    for(std::size_t i = 0; i < cloth.count; i++)
+    {
+        facing += cloth.nx[i] * vertices[i].normal.x + cloth.ny[i] * vertices[i].normal.y + cloth.nz[i] * vertices[i].normal.z;
+    }
+    if(facing < 0.0f)
+    {
+        cloth.normalSign = -1.0f;
+        detail::normals(cloth, 0, cloth.count);
+    }
+
+    return cloth;
+}
+
+void clothReset(Cloth &cloth)
+{
+    cloth.x = cloth.rx;
+    cloth.y = cloth.ry;
+    cloth.z = cloth.rz;
+    cloth.px = cloth.rx;
+    cloth.py = cloth.ry;
+    cloth.pz = cloth.rz;
+    cloth.time = 0.0f;
+    detail::normals(cloth, 0, cloth.count);
+}
+
+void clothStep(Cloth &cloth, const Vector3D &wind, const Vector3D &gravity, float dt, unsigned int threads)
+{
+    const ClothSettings& settings = cloth.settings;
+    float h = dt / cloth.substeps;
+
+    detail::ClothForces forces;
+    forces.wind = wind;
+    forces.gravity = gravity;
+    forces.gust = settings.gust * length(wind);
+    forces.invH = 1.0f / h;
+    forces.h2 = h * h;
+    forces.damping = std::pow(settings.damping, h);
+
+    std::size_t particles = cloth.x.size();
+    std::size_t particleJobs = (particles + clothParticlesPerJob - 1) / clothParticlesPerJob;
+    for(unsigned int substep = 0; substep < cloth.substeps; substep++)
+    {
+        float phase = settings.gustFrequency * (cloth.time + substep * h);
+        forces.gustSin = std::sin(phase);
+        forces.gustCos = std::cos(phase);
+
+        jobsParallelFor(particleJobs, [&cloth, &forces, particles](std::size_t job)
+        {
+            std::size_t first = job * clothParticlesPerJob;
+            std::size_t last = std::min(first + clothParticlesPerJob, particles);
+#ifdef CLOTH_SSE2
+            detail::integrateSSE2(cloth, forces, first, last);
+#else
+            detail::integrateScalar(cloth, forces, first, last);
+#endif
+        }, threads);
+
+        /* colors one after another, the constraints of a color in parallel */
+        const auto& colors = cloth.constraints.colors;
+        for(std::size_t color = 0; color + 1 < colors.size(); color++)
+        {
+            std::size_t begin = colors[color];
+            std::size_t end = colors[color + 1];
+            std::size_t jobs = (end - begin + clothConstraintsPerJob - 1) / clothConstraintsPerJob;
+            float invH2 = 1.0f / forces.h2;
+            jobsParallelFor(jobs, [&cloth, invH2, begin, end](std::size_t job)
+            {
+                std::size_t first = begin + job * clothConstraintsPerJob;
+                detail::solve(cloth, invH2, first, std::min(first + clothConstraintsPerJob, end));
+            }, threads);
+        }
+
+        jobsParallelFor(particleJobs, [&cloth, particles](std::size_t job)
+        {
+            std::size_t first = job * clothParticlesPerJob;
+            detail::tether(cloth, first, std::min(first + clothParticlesPerJob, particles));
+        }, threads);
+    }
+    cloth.time += dt;
+
+    jobsParallelFor(particleJobs, [&cloth](std::size_t job)
+    {
+        detail::normals(cloth, job * clothParticlesPerJob, (job + 1) * clothParticlesPerJob);
+    }, threads);
+}
+
+void clothWriteVertices(const Cloth &cloth, const std::vector<Vertex> &rest, Vertex *destination, unsigned int threads)
+{
+    std::size_t jobs = (cloth.count + clothParticlesPerJob - 1) / clothParticlesPerJob;
+    jobsParallelFor(jobs, [&cloth, &rest, destination](std::size_t job)
+    {
+        std::size_t first = job * clothParticlesPerJob;
+        std::size_t last = std::min(first + clothParticlesPerJob, cloth.count);
+        for(std::size_t i = first; i < last; i++)
+        {
+            Vertex vertex = rest[i];
+            vertex.pos = Vector3D(cloth.x[i], cloth.y[i], cloth.z[i]);
+            vertex.normal = Vector4D(cloth.nx[i], cloth.ny[i], cloth.nz[i], rest[i].normal.w);
+            destination[i] = vertex;
+        }
+    }, threads);
+}
+
+float clothStretch(const Cloth &cloth)
+{
+    /* the edges of the triangles, the bending constraints may shorten when the cloth folds */
+    float stretch = 0.0f;
+    for(std::size_t t = 0; t + 2 < cloth.indices.size(); t += 3)
+    {
+        for(int e = 0; e < 3; e++)
+        {
+            unsigned int a = cloth.indices[t + e];
+            unsigned int b = cloth.indices[t + (e + 1) % 3];
+            float rest = std::sqrt((cloth.rx[b] - cloth.rx[a]) * (cloth.rx[b] - cloth.rx[a]) +
+                                   (cloth.ry[b] - cloth.ry[a]) * (cloth.ry[b] - cloth.ry[a]) +
+                                   (cloth.rz[b] - cloth.rz[a]) * (cloth.rz[b] - cloth.rz[a]));
+            float length = std::sqrt((cloth.x[b] - cloth.x[a]) * (cloth.x[b] - cloth.x[a]) +
+                                     (cloth.y[b] - cloth.y[a]) * (cloth.y[b] - cloth.y[a]) +
+                                     (cloth.z[b] - cloth.z[a]) * (cloth.z[b] - cloth.z[a]));
+            if(rest > 0.0f)
+            {
+                stretch = std::max(stretch, std::abs(length - rest) / rest);
+            }
+        }
+    }
+
+    return stretch;
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+#include "mygl/mesh.h"
+
+#include "flagkernel.h"
+
+#include <cstddef>
+#include <vector>
+
+using ClothFloats = std::vector<float, AlignedAllocator<float>>;
+
+/*
+ * distance constraints of the cloth as structure of arrays, sorted by color. The constraints of one color share no
+ * particle, so that each color can be solved in parallel without locks.
+ */
+struct ClothConstraints
+{
+    std::vector<unsigned int> a;
+    std::vector<unsigned int> b;
+    std::vector<float> rest;
+    std::vector<float> compliance;
+
+    /* the constraints of color c are [colors[c], colors[c + 1]) */
+    std::vector<std::size_t> colors;
+};
+
+struct ClothSettings
+{
+    /* substeps per clothStep, each integrates and solves all constraints once. A substep carries the corrections only a
+     * few edges across the cloth, so for the same stretch the substeps grow with the number of edges between the pinned
+     * particles and the farthest particle (see Cloth::substeps) */
+    unsigned int minSubsteps = 8;
+    float substepsPerEdge = 0.2f;
+
+    /* compliance (XPBD, inverse stiffness) of the mesh edges and of the bending constraints across the edges between two
+     * triangles, 0 is inextensible. Unlike a stiffness per projection it does not change with the number of substeps */
+    float distanceCompliance = 0.0f;
+    float bendingCompliance = 3.5e-5f;
+
+    /* part of the velocity that is kept per second */
+    float damping = 0.38f;
+
+    /* acceleration along the normal per unit of relative wind speed along the normal */
+    float drag = 0.3f;
+
+    /* acceleration along the cloth per unit of relative wind speed along the cloth, lets the cloth stream in the wind */
+    float friction = 1.5f;
+
+    /* lateral wind as a part of the wind speed, travelling along the wind with gustWavelength and gustFrequency */
+    float gust = 0.15f;
+    float gustWavelength = 6.0f;
+    float gustFrequency = 2.5f;
+};
+
+/*
+ * Position based dynamics cloth with unit mass particles. Positions are integrated with Verlet integration in SIMD, then
+ * the constraints are projected color by color on the job system. Wind and gravity are given in the space of the cloth
+ * (see clothStep).
+ */
+struct Cloth
+{
+    std::size_t count = 0;
+
+    /* positions, positions of the previous substep and inverse masses (1, or 0 for pinned particles) */
+    ClothFloats x, y, z;
+    ClothFloats px, py, pz;
+    ClothFloats invMass;
+
+    /* area weighted normals of the particles, updated at the end of clothStep */
+    ClothFloats nx, ny, nz;
+
+    /* rest positions, clothReset returns to them */
+    ClothFloats rx, ry, rz;
+
+    /* phase of the gusts per particle, sine and cosine of the distance along the wind at rest */
+    ClothFloats gustSin, gustCos;
+
+    /* long range attachments: each particle stays within the rest distance of the nearest pinned particle and of both
+     * ends of the pinned particles, so that the cloth neither sags nor swings down around the pole while the edge
+     * corrections travel across it; clothTethers arrays of the padded size one after the other */
+    ClothFloats tetherX, tetherY, tetherZ, tetherLength;
+
+    /* direction the gusts push the particles, the mean normal at rest without the part along the wind */
+    Vector3D lateral;
+
+    ClothConstraints constraints;
+
+    /* triangles of the mesh and the triangles adjacent to each particle, those of particle i are
+     * vertexTriangles[triangleOffsets[i]] ... vertexTriangles[triangleOffsets[i + 1] - 1] */
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> triangleOffsets;
+    std::vector<unsigned int> vertexTriangles;
+
+    /* 1 or -1, so that the normals face the side of the normals of the vertices at rest */
+    float normalSign = 1.0f;
+
+    /* substeps per clothStep, from the settings and the number of edges along the longest tether */
+    unsigned int substeps = 0;
+
+    ClothSettings settings;
+    float time = 0.0f;
+};
+
+/* tethers per particle: to the nearest pinned particle and to the two pinned particles farthest apart */
+constexpr unsigned int clothTethers = 3;
+
+/* particles per job of the integration and the normals, constraints per job of one color */
+constexpr std::size_t clothParticlesPerJob = 4096;
+constexpr std::size_t clothConstraintsPerJob = 4096;
+
+/**
+ * @brief Creates a cloth from a triangle mesh. The edges of the triangles become distance constraints, the opposite
+ * corners of two triangles that share an edge a bending constraint, and each particle is tethered to the nearest pinned
+ * particle and to both ends of the pinned particles. The number of substeps grows with the resolution of the mesh (see ClothSettings::substepsPerEdge).
+ *
+ * @param vertices Rest positions and normals of the particles.
+ * @param indices Triangles of the mesh.
+ * @param pinned Particles that do not move, e.g. those that are attached to a pole.
+ * @param windAxis Direction of the wind in the cloth space the gusts travel along.
+ */
+Cloth clothCreate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices,
+                  const std::vector<unsigned int>& pinned, const Vector3D& windAxis, ClothSettings settings = ClothSettings());
+
+/**
+ * @brief Moves all particles back to their rest positions without velocity.
+ */
+void clothReset(Cloth& cloth);
+
+/**
+ * @brief Advances the cloth by dt in Cloth::substeps substeps.
+ *
+ * @param wind Velocity of the air relative to the pinned particles, in the space of the cloth.
+ * @param gravity Acceleration of gravity in the space of the cloth.
+ * @param threads Maximal number of threads, 0 uses all of them (see jobsParallelFor).
+ */
+void clothStep(Cloth& cloth, const Vector3D& wind, const Vector3D& gravity, float dt, unsigned int threads = 0);
+
+/**
+ * @brief Writes the positions and normals of the particles into vertices on the job system, the other attributes are
+ * taken from rest.
+ *
+ * @param rest Vertices the cloth was created from.
+ * @param destination Memory for all vertices, e.g. mapped gpu memory (see meshMapVertices).
+ */
+void clothWriteVertices(const Cloth& cloth, const std::vector<Vertex>& rest, Vertex* destination, unsigned int threads = 0);
+
+/**
+ * @brief Largest relative deviation of the triangle edges from their rest lengths, a measure of the stretch.
+ */
+float clothStretch(const Cloth& cloth);
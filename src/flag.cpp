@@ -1,45 +1,194 @@
 #include <algorithm>
 
 #include "flag.h"
+#include "mygl/jobs.h"
+#include "mygl/shader.h"
 
+#include <cmath>
+#include <cstddef>
+#include <limits>
 #include <stdexcept>
 
-float getDisplacementValue(Vector2D pos, const FlagSim &sim, int waveParamIndex)
+float getDisplacementValue(Vector2D pos, const FlagSim &sim, std::size_t waveParamIndex)
 {
     const WaveParams &params = sim.parameter[waveParamIndex];
     
-    return params.amplitude * static_cast<float>(sin(dot(normalize(params.direction), pos) * params.omega + sim.accumTime * params.phi));
+    return params.amplitude * static_cast<float>(sin(dot(normalize(params.direction), pos) * params.omega + (sim.accumTime * params.phi + params.offset)));
 }
 
 float flagDisplacement(const FlagSim &sim, Vector2D position, float minPosZ)
 {
-    float displacement = getDisplacementValue(position, sim, 0) + getDisplacementValue(position, sim, 1) + getDisplacementValue(position, sim, 2);
+    float displacement = 0.0f;
+    for (std::size_t i = 0; i < sim.parameter.size(); i++)
+    {
+        displacement += getDisplacementValue(position, sim, i);
+    }
     float positionScale = position[1] / minPosZ;
     return displacement * positionScale;
 }
 
-Flag flagCreate(const std::string& flagFilePath)
+Vector3D flagNormal(const FlagSim &sim, Vector2D position, float minPosZ)
+{
+    float displacement = 0.0f;
+    Vector2D slope = {0.0f, 0.0f};
+    for (const auto& params : sim.parameter)
+    {
+        Vector2D direction = normalize(params.direction);
+        float argument = dot(direction, position) * params.omega + (sim.accumTime * params.phi + params.offset);
+        displacement += params.amplitude * static_cast<float>(sin(argument));
+        slope += direction * (params.amplitude * static_cast<float>(cos(argument)) * params.omega);
+    }
+
+    /* D = S * y / minPosZ with the sum S of the waves and y the second coordinate of the position */
+    float positionScale = position[1] / minPosZ;
+    float dy = slope.x * positionScale;
+    float dz = slope.y * positionScale + displacement / minPosZ;
+    float length = std::sqrt(1.0f + dy * dy + dz * dz);
+    return Vector3D(1.0f / length, -dy / length, -dz / length);
+}
+
+std::vector<WaveParams> flagSpectrum(const FlagSpectrum &spectrum)
+{
+    std::vector<WaveParams> waves(spectrum.count);
+    float amplitudes = 0.0f;
+    for (unsigned int i = 0; i < spectrum.count; i++)
+    {
+        float t = spectrum.count > 1 ? static_cast<float>(i) / (spectrum.count - 1) : 0.0f;
+        float omega = spectrum.omegaMin * std::pow(spectrum.omegaMax / spectrum.omegaMin, t);
+
+        /* low discrepancy sequences (golden ratio and plastic number) spread directions and offsets without a random generator */
+        float angle = spectrum.spread * (2.0f * std::fmod(i * 0.618034f, 1.0f) - 1.0f);
+        float offset = 2.0f * static_cast<float>(M_PI) * std::fmod(i * 0.754878f, 1.0f);
+
+        waves[i].amplitude = std::pow(omega / spectrum.omegaMin, -spectrum.amplitudeFalloff);
+        waves[i].phi = spectrum.phi * std::sqrt(omega / spectrum.omegaMin);
+        waves[i].omega = omega;
+        waves[i].direction = Vector2D(std::sin(angle), std::cos(angle));
+        waves[i].offset = offset;
+        amplitudes += waves[i].amplitude * waves[i].amplitude;
+    }
+
+    for (auto& wave : waves)
+    {
+        wave.amplitude *= spectrum.amplitude / std::sqrt(amplitudes);
+    }
+    return waves;
+}
+
+void flagSimSetWaves(FlagSim &flagSim, std::vector<WaveParams> waves)
+{
+    flagSim.parameter = std::move(waves);
+    flagSim.revision++;
+}
+
+namespace detail
+{
+
+struct
+{
+    GLuint ubo = 0;
+    /* revision of the uploaded wave table, the table is uploaded with the first update */
+    unsigned int revision = 0;
+    bool uploaded = false;
+    FlagWaves data;
+} sFlagWaves;
+
+static_assert(sizeof(FlagWaves) == 16 + 2 * flagMaxWaves * 16, "FlagWaves has to match the std140 layout of the FlagWaves block");
+
+}
+
+void flagWavesUpdate(const FlagSim &flagSim)
+{
+    auto& waves = detail::sFlagWaves;
+    if (flagSim.parameter.size() > flagMaxWaves)
+    {
+        throw std::runtime_error("[Flag] " + std::to_string(flagSim.parameter.size()) + " waves, the flag shader takes at most " + std::to_string(flagMaxWaves));
+    }
+
+    if (!waves.ubo)
+    {
+        glGenBuffers(1, &waves.ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, waves.ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FlagWaves), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, eUniformBlock::FlagBlock, waves.ubo);
+    }
+
+    /* the header with the time changes every frame, the table only with the revision */
+    std::size_t bytes = offsetof(FlagWaves, waves);
+    waves.data.accumTime = flagSim.accumTime;
+    waves.data.count = static_cast<int>(flagSim.parameter.size());
+    if (!waves.uploaded || waves.revision != flagSim.revision)
+    {
+        for (std::size_t i = 0; i < flagSim.parameter.size(); i++)
+        {
+            /* normalized like in getDisplacementValue */
+            const WaveParams& params = flagSim.parameter[i];
+            Vector2D direction = normalize(params.direction);
+            waves.data.waves[2 * i] = Vector4D(direction.x, direction.y, params.omega, params.phi);
+            waves.data.waves[2 * i + 1] = Vector4D(params.amplitude, params.offset, 0.0f, 0.0f);
+        }
+        bytes += 2 * flagSim.parameter.size() * sizeof(Vector4D);
+        waves.revision = flagSim.revision;
+        waves.uploaded = true;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, waves.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, bytes, &waves.data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void flagWavesDelete()
+{
+    glDeleteBuffers(1, &detail::sFlagWaves.ubo);
+    detail::sFlagWaves.ubo = 0;
+    detail::sFlagWaves.uploaded = false;
+}
+
+ModelOptions flagModelOptions()
+{
+    ModelOptions options;
+    options.format = eVertexFormat::FLOAT;
+    return options;
+}
+
+Flag flagFromModels(const std::vector<Model>& models, std::vector<ModelData> data)
 {
     Flag flag;
-    std::vector<Model> models = modelLoad(flagFilePath);
 
     if(models.size() != 1)
     {
         throw std::runtime_error("[Flag] number of parts do not match!" + std::to_string(models.size()));
     }
+
     flag.model = models[0];
     flag.minPosZ = -8.0f;
 
-    /* 
-     * Load vertices for flag, not required in implementation of shader based animation
-     *
-     * TODO - Remove this part if flag animation in shader implemented
-     */
-    flag.vertices = verticesLoad(flagFilePath);
+    /* cpu side vertices for the cpu animation (see animateFlag) */
+    flag.vertices = std::move(data[0].vertices);
+    flag.positions = flagVertices(flag.vertices);
+
+    /* the cloth is only created when it is switched on (see flagClothCreate) */
+    flag.restVertices = flag.vertices;
+    flag.indices = std::move(data[0].indices);
 
     return flag;
 }
 
+Flag flagCreate(const std::string& flagFilePath)
+{
+    std::vector<ModelData> data;
+    std::vector<Model> models = modelLoad(flagFilePath, flagModelOptions(), data);
+    return flagFromModels(models, std::move(data));
+}
+
+void flagCreateAsync(const std::string& flagFilePath, std::function<void(Flag)> done)
+{
+    modelLoadAsync(flagFilePath, flagModelOptions(), [done](std::vector<Model> models, std::vector<ModelData> data)
+    {
+        done(flagFromModels(models, std::move(data)));
+    });
+}
+
 void flagDelete(Flag &flag)
 {
     modelDelete(flag.model);
@@ -51,18 +200,91 @@ void updateSimulation(FlagSim& flagSim, float speedFactor, float dt)
     flagSim.accumTime += dtMultiplier * dt;
 }
 
-void animateFlag(Flag &flag, FlagSim &flagSim)
+std::vector<FlagWave> flagWaves(const FlagSim& flagSim)
+{
+    std::vector<FlagWave> waves;
+    for (const auto& params : flagSim.parameter)
+    {
+        /* normalized and multiplied like in getDisplacementValue, so that the scalar kernel gives the same result */
+        Vector2D direction = normalize(params.direction);
+        waves.push_back({direction.x, direction.y, params.omega, flagSim.accumTime * params.phi + params.offset, params.amplitude});
+    }
+    return waves;
+}
+
+void animateFlagVertices(Flag &flag, const FlagSim &flagSim, Vertex *destination, eFlagKernel kernel, unsigned int threads)
+{
+    std::vector<FlagWave> waves = flagWaves(flagSim);
+    std::size_t count = flag.positions.count;
+    std::size_t ranges = (count + flagRangeVertices - 1) / flagRangeVertices;
+
+    /* each job computes its positions and writes its whole vertices, so the copy to the destination is parallel too */
+    jobsParallelFor(ranges, [&flag, &waves, destination, kernel, count](std::size_t range)
+    {
+        std::size_t first = range * flagRangeVertices;
+        std::size_t last = std::min(first + flagRangeVertices, count);
+        flagKernelRun(kernel, flag.positions, waves, flag.minPosZ, first, last);
+        for (std::size_t i = first; i < last; i++)
+        {
+            Vertex& vertex = flag.vertices[i];
+            float side = vertex.normal.x < 0.0f ? -1.0f : 1.0f;
+            vertex.pos.x = flag.positions.x[i];
+            vertex.normal = Vector4D(side * flag.positions.nx[i], side * flag.positions.ny[i], side * flag.positions.nz[i], vertex.normal.w);
+            destination[i] = vertex;
+        }
+    }, threads);
+}
+
+void animateFlag(Flag &flag, FlagSim &flagSim, eFlagKernel kernel)
 {
-    for (unsigned i = 0; i < flag.vertices.size(); i++)
+    Vertex* vertices = meshMapVertices(flag.model.mesh);
+    animateFlagVertices(flag, flagSim, vertices, kernel);
+    if (!meshUnmapVertices(flag.model.mesh))
     {
-        flag.vertices[i].pos.x = flagDisplacement(flagSim, {flag.vertices[i].pos.y, flag.vertices[i].pos.z}, flag.minPosZ);
+        meshUpdateVertices(flag.model.mesh, flag.vertices);
     }
-    glBindVertexArray(flag.model.mesh.vao);
+}
+
+void flagClothCreate(Flag &flag)
+{
+    if (flag.cloth.count != 0)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, flag.model.mesh.vbo);
-        glBufferData(GL_ARRAY_BUFFER, flag.vertices.size() * sizeof(Vertex), flag.vertices.data(), GL_DYNAMIC_DRAW);
-        glCheckError();
+        return;
     }
-    glBindVertexArray(0);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    /* the edge at the flag connector is the one with the largest z, the waves leave it in place as well */
+    float maxPosZ = -std::numeric_limits<float>::max();
+    for (const auto& vertex : flag.restVertices)
+    {
+        maxPosZ = std::max(maxPosZ, vertex.pos.z);
+    }
+    std::vector<unsigned int> pinned;
+    for (std::size_t i = 0; i < flag.restVertices.size(); i++)
+    {
+        if (flag.restVertices[i].pos.z > maxPosZ - 1e-4f)
+        {
+            pinned.push_back(static_cast<unsigned int>(i));
+        }
+    }
+    flag.cloth = clothCreate(flag.restVertices, flag.indices, pinned, Vector3D(0.0f, 0.0f, -1.0f));
+}
+
+void flagClothStep(Flag &flag, const Vector3D &wind, const Vector3D &gravity, float dt)
+{
+    clothStep(flag.cloth, wind, gravity, std::min(dt, flagClothMaxDt));
+
+    Vertex* vertices = meshMapVertices(flag.model.mesh);
+    clothWriteVertices(flag.cloth, flag.restVertices, vertices);
+    if (!meshUnmapVertices(flag.model.mesh))
+    {
+        std::vector<Vertex> cloth(flag.restVertices.size());
+        clothWriteVertices(flag.cloth, flag.restVertices, cloth.data());
+        meshUpdateVertices(flag.model.mesh, cloth);
+    }
+}
+
+void flagClothReset(Flag &flag)
+{
+    clothReset(flag.cloth);
+    meshUpdateVertices(flag.model.mesh, flag.restVertices);
 }
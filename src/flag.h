@@ -3,24 +3,32 @@
 #include "mygl/base.h"
 #include "mygl/model.h"
 
+#include "cloth.h"
+#include "flagkernel.h"
+
 struct WaveParams
 {
     float amplitude;
     float phi;
     float omega;
     Vector2D direction;
+    /* phase of the wave at the origin at time 0 */
+    float offset = 0.0f;
 };
 
 struct FlagSim
 {
     /**
-     * Parameters for the 3 wave functions for the flag simulation
+     * Parameters of the wave functions for the flag simulation, any number of them (see flagSpectrum). Changes have to
+     * increment revision (see flagSimSetWaves)
      */
-    WaveParams parameter[3] = {
+    std::vector<WaveParams> parameter = {
         { 1.0f,  1.0f,  0.25f, normalize(Vector2D{0.0f,  1.0f}) },
         { 0.2f,  1.5f, 0.75f,  normalize(Vector2D{0.0f, 1.0f}) },
         { 0.1f,  5.0f,  2.0f,  normalize(Vector2D{-1.0f / 3.0f, 1.0f}) },
     };
+    /* incremented when the waves change, the wave table of the flag shader is only uploaded again then */
+    unsigned int revision = 0;
 
     float minDtFactor = 0.8f;
     float maxDtFactor = 4.0f;
@@ -28,15 +36,70 @@ struct FlagSim
     float accumTime = 0.0f;
 };
 
+/* spectrum of waves driven by the wind along the flag (see flagSpectrum) */
+struct FlagSpectrum
+{
+    unsigned int count = 64;
+
+    /* root of the summed squared amplitudes, the waves have random phases so this is the typical displacement (about 1
+     * for the default waves of FlagSim), the amplitudes fall off with omega^-amplitudeFalloff */
+    float amplitude = 1.0f;
+    float amplitudeFalloff = 1.5f;
+
+    /* angular frequencies from omegaMin to omegaMax, geometrically spaced */
+    float omegaMin = 0.25f;
+    float omegaMax = 8.0f;
+
+    /* phase speed of the wave with omegaMin, the others travel with sqrt(omega / omegaMin) times of it */
+    float phi = 1.0f;
+
+    /* largest angle between a wave and the wind, which blows along the flag (direction (0, 1)) */
+    float spread = 0.6f;
+};
+
+/* waves the wave table of the flag shader holds at most, the FLAG_MAX_WAVES define of the flag permutation */
+constexpr unsigned int flagMaxWaves = 256;
+
+/* std140 layout of the FlagWaves uniform block in src/shader/default.vert, two vec4 per wave */
+struct FlagWaves
+{
+    float accumTime;
+    int count;
+    float _padding[2];
+    /* direction y and z, omega and phase speed, then amplitude and phase offset */
+    Vector4D waves[2 * flagMaxWaves];
+};
+
+/* animation of the flag, selectable at runtime (see Plane::flagSimulation) */
+enum class eFlagSimulation
+{
+    WAVES = 0,  // sum of sine waves, displaced in the vertex shader
+    CLOTH       // position based dynamics cloth on the cpu, driven by the speed and rotation of the plane
+};
+
 struct Flag {
     Model model;
 
-    /* vertices of the flag, not required anymore in solution with shader based animation */
+    /* vertices of the flag as the cpu animation left them (see animateFlag), the shader animation leaves them at rest */
     std::vector<Vertex> vertices;
+    /* positions of the vertices as structure of arrays for the cpu kernels (see animateFlag) */
+    FlagVertices positions;
+
+    /* vertices at rest and the triangles of the flag mesh, the cloth is created from them on the first switch to the
+     * cloth simulation and stays empty until then (see flagClothCreate) */
+    std::vector<Vertex> restVertices;
+    std::vector<unsigned int> indices;
+    Cloth cloth;
 
     float minPosZ;
 };
 
+/**
+ * @brief Options flagCreate passes to modelLoad, float vertices that animateFlag can write directly. The asset baker
+ * bakes the flag with the same options.
+ */
+ModelOptions flagModelOptions();
+
 /**
  * @brief Initializes a plane grid to visualize flag surface. For that a vector containing all grid vertices is created and
  * a mesh (see function meshCreate(...)) is setup with these vertices.
@@ -48,12 +111,18 @@ struct Flag {
  * usage:
  *
  *   Flag myFlag = flagCreate({0.0, 0.0, 1.0, 0.5})
- *   glBindVertexArray(myFlag.mesh.vao);
- *   glDrawElements(GL_TRIANGLES, myFlag.size_ibo, GL_UNSIGNED_INT, nullptr);
+ *   glBindVertexArray(meshVertexArray(myFlag.model.mesh.format));
+ *   glDrawElementsBaseVertex(GL_TRIANGLES, myFlag.model.mesh.size_ibo, myFlag.model.mesh.indexType,
+ *                            meshIndexOffset(myFlag.model.mesh, 0), meshBaseVertex(myFlag.model.mesh));
  *
  */
 Flag flagCreate(const std::string& flagFilePath);
 
+/**
+ * @brief Loads the flag on the job system like flagCreate, done receives the flag on the main thread (see jobsPoll).
+ */
+void flagCreateAsync(const std::string& flagFilePath, std::function<void(Flag)> done);
+
 
 /**
  * @brief Cleanup and delete all OpenGL buffers of the flag mesh. Has to be called for each flag after it is not used anymore.
@@ -72,11 +141,95 @@ void flagDelete(Flag& flag);
 void updateSimulation(FlagSim& flagSim, float speedFactor, float dt);
 
 /**
- * @brief Animates the flag by updating the vertex positions of the flag mesh.
+ * @brief Waves of a wind spectrum: geometrically spaced frequencies whose amplitudes fall off with the frequency,
+ * directions spread around the wind and phase offsets from low discrepancy sequences, so the spectrum is deterministic.
+ */
+std::vector<WaveParams> flagSpectrum(const FlagSpectrum& spectrum);
+
+/**
+ * @brief Replaces the waves of the flag simulation and increments its revision.
+ */
+void flagSimSetWaves(FlagSim& flagSim, std::vector<WaveParams> waves);
+
+/**
+ * @brief Uploads the accumulated time of the flag simulation into the uniform buffer bound to the "FlagWaves" block
+ * (see eUniformBlock), and the wave table only if the revision of the simulation changed since the last upload. Has to
+ * be called before the first flag draw of a frame.
+ */
+void flagWavesUpdate(const FlagSim& flagSim);
+
+/**
+ * @brief Deletes the uniform buffer of the flag waves.
+ */
+void flagWavesDelete();
+
+/**
+ * @brief Displacement of the flag at a position in its y/z plane, with the standard library sine per wave. Reference for
+ * the cpu kernels (see flagKernelRun).
+ */
+float flagDisplacement(const FlagSim& sim, Vector2D position, float minPosZ);
+
+/**
+ * @brief Normal of the displaced flag at a position in its y/z plane, from the partial derivatives of flagDisplacement:
+ * the surface (D(y, z), y, z) has the normal normalize(1, -dD/dy, -dD/dz). The flag shader (see flagWave in
+ * shader/default.vert) and the cpu kernels evaluate the same derivatives, so no neighbouring vertices are needed.
  *
- * TODO - This function should be replaced by a shader based animation in the assignment and the it should be removed.
+ * @return Normal facing +x like the normals of the flag at rest.
+ */
+Vector3D flagNormal(const FlagSim& sim, Vector2D position, float minPosZ);
+
+/**
+ * @brief Waves of the flag simulation at its current accumulated time, in the form the cpu kernels take them.
+ */
+std::vector<FlagWave> flagWaves(const FlagSim& flagSim);
+
+/* vertices per job of the threaded flag update (see animateFlagVertices), a multiple of flagKernelBlock */
+constexpr std::size_t flagRangeVertices = 8192;
+
+/**
+ * @brief Computes the animated vertices of the flag in ranges of flagRangeVertices on the job system and writes them to
+ * destination, e.g. mapped gpu memory (see meshMapVertices). Positions and analytic normals (see flagNormal) in
+ * Flag::vertices are updated as well, normals keep the side of the flag they faced at rest. Needs no OpenGL context, so
+ * that it can also run headless.
+ *
+ * @param destination Memory for all vertices of the flag, all of them are written.
+ * @param kernel Implementation of the displacement.
+ * @param threads Maximal number of threads working on the ranges, 0 uses all of them (see jobsParallelFor).
+ */
+void animateFlagVertices(Flag& flag, const FlagSim& flagSim, Vertex* destination, eFlagKernel kernel,
+                         unsigned int threads = 0);
+
+/**
+ * @brief Animates the flag on the cpu by updating the vertex positions of the flag mesh. The vertices are computed with
+ * the fastest cpu kernel (see flagKernelBest) on the job system and written straight into the mapped vertex buffer of
+ * the mesh. The application displaces the flag in the vertex shader instead (see flagWavesUpdate), this is the backend
+ * for contexts without the flag shader and, through animateFlagVertices, for headless use such as the benchmarks.
  *
  * @param flag Flag to be animated.
  * @param flagSim Object for flag simulation.
+ * @param kernel Implementation of the displacement.
+ */
+void animateFlag(Flag& flag, FlagSim& flagSim, eFlagKernel kernel = flagKernelBest());
+
+/* longest time step of the cloth, longer frames (e.g. after a stall) are simulated slower instead of unstable */
+constexpr float flagClothMaxDt = 1.0f / 30.0f;
+
+/**
+ * @brief Creates the cloth of the flag from its rest vertices, pinned along the edge at the flag connector. Does nothing
+ * if the cloth already exists.
+ */
+void flagClothCreate(Flag& flag);
+
+/**
+ * @brief Advances the cloth of the flag by dt (at most flagClothMaxDt) and writes its positions and normals into the mapped vertex buffer of the
+ * flag mesh, which is drawn with the CLOTH permutation of the flag shader.
+ *
+ * @param wind Velocity of the air relative to the flag in the space of the flag mesh.
+ * @param gravity Acceleration of gravity in the space of the flag mesh.
+ */
+void flagClothStep(Flag& flag, const Vector3D& wind, const Vector3D& gravity, float dt);
+
+/**
+ * @brief Returns the cloth of the flag to rest and uploads the rest vertices, which the wave simulation displaces.
  */
-void animateFlag(Flag& flag, FlagSim& flagSim);
+void flagClothReset(Flag& flag);
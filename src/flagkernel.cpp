@@ -0,0 +1,308 @@
+#include "flagkernel.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define FLAG_KERNEL_SSE2
+#include <immintrin.h>
+#if defined(__GNUC__)
+/* the AVX2 kernel is compiled for AVX2 with a target attribute and only called if the cpu has it */
+#define FLAG_KERNEL_AVX2
+#endif
+#endif
+
+namespace detail
+{
+
+/* pi split into parts with few mantissa bits, k * part is exact for the multiples k of pi in the range reduction */
+constexpr float piPart1 = 3.140625f;
+constexpr float piPart2 = 9.67502593994140625e-4f;
+constexpr float piPart3 = 1.509957990978376432e-7f;
+constexpr float invPi = 0.318309886183790671538f;
+
+/* minimax polynomials of sin(r)/r - 1 and cos(r) - 1 in r^2 for r in [-pi/2, pi/2] */
+constexpr float sinC1 = -0.16666667f;
+constexpr float sinC2 = 0.0083333310f;
+constexpr float sinC3 = -0.00019840874f;
+constexpr float sinC4 = 2.7525562e-06f;
+constexpr float sinC5 = -2.3889859e-08f;
+constexpr float cosC1 = -0.5f;
+constexpr float cosC2 = 0.041666638f;
+constexpr float cosC3 = -0.0013888378f;
+constexpr float cosC4 = 2.4760495e-05f;
+constexpr float cosC5 = -2.6051615e-07f;
+
+/*
+ * the same float operations as flagDisplacement and flagNormal in flag.cpp, so that only the sine and cosine differ
+ * between the kernels. With the sum S of the waves and the scale z / minPosZ the displacement is D = S * scale, its
+ * derivatives are dD/dy = dS/dy * scale and dD/dz = dS/dz * scale + S / minPosZ.
+ */
+void runScalar(FlagVertices& vertices, const std::vector<FlagWave>& waves, float minPosZ, std::size_t first, std::size_t last)
+{
+    for(std::size_t i = first; i < last; i++)
+    {
+        float y = vertices.y[i];
+        float z = vertices.z[i];
+        float displacement = 0.0f;
+        float dy = 0.0f;
+        float dz = 0.0f;
+        for(const auto& wave : waves)
+        {
+            float argument = (wave.directionY * y + wave.directionZ * z) * wave.omega + wave.phase;
+            displacement += wave.amplitude * std::sin(argument);
+            float slope = wave.amplitude * std::cos(argument) * wave.omega;
+            dy += slope * wave.directionY;
+            dz += slope * wave.directionZ;
+        }
+        float scale = z / minPosZ;
+        vertices.x[i] = displacement * scale;
+
+        dy = dy * scale;
+        dz = dz * scale + displacement / minPosZ;
+        float length = std::sqrt(1.0f + dy * dy + dz * dz);
+        vertices.nx[i] = 1.0f / length;
+        vertices.ny[i] = -dy / length;
+        vertices.nz[i] = -dz / length;
+    }
+}
+
+#ifdef FLAG_KERNEL_SSE2
+/* sine and cosine of 4 floats, reduced by the nearest multiple k of pi, the signs flip for odd k */
+inline void sincos4(__m128 x, __m128& sine, __m128& cosine)
+{
+    __m128i k = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(invPi)));
+    __m128 kf = _mm_cvtepi32_ps(k);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(kf, _mm_set1_ps(piPart1)));
+    r = _mm_sub_ps(r, _mm_mul_ps(kf, _mm_set1_ps(piPart2)));
+    r = _mm_sub_ps(r, _mm_mul_ps(kf, _mm_set1_ps(piPart3)));
+    __m128 r2 = _mm_mul_ps(r, r);
+    __m128 sign = _mm_castsi128_ps(_mm_slli_epi32(k, 31));
+
+    __m128 p = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(sinC5), r2), _mm_set1_ps(sinC4));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(sinC3));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(sinC2));
+    p = _mm_add_ps(_mm_mul_ps(p, r2), _mm_set1_ps(sinC1));
+    p = _mm_mul_ps(_mm_mul_ps(p, r2), r);
+    sine = _mm_xor_ps(_mm_add_ps(r, p), sign);
+
+    __m128 q = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(cosC5), r2), _mm_set1_ps(cosC4));
+    q = _mm_add_ps(_mm_mul_ps(q, r2), _mm_set1_ps(cosC3));
+    q = _mm_add_ps(_mm_mul_ps(q, r2), _mm_set1_ps(cosC2));
+    q = _mm_add_ps(_mm_mul_ps(q, r2), _mm_set1_ps(cosC1));
+    q = _mm_mul_ps(q, r2);
+    cosine = _mm_xor_ps(_mm_add_ps(_mm_set1_ps(1.0f), q), sign);
+}
+
+void runSSE2(FlagVertices& vertices, const std::vector<FlagWave>& waves, float minPosZ, std::size_t first, std::size_t last)
+{
+    const __m128 minZ = _mm_set1_ps(minPosZ);
+    const __m128 one = _mm_set1_ps(1.0f);
+    for(std::size_t i = first; i < last; i += 4)
+    {
+        __m128 y = _mm_load_ps(&vertices.y[i]);
+        __m128 z = _mm_load_ps(&vertices.z[i]);
+        __m128 displacement = _mm_setzero_ps();
+        __m128 dy = _mm_setzero_ps();
+        __m128 dz = _mm_setzero_ps();
+        for(const auto& wave : waves)
+        {
+            __m128 directionY = _mm_set1_ps(wave.directionY);
+            __m128 directionZ = _mm_set1_ps(wave.directionZ);
+            __m128 amplitude = _mm_set1_ps(wave.amplitude);
+            __m128 argument = _mm_add_ps(_mm_mul_ps(directionY, y), _mm_mul_ps(directionZ, z));
+            argument = _mm_add_ps(_mm_mul_ps(argument, _mm_set1_ps(wave.omega)), _mm_set1_ps(wave.phase));
+
+            __m128 sine, cosine;
+            sincos4(argument, sine, cosine);
+            displacement = _mm_add_ps(displacement, _mm_mul_ps(amplitude, sine));
+            __m128 slope = _mm_mul_ps(_mm_mul_ps(amplitude, cosine), _mm_set1_ps(wave.omega));
+            dy = _mm_add_ps(dy, _mm_mul_ps(slope, directionY));
+            dz = _mm_add_ps(dz, _mm_mul_ps(slope, directionZ));
+        }
+        __m128 scale = _mm_div_ps(z, minZ);
+        _mm_store_ps(&vertices.x[i], _mm_mul_ps(displacement, scale));
+
+        dy = _mm_mul_ps(dy, scale);
+        dz = _mm_add_ps(_mm_mul_ps(dz, scale), _mm_div_ps(displacement, minZ));
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz)));
+        __m128 zero = _mm_setzero_ps();
+        _mm_store_ps(&vertices.nx[i], _mm_div_ps(one, length));
+        _mm_store_ps(&vertices.ny[i], _mm_div_ps(_mm_sub_ps(zero, dy), length));
+        _mm_store_ps(&vertices.nz[i], _mm_div_ps(_mm_sub_ps(zero, dz), length));
+    }
+}
+#endif
+
+#ifdef FLAG_KERNEL_AVX2
+/* like sincos4, without fma so that the arguments are rounded like in the scalar kernel */
+__attribute__((target("avx2"))) inline void sincos8(__m256 x, __m256& sine, __m256& cosine)
+{
+    __m256i k = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(invPi)));
+    __m256 kf = _mm256_cvtepi32_ps(k);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(kf, _mm256_set1_ps(piPart1)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(kf, _mm256_set1_ps(piPart2)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(kf, _mm256_set1_ps(piPart3)));
+    __m256 r2 = _mm256_mul_ps(r, r);
+    __m256 sign = _mm256_castsi256_ps(_mm256_slli_epi32(k, 31));
+
+    __m256 p = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(sinC5), r2), _mm256_set1_ps(sinC4));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(sinC3));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(sinC2));
+    p = _mm256_add_ps(_mm256_mul_ps(p, r2), _mm256_set1_ps(sinC1));
+    p = _mm256_mul_ps(_mm256_mul_ps(p, r2), r);
+    sine = _mm256_xor_ps(_mm256_add_ps(r, p), sign);
+
+    __m256 q = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(cosC5), r2), _mm256_set1_ps(cosC4));
+    q = _mm256_add_ps(_mm256_mul_ps(q, r2), _mm256_set1_ps(cosC3));
+    q = _mm256_add_ps(_mm256_mul_ps(q, r2), _mm256_set1_ps(cosC2));
+    q = _mm256_add_ps(_mm256_mul_ps(q, r2), _mm256_set1_ps(cosC1));
+    q = _mm256_mul_ps(q, r2);
+    cosine = _mm256_xor_ps(_mm256_add_ps(_mm256_set1_ps(1.0f), q), sign);
+}
+
+__attribute__((target("avx2")))
+void runAVX2(FlagVertices& vertices, const std::vector<FlagWave>& waves, float minPosZ, std::size_t first, std::size_t last)
+{
+    const __m256 minZ = _mm256_set1_ps(minPosZ);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    for(std::size_t i = first; i < last; i += 8)
+    {
+        __m256 y = _mm256_load_ps(&vertices.y[i]);
+        __m256 z = _mm256_load_ps(&vertices.z[i]);
+        __m256 displacement = _mm256_setzero_ps();
+        __m256 dy = _mm256_setzero_ps();
+        __m256 dz = _mm256_setzero_ps();
+        for(const auto& wave : waves)
+        {
+            __m256 directionY = _mm256_set1_ps(wave.directionY);
+            __m256 directionZ = _mm256_set1_ps(wave.directionZ);
+            __m256 amplitude = _mm256_set1_ps(wave.amplitude);
+            __m256 argument = _mm256_add_ps(_mm256_mul_ps(directionY, y), _mm256_mul_ps(directionZ, z));
+            argument = _mm256_add_ps(_mm256_mul_ps(argument, _mm256_set1_ps(wave.omega)), _mm256_set1_ps(wave.phase));
+
+            __m256 sine, cosine;
+            sincos8(argument, sine, cosine);
+            displacement = _mm256_add_ps(displacement, _mm256_mul_ps(amplitude, sine));
+            __m256 slope = _mm256_mul_ps(_mm256_mul_ps(amplitude, cosine), _mm256_set1_ps(wave.omega));
+            dy = _mm256_add_ps(dy, _mm256_mul_ps(slope, directionY));
+            dz = _mm256_add_ps(dz, _mm256_mul_ps(slope, directionZ));
+        }
+        __m256 scale = _mm256_div_ps(z, minZ);
+        _mm256_store_ps(&vertices.x[i], _mm256_mul_ps(displacement, scale));
+
+        dy = _mm256_mul_ps(dy, scale);
+        dz = _mm256_add_ps(_mm256_mul_ps(dz, scale), _mm256_div_ps(displacement, minZ));
+        __m256 length = _mm256_sqrt_ps(_mm256_add_ps(_mm256_add_ps(one, _mm256_mul_ps(dy, dy)), _mm256_mul_ps(dz, dz)));
+        __m256 zero = _mm256_setzero_ps();
+        _mm256_store_ps(&vertices.nx[i], _mm256_div_ps(one, length));
+        _mm256_store_ps(&vertices.ny[i], _mm256_div_ps(_mm256_sub_ps(zero, dy), length));
+        _mm256_store_ps(&vertices.nz[i], _mm256_div_ps(_mm256_sub_ps(zero, dz), length));
+    }
+}
+#endif
+
+}
+
+FlagVertices flagVertices(const std::vector<Vertex> &vertices)
+{
+    FlagVertices soa;
+    soa.count = vertices.size();
+
+    std::size_t padded = (vertices.size() + flagKernelBlock - 1) / flagKernelBlock * flagKernelBlock;
+    soa.x.assign(padded, 0.0f);
+    soa.y.assign(padded, 0.0f);
+    soa.z.assign(padded, 0.0f);
+    soa.nx.assign(padded, 1.0f);
+    soa.ny.assign(padded, 0.0f);
+    soa.nz.assign(padded, 0.0f);
+    for(std::size_t i = 0; i < vertices.size(); i++)
+    {
+        soa.x[i] = vertices[i].pos.x;
+        soa.y[i] = vertices[i].pos.y;
+        soa.z[i] = vertices[i].pos.z;
+        soa.nx[i] = vertices[i].normal.x;
+        soa.ny[i] = vertices[i].normal.y;
+        soa.nz[i] = vertices[i].normal.z;
+    }
+
+    return soa;
+}
+
+void flagVerticesStore(const FlagVertices &soa, std::vector<Vertex> &vertices)
+{
+    for(std::size_t i = 0; i < soa.count; i++)
+    {
+        vertices[i].pos.x = soa.x[i];
+        vertices[i].normal = Vector4D(soa.nx[i], soa.ny[i], soa.nz[i], vertices[i].normal.w);
+    }
+}
+
+bool flagKernelSupported(eFlagKernel kernel)
+{
+    switch(kernel)
+    {
+        case eFlagKernel::SCALAR:
+            return true;
+#ifdef FLAG_KERNEL_SSE2
+        case eFlagKernel::SSE2:
+            return true;
+#endif
+#ifdef FLAG_KERNEL_AVX2
+        case eFlagKernel::AVX2:
+        {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+        }
+#endif
+        default:
+            return false;
+    }
+}
+
+eFlagKernel flagKernelBest()
+{
+    static const eFlagKernel best = flagKernelSupported(eFlagKernel::AVX2) ? eFlagKernel::AVX2
+                                  : flagKernelSupported(eFlagKernel::SSE2) ? eFlagKernel::SSE2
+                                                                           : eFlagKernel::SCALAR;
+    return best;
+}
+
+const char* flagKernelName(eFlagKernel kernel)
+{
+    switch(kernel)
+    {
+        case eFlagKernel::SCALAR: return "scalar";
+        case eFlagKernel::SSE2: return "sse2";
+        case eFlagKernel::AVX2: return "avx2";
+        default: return "unknown";
+    }
+}
+
+void flagKernelRun(eFlagKernel kernel, FlagVertices &vertices, const std::vector<FlagWave> &waves, float minPosZ,
+                   std::size_t first, std::size_t last)
+{
+    /* ranges end at a block boundary, the padding is computed like the other vertices */
+    last = std::min((last + flagKernelBlock - 1) / flagKernelBlock * flagKernelBlock, vertices.x.size());
+    if(first >= last)
+    {
+        return;
+    }
+
+    switch(kernel)
+    {
+#ifdef FLAG_KERNEL_SSE2
+        case eFlagKernel::SSE2:
+            detail::runSSE2(vertices, waves, minPosZ, first, last);
+            break;
+#endif
+#ifdef FLAG_KERNEL_AVX2
+        case eFlagKernel::AVX2:
+            detail::runAVX2(vertices, waves, minPosZ, first, last);
+            break;
+#endif
+        default:
+            detail::runScalar(vertices, waves, minPosZ, first, last);
+            break;
+    }
+}
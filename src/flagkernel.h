@@ -0,0 +1,113 @@
+#pragma once
+
+#include "mygl/mesh.h"
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/* allocator with 32 byte aligned storage, so that the flag kernels can use aligned SIMD loads and stores */
+template<typename T>
+struct AlignedAllocator
+{
+    using value_type = T;
+    static constexpr std::size_t alignment = 32;
+
+    AlignedAllocator() = default;
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>&) {}
+
+    T* allocate(std::size_t count)
+    {
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(alignment)));
+    }
+    void deallocate(T* pointer, std::size_t)
+    {
+        ::operator delete(pointer, std::align_val_t(alignment));
+    }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U>&) const { return false; }
+};
+
+/* one wave of the flag animation, amplitude * sin(dot(direction, (y, z)) * omega + phase) */
+struct FlagWave
+{
+    /* normalized direction in the y/z plane of the flag */
+    float directionY;
+    float directionZ;
+    float omega;
+    /* accumulated time times the phase speed of the wave */
+    float phase;
+    float amplitude;
+};
+
+/* cpu implementations of the flag animation, the SIMD kernels are only used if the cpu supports them */
+enum class eFlagKernel
+{
+    SCALAR = 0,  // reference, standard library sine and cosine per vertex
+    SSE2,        // 4 vertices per step, polynomial sine and cosine
+    AVX2,        // 8 vertices per step, polynomial sine and cosine
+    KERNEL_COUNT
+};
+
+/*
+ * Maximal absolute difference of the x coordinates and the normals of the SIMD kernels to the scalar kernel, per unit
+ * of summed wave amplitude (times |z / minPosZ|, times omega for the normals). Holds for wave arguments up to 1e5 in magnitude (e.g. phase speed 5 for 5.5 hours of
+ * accumulated time), beyond that the range reduction of the polynomial sine loses precision.
+ */
+constexpr float flagKernelTolerance = 1e-6f;
+
+/* flag vertex positions and normals as structure of arrays, padded to a multiple of flagKernelBlock vertices */
+struct FlagVertices
+{
+    std::size_t count = 0;
+    std::vector<float, AlignedAllocator<float>> x;
+    std::vector<float, AlignedAllocator<float>> y;
+    std::vector<float, AlignedAllocator<float>> z;
+    std::vector<float, AlignedAllocator<float>> nx;
+    std::vector<float, AlignedAllocator<float>> ny;
+    std::vector<float, AlignedAllocator<float>> nz;
+};
+
+/* vertices per block of the kernels, ranges of vertices start at multiples of it */
+constexpr std::size_t flagKernelBlock = 8;
+
+/**
+ * @brief Copies the positions and normals of the vertices into a structure of arrays.
+ */
+FlagVertices flagVertices(const std::vector<Vertex>& vertices);
+
+/**
+ * @brief Writes the x coordinates and the normals of the structure of arrays back into the vertices, which have the
+ * same count.
+ */
+void flagVerticesStore(const FlagVertices& soa, std::vector<Vertex>& vertices);
+
+/**
+ * @brief Whether the kernel can run on this cpu, checked at runtime.
+ */
+bool flagKernelSupported(eFlagKernel kernel);
+
+/**
+ * @brief Fastest kernel the cpu supports.
+ */
+eFlagKernel flagKernelBest();
+
+/**
+ * @brief Name of the kernel for log output.
+ */
+const char* flagKernelName(eFlagKernel kernel);
+
+/**
+ * @brief Sets x = sum of the waves at (y, z) times z / minPosZ for the vertices in [first, last), and the normals to the
+ * analytic normals of the displaced surface, normalize(1, -dx/dy, -dx/dz) (see flagNormal).
+ *
+ * @param kernel Implementation to use, has to be supported (see flagKernelSupported).
+ * @param first First vertex, a multiple of flagKernelBlock.
+ * @param last End of the range, clamped to the padded vertex count.
+ */
+void flagKernelRun(eFlagKernel kernel, FlagVertices& vertices, const std::vector<FlagWave>& waves, float minPosZ,
+                   std::size_t first, std::size_t last);
@@ -172,6 +172,31 @@ Matrix3D inverse(const Matrix3D &M)
                      r2.x * invDet, r2.y * invDet, r2.z * invDet));
 }
 
+Matrix3D transpose(const Matrix3D &M)
+{
+    return (Matrix3D(M(0,0), M(1,0), M(2,0),
+                     M(0,1), M(1,1), M(2,1),
+                     M(0,2), M(1,2), M(2,2)));
+}
+
+Matrix3D normalMatrix(const Matrix4D &M)
+{
+    Matrix3D A(M);
+
+    /* rotations with a uniform scale (orthogonal columns of equal length) are their own normal matrix up to the scale */
+    const float eps = 1e-5F;
+    float xx = dot(A[0], A[0]);
+    float yy = dot(A[1], A[1]);
+    float zz = dot(A[2], A[2]);
+    if(std::abs(dot(A[0], A[1])) <= eps * xx && std::abs(dot(A[0], A[2])) <= eps * xx &&
+       std::abs(dot(A[1], A[2])) <= eps * yy && std::abs(xx - yy) <= eps * xx && std::abs(xx - zz) <= eps * xx)
+    {
+        return A;
+    }
+
+    return transpose(inverse(A));
+}
+
 const std::string toString(const Matrix3D& M) {
     return std::to_string(M(0, 0)) + " " + std::to_string(M(0, 1)) + " " + std::to_string(M(0, 2)) + "\n"
         + std::to_string(M(1, 0)) + " " + std::to_string(M(1, 1)) + " " + std::to_string(M(1, 2)) + "\n"
@@ -36,5 +36,10 @@ Matrix3D operator *(const Matrix3D& A, const Matrix3D& B);
 Vector3D operator *(const Matrix3D& M, const Vector3D& v);
 
 Matrix3D inverse(const Matrix3D& M);
+Matrix3D transpose(const Matrix3D& M);
+
+/* matrix that transforms the normals of a model, i.e. the inverse transpose of its upper 3x3 part. The result is only
+ * correct up to a positive scale, normals have to be normalized after the transformation. */
+Matrix3D normalMatrix(const Matrix4D& M);
 
 const std::string toString(const Matrix3D& M);
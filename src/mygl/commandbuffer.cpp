@@ -0,0 +1,57 @@
+#include "commandbuffer.h"
+#include "jobs.h"
+#include "stats.h"
+
+void commandBufferBegin(CommandBuffer &buffer)
+{
+    buffer.entries.clear();
+    buffer.items.clear();
+    buffer.thread = jobsThreadIndex();
+    buffer.recordTime = 0.0;
+    buffer.start = std::chrono::steady_clock::now();
+}
+
+unsigned int commandBufferEntry(CommandBuffer &buffer, const DrawEntry &entry)
+{
+    buffer.entries.push_back(entry);
+    return static_cast<unsigned int>(buffer.entries.size() - 1);
+}
+
+void commandBufferDraw(CommandBuffer &buffer, const RenderItem &item)
+{
+    buffer.items.push_back(item);
+}
+
+void commandBufferEnd(CommandBuffer &buffer)
+{
+    buffer.recordTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buffer.start).count();
+}
+
+void commandBuffersReplay(std::vector<CommandBuffer> &buffers)
+{
+    FrameStats& stats = statsFrame();
+    for(auto& buffer : buffers)
+    {
+        /* entries of a buffer are added one after another, so the local indices only need an offset */
+        unsigned int base = 0;
+        for(std::size_t i = 0; i < buffer.entries.size(); i++)
+        {
+            unsigned int index = drawDataAdd(buffer.entries[i]);
+            base = i == 0 ? index : base;
+        }
+
+        for(auto item : buffer.items)
+        {
+            item.drawEntry += base;
+            renderQueueAdd(item);
+        }
+
+        if(stats.recordTime.size() <= buffer.thread)
+        {
+            stats.recordTime.resize(buffer.thread + 1, 0.0);
+        }
+        stats.recordTime[buffer.thread] += buffer.recordTime;
+        stats.commandBuffers++;
+        stats.recordedBuffers++;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "drawdata.h"
+#include "renderqueue.h"
+
+#include <chrono>
+#include <vector>
+
+/**
+ * Draw commands of a part of the scene, recorded without OpenGL calls so that any thread can record them. The per draw
+ * data of the commands is kept in the buffer and only appended to the per draw data ring when the buffer gets replayed
+ * on the thread of the OpenGL context (see commandBuffersReplay).
+ *
+ * usage:
+ *
+ *   jobsParallelFor(buffers.size(), [&](std::size_t i)
+ *   {
+ *       commandBufferBegin(buffers[i]);
+ *       RenderItem item = ...;
+ *       item.drawEntry = commandBufferEntry(buffers[i], drawEntry(model));
+ *       commandBufferDraw(buffers[i], item);
+ *       commandBufferEnd(buffers[i]);
+ *   });
+ *   commandBuffersReplay(buffers);
+ *   renderQueueSubmit();
+ */
+struct CommandBuffer
+{
+    /* per draw data, the drawEntry of the items is an index into it until the replay */
+    std::vector<DrawEntry> entries;
+    std::vector<RenderItem> items;
+
+    /* thread that recorded the buffer (see jobsThreadIndex) and the time the recording took in ms */
+    unsigned int thread = 0;
+    double recordTime = 0.0;
+    std::chrono::steady_clock::time_point start;
+};
+
+/**
+ * @brief Clears the buffer and starts recording it on the calling thread.
+ */
+void commandBufferBegin(CommandBuffer& buffer);
+
+/**
+ * @brief Adds per draw data to the buffer.
+ *
+ * @return Index of the entry in the buffer, used as RenderItem::drawEntry of the draws that use it.
+ */
+unsigned int commandBufferEntry(CommandBuffer& buffer, const DrawEntry& entry);
+
+/**
+ * @brief Records a draw, its drawEntry is an index returned by commandBufferEntry of the same buffer.
+ */
+void commandBufferDraw(CommandBuffer& buffer, const RenderItem& item);
+
+/**
+ * @brief Ends the recording of the buffer.
+ */
+void commandBufferEnd(CommandBuffer& buffer);
+
+/**
+ * @brief Appends the per draw data of the buffers to the per draw data ring (see drawDataAdd) and their draws to the
+ * render queue (see renderQueueAdd), in the order of the buffers so that the result does not depend on which thread
+ * recorded which buffer. The recording times are added to the frame statistics. Has to be called on the thread of the
+ * OpenGL context between drawDataBegin and drawDataUpload.
+ */
+void commandBuffersReplay(std::vector<CommandBuffer>& buffers);
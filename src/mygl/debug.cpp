@@ -9,12 +9,18 @@ const std::string vertex_shader_code_debug = R"END(
     layout(location = 1) in vec3 aColor;
     out vec3 tColor;
 
-    uniform mat4 uProj;
-    uniform mat4 uView;
+    layout(std140) uniform FrameData
+    {
+        mat4 uView;
+        mat4 uProj;
+        mat4 uViewProj;
+        vec4 uCameraPosition;
+        float uTime;
+    };
 
     void main()
     {
-        gl_Position = uProj * uView * vec4(aPosition, 1.0);
+        gl_Position = uViewProj * vec4(aPosition, 1.0);
         tColor = aColor;
     }
 )END";
@@ -94,12 +100,10 @@ void debugDrawTriangles(const std::vector<DebugVertex>& triangles)
     sVisualDebugger.triangles.insert(sVisualDebugger.triangles.end(), triangles.begin(), triangles.end());
 }
 
-void debugDraw(const Camera& camera)
+void debugDraw()
 {
     glBindVertexArray(sVisualDebugger.vao);
     glUseProgram(sVisualDebugger.shader.id);
-    shaderUniform(sVisualDebugger.shader, "uProj",  cameraProjection(camera));
-    shaderUniform(sVisualDebugger.shader, "uView",  cameraView(camera));
 
     glDisable(GL_DEPTH_TEST);
 
@@ -16,5 +16,6 @@ void debugDrawLines(const std::vector<DebugVertex>& lines);
 void debugDrawTriangles(const std::vector<DebugVertex>& triangles);
 
 void debugInit();
-void debugDraw(const Camera& camera);
+/* draws the collected primitives with the camera of the current frame (see frameDataUpdate) */
+void debugDraw();
 void debugShutdown();
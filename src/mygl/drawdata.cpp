@@ -0,0 +1,161 @@
+#include "drawdata.h"
+#include "shader.h"
+#include "stats.h"
+
+#include <cstring>
+#include <vector>
+
+namespace detail
+{
+
+/* frames the cpu can prepare while the gpu still reads the data of the previous ones */
+const unsigned int framesInFlight = 3;
+
+struct
+{
+    GLuint ubo = 0;
+    GLsync fences[framesInFlight] = {};
+
+    /* entries per region and distance of the entries (aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT) */
+    std::size_t capacity = 256;
+    std::size_t stride = 0;
+
+    unsigned int region = 0;
+    std::vector<uint8_t> entries;
+    std::size_t count = 0;
+} sDrawData;
+
+void ringCreate(std::size_t capacity)
+{
+    auto& ring = sDrawData;
+    if(!ring.ubo)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        ring.stride = (sizeof(DrawEntry) + alignment - 1) / alignment * alignment;
+        glGenBuffers(1, &ring.ubo);
+    }
+
+    /* new storage, the gpu keeps reading the orphaned one of frames in flight */
+    ring.capacity = capacity;
+    glBindBuffer(GL_UNIFORM_BUFFER, ring.ubo);
+    glBufferData(GL_UNIFORM_BUFFER, framesInFlight * ring.capacity * ring.stride, nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+}
+
+DrawEntry drawEntry(const Matrix4D &model)
+{
+    Matrix3D normal = normalMatrix(model);
+
+    DrawEntry entry;
+    entry.model = model;
+    for(int j = 0; j < 3; j++)
+    {
+        entry.normal[j] = Vector4D(normal[j], 0.0f);
+    }
+
+    return entry;
+}
+
+void drawDataBegin()
+{
+    auto& ring = detail::sDrawData;
+    if(!ring.ubo)
+    {
+        detail::ringCreate(ring.capacity);
+    }
+
+    ring.region = (ring.region + 1) % detail::framesInFlight;
+    ring.count = 0;
+
+    GLsync& fence = ring.fences[ring.region];
+    if(fence)
+    {
+        if(glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+        {
+            statsFrame().ringWaits++;
+            while(glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+            {
+            }
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+unsigned int drawDataAdd(const DrawEntry &entry)
+{
+    auto& ring = detail::sDrawData;
+
+    std::size_t offset = ring.count * ring.stride;
+    if(ring.entries.size() < offset + ring.stride)
+    {
+        ring.entries.resize(offset + ring.stride);
+    }
+    std::memcpy(ring.entries.data() + offset, &entry, sizeof(DrawEntry));
+
+    return static_cast<unsigned int>(ring.count++);
+}
+
+void drawDataUpload()
+{
+    auto& ring = detail::sDrawData;
+    if(ring.count == 0)
+    {
+        return;
+    }
+
+    if(ring.count > ring.capacity)
+    {
+        std::size_t capacity = ring.capacity;
+        while(capacity < ring.count)
+        {
+            capacity *= 2;
+        }
+        detail::ringCreate(capacity);
+    }
+
+    /* the fence of drawDataBegin guarantees that the gpu is done with this region */
+    GLintptr offset = ring.region * ring.capacity * ring.stride;
+    GLsizeiptr size = ring.count * ring.stride;
+    glBindBuffer(GL_UNIFORM_BUFFER, ring.ubo);
+    void* data = glMapBufferRange(GL_UNIFORM_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    if(data)
+    {
+        std::memcpy(data, ring.entries.data(), size);
+        glUnmapBuffer(GL_UNIFORM_BUFFER);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void drawDataBind(unsigned int index)
+{
+    auto& ring = detail::sDrawData;
+
+    GLintptr offset = (ring.region * ring.capacity + index) * ring.stride;
+    glBindBufferRange(GL_UNIFORM_BUFFER, eUniformBlock::DrawBlock, ring.ubo, offset, sizeof(DrawEntry));
+}
+
+void drawDataEnd()
+{
+    auto& ring = detail::sDrawData;
+    ring.fences[ring.region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void drawDataDelete()
+{
+    auto& ring = detail::sDrawData;
+    for(auto& fence : ring.fences)
+    {
+        if(fence)
+        {
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+
+    glDeleteBuffers(1, &ring.ubo);
+    ring.ubo = 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "base.h"
+
+/* std140 layout of the DrawData uniform block in src/shader, one entry per draw */
+struct DrawEntry
+{
+    Matrix4D model;
+    /* columns of the normal matrix (std140 mat3), see normalMatrix */
+    Vector4D normal[3];
+};
+
+/**
+ * @brief Creates the entry of a draw with the given model matrix. The normal matrix is computed once here instead of
+ * inverting the model matrix per vertex in the shaders.
+ */
+DrawEntry drawEntry(const Matrix4D& model);
+
+/**
+ * @brief Starts the per draw data of a frame. The data lives in a uniform buffer ring with one region per frame in
+ * flight, the region of this frame is only reused after the fence of its last use (see drawDataEnd) got signaled.
+ */
+void drawDataBegin();
+
+/**
+ * @brief Appends an entry to the per draw data of the frame, all entries are written in one pass before the draws.
+ *
+ * @return Index of the entry, used by drawDataBind.
+ */
+unsigned int drawDataAdd(const DrawEntry& entry);
+
+/**
+ * @brief Uploads the entries of the frame into its region of the ring with one unsynchronized buffer mapping.
+ */
+void drawDataUpload();
+
+/**
+ * @brief Binds the range of one entry to the "DrawData" block of all shader programs (see eUniformBlock).
+ */
+void drawDataBind(unsigned int index);
+
+/**
+ * @brief Ends the per draw data of a frame by placing a fence behind its draws.
+ */
+void drawDataEnd();
+
+/**
+ * @brief Deletes the uniform buffer and the fences of the ring.
+ */
+void drawDataDelete();
@@ -0,0 +1,129 @@
+#include "drawlist.h"
+#include "jobs.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <numeric>
+
+void drawListResize(DrawList &list, std::size_t count)
+{
+    if(list.buffers.size() != count)
+    {
+        list.buffers.resize(count);
+        list.depth.resize(count, 0.0f);
+        drawListInvalidate(list);
+    }
+}
+
+void drawListInvalidate(DrawList &list, std::size_t buffer)
+{
+    list.dirty.resize(list.buffers.size(), 1);
+    list.dirty[buffer] = 1;
+}
+
+void drawListInvalidate(DrawList &list)
+{
+    list.dirty.assign(list.buffers.size(), 1);
+}
+
+unsigned int drawListRecord(DrawList &list, const std::function<void(std::size_t, CommandBuffer&)>& record)
+{
+    std::vector<std::size_t> dirty;
+    for(std::size_t i = 0; i < list.dirty.size(); i++)
+    {
+        if(list.dirty[i])
+        {
+            dirty.push_back(i);
+        }
+    }
+    if(dirty.empty())
+    {
+        return 0;
+    }
+
+    jobsParallelFor(dirty.size(), [&list, &dirty, &record](std::size_t i)
+    {
+        CommandBuffer& buffer = list.buffers[dirty[i]];
+        commandBufferBegin(buffer);
+        record(dirty[i], buffer);
+        commandBufferEnd(buffer);
+    });
+
+    FrameStats& stats = statsFrame();
+    for(std::size_t i : dirty)
+    {
+        const CommandBuffer& buffer = list.buffers[i];
+        if(stats.recordTime.size() <= buffer.thread)
+        {
+            stats.recordTime.resize(buffer.thread + 1, 0.0);
+        }
+        stats.recordTime[buffer.thread] += buffer.recordTime;
+        stats.recordedBuffers++;
+        list.dirty[i] = 0;
+    }
+
+    list.sortDirty = true;
+    return static_cast<unsigned int>(dirty.size());
+}
+
+void drawListDepth(DrawList &list, std::size_t buffer, float depth)
+{
+    list.depth[buffer] = depth;
+}
+
+void drawListReplay(DrawList &list)
+{
+    /* one comparison per buffer, the draws are only sorted again if the buffers change places */
+    std::vector<unsigned int> order(list.buffers.size());
+    std::iota(order.begin(), order.end(), 0u);
+    std::stable_sort(order.begin(), order.end(), [&list](unsigned int a, unsigned int b) { return list.depth[a] < list.depth[b]; });
+    if(order != list.order)
+    {
+        list.order.swap(order);
+        list.sortDirty = true;
+    }
+
+    if(list.sortDirty)
+    {
+        /* the local entry indices of the buffers become indices into the entries of all buffers */
+        std::vector<unsigned int> offsets(list.buffers.size());
+        unsigned int offset = 0;
+        for(std::size_t i = 0; i < list.buffers.size(); i++)
+        {
+            offsets[i] = offset;
+            offset += static_cast<unsigned int>(list.buffers[i].entries.size());
+        }
+
+        /* the sort is stable, so the draws of one state keep the front to back order of their buffers */
+        list.sorted.clear();
+        for(unsigned int i : list.order)
+        {
+            for(auto item : list.buffers[i].items)
+            {
+                item.drawEntry += offsets[i];
+                list.sorted.push_back(item);
+            }
+        }
+        renderItemsSort(list.sorted);
+        list.sortDirty = false;
+    }
+
+    /* entries are added one after another, so the indices of the draws only need the index of the first one */
+    bool first = true;
+    for(const auto& buffer : list.buffers)
+    {
+        for(const auto& entry : buffer.entries)
+        {
+            unsigned int index = drawDataAdd(entry);
+            list.entryBase = first ? index : list.entryBase;
+            first = false;
+        }
+    }
+
+    statsFrame().commandBuffers += static_cast<unsigned int>(list.buffers.size());
+}
+
+void drawListSubmit(const DrawList &list)
+{
+    renderItemsSubmit(list.sorted, list.entryBase);
+}
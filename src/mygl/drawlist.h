@@ -0,0 +1,93 @@
+#pragma once
+
+#include "commandbuffer.h"
+
+#include <functional>
+#include <vector>
+
+/**
+ * Draw commands that are kept across frames. The list is split into command buffers, only buffers that were
+ * invalidated are recorded again. The sort keys of the draws only hold the state, the draws of one state are ordered
+ * front to back per buffer (see drawListDepth), so they are only sorted again if a buffer was recorded or the depth
+ * order of the buffers changed. Per draw data that changes every frame (e.g. model matrices) is written into the
+ * entries of the buffers in place, the draws reference the entries by index and stay valid.
+ *
+ * usage:
+ *
+ *   drawListResize(list, count);
+ *   if(sceneChanged)
+ *   {
+ *       drawListInvalidate(list);
+ *   }
+ *   drawListRecord(list, [](std::size_t i, CommandBuffer& buffer) { ... commandBufferEntry/commandBufferDraw ... });
+ *   list.buffers[i].entries[j] = drawEntry(model);
+ *   drawListDepth(list, i, renderDepth(cameraPosition, model, center));
+ *
+ *   drawDataBegin();
+ *   drawListReplay(list);
+ *   drawDataUpload();
+ *   drawListSubmit(list);
+ *   drawDataEnd();
+ */
+struct DrawList
+{
+    std::vector<CommandBuffer> buffers;
+    /* buffers that have to be recorded again */
+    std::vector<char> dirty;
+
+    /* draws of all buffers sorted by key, their drawEntry is an index into the entries of all buffers in order */
+    std::vector<RenderItem> sorted;
+    bool sortDirty = true;
+
+    /* distance of each buffer to the camera and the order of the buffers the draws were sorted in */
+    std::vector<float> depth;
+    std::vector<unsigned int> order;
+
+    /* index of the first entry in the per draw data ring, set by drawListReplay */
+    unsigned int entryBase = 0;
+};
+
+/**
+ * @brief Sets the number of command buffers, all buffers are invalidated if it changes.
+ */
+void drawListResize(DrawList& list, std::size_t count);
+
+/**
+ * @brief Marks one buffer to be recorded again by the next drawListRecord.
+ */
+void drawListInvalidate(DrawList& list, std::size_t buffer);
+
+/**
+ * @brief Marks all buffers to be recorded again by the next drawListRecord.
+ */
+void drawListInvalidate(DrawList& list);
+
+/**
+ * @brief Records the invalidated buffers on the job system, buffers that are still valid are kept as they are. The
+ * number of recorded buffers and their recording times are added to the frame statistics.
+ *
+ * @param record Called with the index of the buffer between commandBufferBegin and commandBufferEnd, may be called on
+ * any thread.
+ * @return Number of recorded buffers.
+ */
+unsigned int drawListRecord(DrawList& list, const std::function<void(std::size_t, CommandBuffer&)>& record);
+
+/**
+ * @brief Sets the distance of a buffer to the camera (e.g. of the center of its draws, see renderDepth). Draws with the
+ * same sort key are submitted in the order of the distances of their buffers, the draws are only sorted again by
+ * drawListReplay if that order changes.
+ */
+void drawListDepth(DrawList& list, std::size_t buffer, float depth);
+
+/**
+ * @brief Appends the entries of all buffers to the per draw data ring (see drawDataAdd) and sorts the draws if a buffer
+ * was recorded or the depth order of the buffers changed since the last call. Has to be called between drawDataBegin
+ * and drawDataUpload.
+ */
+void drawListReplay(DrawList& list);
+
+/**
+ * @brief Draws the sorted draws of the list with the entries of the last drawListReplay (see renderItemsSubmit). Has to
+ * be called after drawDataUpload.
+ */
+void drawListSubmit(const DrawList& list);
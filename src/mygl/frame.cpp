@@ -0,0 +1,49 @@
+#include "frame.h"
+#include "shader.h"
+
+namespace detail
+{
+
+struct
+{
+    GLuint ubo = 0;
+    FrameData data;
+} sFrame;
+
+static_assert(sizeof(FrameData) == 3 * 64 + 16 + 16, "FrameData has to match the std140 layout of the FrameData block");
+
+}
+
+void frameDataUpdate(const Camera &camera, float time)
+{
+    auto& frame = detail::sFrame;
+
+    frame.data.view = cameraView(camera);
+    frame.data.proj = cameraProjection(camera);
+    frame.data.viewProj = frame.data.proj * frame.data.view;
+    frame.data.cameraPosition = Vector4D(cameraPosition(camera), 1.0f);
+    frame.data.time = time;
+
+    if(!frame.ubo)
+    {
+        glGenBuffers(1, &frame.ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, frame.ubo);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), nullptr, GL_DYNAMIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, eUniformBlock::FrameBlock, frame.ubo);
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frame.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &frame.data);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+const FrameData& frameData()
+{
+    return detail::sFrame.data;
+}
+
+void frameDataDelete()
+{
+    glDeleteBuffers(1, &detail::sFrame.ubo);
+    detail::sFrame.ubo = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include "base.h"
+#include "camera.h"
+
+/* std140 layout of the FrameData uniform block in src/shader, shared by all shader programs */
+struct FrameData
+{
+    Matrix4D view;
+    Matrix4D proj;
+    Matrix4D viewProj;
+    Vector4D cameraPosition;    // w is unused
+    float time;
+    float _padding[3];
+};
+
+/**
+ * @brief Computes the camera matrices once for the frame and uploads them into the uniform buffer bound to the
+ * "FrameData" block of all shader programs (see eUniformBlock). Has to be called before the first draw of a frame.
+ *
+ * @param camera Camera the frame is rendered with.
+ * @param time Time since the start of the application (in s).
+ */
+void frameDataUpdate(const Camera& camera, float time);
+
+/**
+ * @brief Data of the current frame as uploaded by frameDataUpdate.
+ */
+const FrameData& frameData();
+
+/**
+ * @brief Deletes the uniform buffer of the frame data.
+ */
+void frameDataDelete();
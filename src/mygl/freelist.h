@@ -0,0 +1,81 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+/* free list over a range of a buffer, first fit with merging of neighbouring blocks */
+struct FreeList
+{
+    struct Block
+    {
+        std::size_t offset;
+        std::size_t size;
+    };
+
+    std::size_t capacity = 0;
+    std::size_t used = 0;
+    std::vector<Block> blocks;
+
+    bool allocate(std::size_t size, std::size_t &offset)
+    {
+        if(size == 0)
+        {
+            offset = 0;
+            return true;
+        }
+
+        for(auto it = blocks.begin(); it != blocks.end(); ++it)
+        {
+            if(it->size >= size)
+            {
+                offset = it->offset;
+                it->offset += size;
+                it->size -= size;
+                if(it->size == 0)
+                {
+                    blocks.erase(it);
+                }
+                used += size;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void release(std::size_t offset, std::size_t size)
+    {
+        if(size == 0)
+        {
+            return;
+        }
+
+        used -= size;
+        insert(offset, size);
+    }
+
+    void grow(std::size_t newCapacity)
+    {
+        insert(capacity, newCapacity - capacity);
+        capacity = newCapacity;
+    }
+
+    void insert(std::size_t offset, std::size_t size)
+    {
+        auto it = std::lower_bound(blocks.begin(), blocks.end(), offset, [](const Block& b, std::size_t o) { return b.offset < o; });
+        it = blocks.insert(it, Block{offset, size});
+
+        /* merge with following and preceding block */
+        if(it + 1 != blocks.end() && it->offset + it->size == (it + 1)->offset)
+        {
+            it->size += (it + 1)->size;
+            blocks.erase(it + 1);
+        }
+        if(it != blocks.begin() && (it - 1)->offset + (it - 1)->size == it->offset)
+        {
+            (it - 1)->size += it->size;
+            blocks.erase(it);
+        }
+    }
+};
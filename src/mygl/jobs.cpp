@@ -0,0 +1,222 @@
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace detail
+{
+
+/* persistent worker threads that take jobs from one shared queue */
+struct
+{
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stop = false;
+} sPool;
+
+/* functions the jobs hand over to the main thread */
+struct
+{
+    std::deque<std::function<void()>> queue;
+    std::mutex mutex;
+} sCompletions;
+
+/* index of the calling thread, 0 for threads outside of the pool */
+thread_local unsigned int sThreadIndex = 0;
+
+void workerLoop(unsigned int index)
+{
+    sThreadIndex = index;
+
+    auto& pool = sPool;
+    while(true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(pool.mutex);
+            pool.wake.wait(lock, [&pool]() { return pool.stop || !pool.queue.empty(); });
+            if(pool.queue.empty())
+            {
+                return;
+            }
+
+            job = std::move(pool.queue.front());
+            pool.queue.pop_front();
+        }
+
+        job();
+    }
+}
+
+void poolStart()
+{
+    auto& pool = sPool;
+    if(!pool.workers.empty())
+    {
+        return;
+    }
+
+    unsigned int hardware = std::max(2u, std::thread::hardware_concurrency());
+    pool.stop = false;
+    for(unsigned int i = 0; i + 1 < hardware; i++)
+    {
+        pool.workers.emplace_back(workerLoop, i + 1);
+    }
+}
+
+void poolSubmit(std::function<void()> job)
+{
+    auto& pool = sPool;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        poolStart();
+        pool.queue.push_back(std::move(job));
+    }
+    pool.wake.notify_one();
+}
+
+/* shared between the caller of jobsParallelFor and its helper jobs, helpers that start late only find no work left */
+struct ParallelFor
+{
+    std::function<void(std::size_t)> task;
+    std::size_t count = 0;
+
+    std::atomic<std::size_t> next{0};
+    std::size_t done = 0;
+    std::exception_ptr error;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    void work()
+    {
+        std::size_t i;
+        while((i = next.fetch_add(1)) < count)
+        {
+            std::exception_ptr caught;
+            try
+            {
+                task(i);
+            }
+            catch(...)
+            {
+                caught = std::current_exception();
+            }
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if(caught && !error)
+            {
+                error = caught;
+            }
+            if(++done == count)
+            {
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+unsigned int jobsThreads()
+{
+    auto& pool = detail::sPool;
+    std::lock_guard<std::mutex> lock(pool.mutex);
+    detail::poolStart();
+
+    return static_cast<unsigned int>(pool.workers.size()) + 1;
+}
+
+unsigned int jobsThreadIndex()
+{
+    return detail::sThreadIndex;
+}
+
+void jobsParallelFor(std::size_t count, const std::function<void(std::size_t)>& task, unsigned int threads)
+{
+    if(count == 0)
+    {
+        return;
+    }
+
+    threads = threads == 0 ? jobsThreads() : std::min(threads, jobsThreads());
+    std::size_t helpers = std::min<std::size_t>(threads - 1, count - 1);
+
+    auto state = std::make_shared<detail::ParallelFor>();
+    state->task = task;
+    state->count = count;
+
+    for(std::size_t i = 0; i < helpers; i++)
+    {
+        detail::poolSubmit([state]() { state->work(); });
+    }
+
+    /* the calling thread works as well, so all tasks finish even if every worker is busy */
+    state->work();
+
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->finished.wait(lock, [&state]() { return state->done == state->count; });
+
+    if(state->error)
+    {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void jobsEnqueue(std::function<void()> job)
+{
+    detail::poolSubmit(std::move(job));
+}
+
+void jobsComplete(std::function<void()> completion)
+{
+    auto& completions = detail::sCompletions;
+    std::lock_guard<std::mutex> lock(completions.mutex);
+    completions.queue.push_back(std::move(completion));
+}
+
+unsigned int jobsPoll()
+{
+    auto& completions = detail::sCompletions;
+
+    std::deque<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(completions.mutex);
+        ready.swap(completions.queue);
+    }
+
+    for(auto& completion : ready)
+    {
+        completion();
+    }
+
+    return static_cast<unsigned int>(ready.size());
+}
+
+void jobsShutdown()
+{
+    auto& pool = detail::sPool;
+    {
+        std::lock_guard<std::mutex> lock(pool.mutex);
+        pool.stop = true;
+    }
+    pool.wake.notify_all();
+
+    for(auto& worker : pool.workers)
+    {
+        worker.join();
+    }
+    pool.workers.clear();
+
+    std::lock_guard<std::mutex> lock(detail::sCompletions.mutex);
+    detail::sCompletions.queue.clear();
+}
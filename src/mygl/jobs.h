@@ -0,0 +1,52 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+/**
+ * @brief Number of threads that work on jobs, the worker threads of the pool plus the calling thread. The pool is
+ * created on first use with one worker less than the hardware threads (at least one worker).
+ */
+unsigned int jobsThreads();
+
+/**
+ * @brief Index of the calling thread in [0, jobsThreads()), 0 for the main thread (and all other threads outside of the
+ * pool), the workers are numbered from 1. Used to attribute work to threads, e.g. in statistics.
+ */
+unsigned int jobsThreadIndex();
+
+/**
+ * @brief Runs task(i) for all i in [0, count) on the worker threads and the calling thread and returns after all of
+ * them finished. The first exception thrown by a task is rethrown after the others finished. Can be called from within
+ * a job, the calling thread then works on the tasks itself if no worker is free.
+ *
+ * @param count Number of tasks.
+ * @param task Function that is called with the index of each task.
+ * @param threads Maximal number of threads that work on the tasks at the same time, 0 uses all of them (see jobsThreads).
+ */
+void jobsParallelFor(std::size_t count, const std::function<void(std::size_t)>& task, unsigned int threads = 0);
+
+/**
+ * @brief Queues a job for the worker threads and returns immediately.
+ */
+void jobsEnqueue(std::function<void()> job);
+
+/**
+ * @brief Queues a function for the main thread, e.g. the OpenGL upload of data a job prepared. It is called by the next
+ * jobsPoll.
+ */
+void jobsComplete(std::function<void()> completion);
+
+/**
+ * @brief Calls the queued completions (see jobsComplete) on the calling thread, which has to be the thread of the
+ * OpenGL context. Exceptions of the completions are passed on.
+ *
+ * @return Number of completions that were called.
+ */
+unsigned int jobsPoll();
+
+/**
+ * @brief Finishes the queued jobs and joins the worker threads, completions that were not polled yet are dropped. Has
+ * to be called before the end of main.
+ */
+void jobsShutdown();
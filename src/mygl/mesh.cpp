@@ -1,42 +1,512 @@
 #include "mesh.h"
+#include "freelist.h"
 
-Mesh meshCreate(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, GLenum vertexBufferUsage, GLenum indexBufferUsage)
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+namespace detail
 {
-    GLuint vao = 0, vbo = 0, ebo = 0;
 
-    glGenVertexArrays(1, &vao);
-    glGenBuffers(1, &vbo);
-    glGenBuffers(1, &ebo);
+/* IEEE 754 single to half precision conversion with round to nearest even */
+uint16_t halfFromFloat(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+
+    uint32_t sign = (bits >> 16) & 0x8000u;
+    uint32_t absolute = bits & 0x7FFFFFFFu;
 
-    glBindVertexArray(vao);
+    /* NaN and infinity (values too large for half precision become infinity) */
+    if(absolute >= 0x47800000u)
     {
-        glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), vertices.data(), vertexBufferUsage);
-        glCheckError();
+        return static_cast<uint16_t>(sign | 0x7C00u | (absolute > 0x7F800000u ? 0x200u : 0u));
+    }
+    /* subnormal half precision, shift the mantissa including the implicit bit */
+    if(absolute < 0x38800000u)
+    {
+        if(absolute < 0x33000000u)
+        {
+            return static_cast<uint16_t>(sign);
+        }
+        uint32_t exponent = absolute >> 23;
+        uint32_t mantissa = (absolute & 0x7FFFFFu) | 0x800000u;
+        uint32_t shift = 126 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if(rest > halfway || (rest == halfway && (half & 1u)))
+        {
+            half++;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), indices.data(), indexBufferUsage);
-        glCheckError();
+    uint32_t half = (absolute - 0x38000000u) >> 13;
+    uint32_t rest = absolute & 0x1FFFu;
+    if(rest > 0x1000u || (rest == 0x1000u && (half & 1u)))
+    {
+        half++;
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+/* signed normalized 10 bit component for GL_INT_2_10_10_10_REV */
+uint32_t snorm10(float value)
+{
+    float clamped = std::max(-1.0f, std::min(value, 1.0f));
+    return static_cast<uint32_t>(static_cast<int32_t>(std::lround(clamped * 511.0f))) & 0x3FFu;
+}
+
+/* unsigned normalized 16 bit component in [0, 1] */
+uint16_t unorm16(float value)
+{
+    float clamped = std::max(0.0f, std::min(value, 1.0f));
+    return static_cast<uint16_t>(std::lround(clamped * 65535.0f));
+}
+
+std::vector<PackedVertex> pack(const std::vector<Vertex> &vertices, Vector3D &posScale, Vector3D &posOffset)
+{
+    Vector3D minPos(FLT_MAX, FLT_MAX, FLT_MAX);
+    Vector3D maxPos(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for(const auto& v : vertices)
+    {
+        for(unsigned int i = 0; i < 3; i++)
+        {
+            minPos[i] = std::min(minPos[i], v.pos[i]);
+            maxPos[i] = std::max(maxPos[i], v.pos[i]);
+        }
+    }
+
+    /* AABB of the mesh, decoded in the shader with aPosition * posScale + posOffset */
+    posOffset = vertices.empty() ? Vector3D(0.0f, 0.0f, 0.0f) : minPos;
+    posScale = vertices.empty() ? Vector3D(1.0f, 1.0f, 1.0f) : maxPos - minPos;
+
+    std::vector<PackedVertex> packed(vertices.size());
+    for(std::size_t k = 0; k < vertices.size(); k++)
+    {
+        const Vertex& v = vertices[k];
+        PackedVertex& p = packed[k];
+
+        for(unsigned int i = 0; i < 3; i++)
+        {
+            p.pos[i] = posScale[i] > 0.0f ? unorm16((v.pos[i] - posOffset[i]) / posScale[i]) : 0;
+        }
+        p.material = static_cast<uint16_t>(v.material);
+
+        p.normal = snorm10(v.normal.x) | (snorm10(v.normal.y) << 10) | (snorm10(v.normal.z) << 20);
+
+        p.uv[0] = halfFromFloat(v.uv.x);
+        p.uv[1] = halfFromFloat(v.uv.y);
+    }
+
+    return packed;
+}
+
+struct Allocation
+{
+    std::size_t vertexOffset = 0;
+    std::size_t vertexCount = 0;
+    std::size_t indexOffset = 0;
+    std::size_t indexBytes = 0;
+    unsigned int indexSize = 4;
+    bool alive = false;
+};
+
+/* one vertex/index buffer pair with its vertex array object per vertex format */
+struct Arena
+{
+    GLuint vao = 0;
+    GLuint vbo = 0;
+    GLuint ebo = 0;
+
+    FreeList vertices;   // in vertices
+    FreeList indices;    // in bytes
+
+    /* indexed by Mesh::id, 0 is never used */
+    std::vector<Allocation> allocations = std::vector<Allocation>(1);
+    std::vector<unsigned int> freeIds;
+};
+
+Arena sArenas[2];
+
+const std::size_t initialVertexCapacity = 1 << 16;
+const std::size_t initialIndexCapacity = 1 << 18;
+
+std::size_t vertexStride(eVertexFormat format)
+{
+    return format == eVertexFormat::PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+GLenum bufferUsage(eVertexFormat format)
+{
+    /* float meshes are the ones that get updated from the cpu */
+    return format == eVertexFormat::PACKED ? GL_STATIC_DRAW : GL_DYNAMIC_DRAW;
+}
 
-        glEnableVertexAttribArray(eDataIdx::Position);
-        glEnableVertexAttribArray(eDataIdx::Normal);
-        glEnableVertexAttribArray(eDataIdx::UV);
+void vertexLayout(eVertexFormat format)
+{
+    glEnableVertexAttribArray(eDataIdx::Position);
+    glEnableVertexAttribArray(eDataIdx::Normal);
+    glEnableVertexAttribArray(eDataIdx::UV);
+    glEnableVertexAttribArray(eDataIdx::MaterialID);
+    if(format == eVertexFormat::PACKED)
+    {
+        glVertexAttribPointer(eDataIdx::Position,   3, GL_UNSIGNED_SHORT,       GL_TRUE,  sizeof(PackedVertex), (void*) offsetof(PackedVertex, pos));
+        glVertexAttribPointer(eDataIdx::Normal,     4, GL_INT_2_10_10_10_REV,   GL_TRUE,  sizeof(PackedVertex), (void*) offsetof(PackedVertex, normal));
+        glVertexAttribPointer(eDataIdx::UV,         2, GL_HALF_FLOAT,           GL_FALSE, sizeof(PackedVertex), (void*) offsetof(PackedVertex, uv));
+        glVertexAttribIPointer(eDataIdx::MaterialID, 1, GL_UNSIGNED_SHORT,                sizeof(PackedVertex), (void*) offsetof(PackedVertex, material));
+    }
+    else
+    {
         glVertexAttribPointer(eDataIdx::Position,   3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, pos));
         glVertexAttribPointer(eDataIdx::Normal,     3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, normal));
         glVertexAttribPointer(eDataIdx::UV,         2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*) offsetof(Vertex, uv));
-        glCheckError();
+        glVertexAttribIPointer(eDataIdx::MaterialID, 1, GL_UNSIGNED_INT,   sizeof(Vertex), (void*) offsetof(Vertex, material));
     }
+}
+
+/*
+ * Replaces the buffers of the arena with new ones of the given capacity and copies all live allocations over. Either the
+ * offsets are kept (growing) or the allocations are moved next to each other (compaction).
+ */
+void relocate(Arena &arena, eVertexFormat format, std::size_t vertexCapacity, std::size_t indexCapacity, bool compact)
+{
+    const std::size_t stride = vertexStride(format);
+
+    GLuint vbo = 0, ebo = 0;
+    glGenBuffers(1, &vbo);
+    glGenBuffers(1, &ebo);
 
+    glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+    glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity * stride, nullptr, bufferUsage(format));
+    glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+    glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, nullptr, bufferUsage(format));
+    glCheckError();
+
+    FreeList vertices;
+    FreeList indices;
+    if(compact)
+    {
+        vertices.grow(vertexCapacity);
+        indices.grow(indexCapacity);
+    }
+    else
+    {
+        vertices = arena.vertices;
+        indices = arena.indices;
+        vertices.grow(vertexCapacity);
+        indices.grow(indexCapacity);
+    }
+
+    for(auto& allocation : arena.allocations)
+    {
+        if(!allocation.alive)
+        {
+            continue;
+        }
+
+        std::size_t vertexOffset = allocation.vertexOffset;
+        std::size_t indexOffset = allocation.indexOffset;
+        if(compact)
+        {
+            vertices.allocate(allocation.vertexCount, vertexOffset);
+            indices.allocate(allocation.indexBytes, indexOffset);
+        }
+
+        if(arena.vbo && allocation.vertexCount)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, arena.vbo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, vbo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.vertexOffset * stride, vertexOffset * stride, allocation.vertexCount * stride);
+        }
+        if(arena.ebo && allocation.indexBytes)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, arena.ebo);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, ebo);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, allocation.indexOffset, indexOffset, allocation.indexBytes);
+        }
+
+        allocation.vertexOffset = vertexOffset;
+        allocation.indexOffset = indexOffset;
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glCheckError();
+
+    glDeleteBuffers(1, &arena.vbo);
+    glDeleteBuffers(1, &arena.ebo);
+    arena.vbo = vbo;
+    arena.ebo = ebo;
+    arena.vertices = vertices;
+    arena.indices = indices;
+
+    /* point the shared vertex array object to the new buffers */
+    if(!arena.vao)
+    {
+        glGenVertexArrays(1, &arena.vao);
+    }
+    glBindVertexArray(arena.vao);
+    {
+        glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.ebo);
+        vertexLayout(format);
+        glCheckError();
+    }
     glBindVertexArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+Arena& arena(eVertexFormat format)
+{
+    Arena& arena = sArenas[format];
+    if(!arena.vao)
+    {
+        relocate(arena, format, initialVertexCapacity, initialIndexCapacity, false);
+    }
+    return arena;
+}
 
-    return Mesh{vao, vbo, ebo, (unsigned int) vertices.size(), (unsigned int) indices.size()};
+}
+
+Mesh meshEncode(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, eVertexFormat format,
+                std::vector<uint8_t> &vertexData, std::vector<uint8_t> &indexData)
+{
+    Mesh mesh;
+    mesh.format = format;
+    mesh.indexType = vertices.size() <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    mesh.size_vbo = static_cast<unsigned int>(vertices.size());
+    mesh.size_ibo = static_cast<unsigned int>(indices.size());
+
+    vertexData.resize(meshVertexBytes(mesh));
+    if(format == eVertexFormat::PACKED)
+    {
+        std::vector<PackedVertex> packed = detail::pack(vertices, mesh.posScale, mesh.posOffset);
+        std::memcpy(vertexData.data(), packed.data(), vertexData.size());
+    }
+    else
+    {
+        std::memcpy(vertexData.data(), vertices.data(), vertexData.size());
+    }
+
+    indexData.resize(meshIndexBytes(mesh));
+    if(mesh.indexType == GL_UNSIGNED_SHORT)
+    {
+        std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        std::memcpy(indexData.data(), shortIndices.data(), indexData.size());
+    }
+    else
+    {
+        std::memcpy(indexData.data(), indices.data(), indexData.size());
+    }
+
+    return mesh;
+}
+
+void meshDecode(const Mesh &layout, const void *vertexData, const void *indexData,
+                std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    if(layout.format != eVertexFormat::FLOAT)
+    {
+        throw std::runtime_error("[Mesh] Only the vertices of float meshes can be decoded");
+    }
+
+    vertices.resize(layout.size_vbo);
+    std::memcpy(vertices.data(), vertexData, meshVertexBytes(layout));
+
+    indices.resize(layout.size_ibo);
+    if(layout.indexType == GL_UNSIGNED_SHORT)
+    {
+        const auto* shortIndices = static_cast<const uint16_t*>(indexData);
+        std::copy(shortIndices, shortIndices + layout.size_ibo, indices.begin());
+    }
+    else
+    {
+        std::memcpy(indices.data(), indexData, meshIndexBytes(layout));
+    }
+}
+
+Mesh meshCreate(const std::vector<Vertex> &vertices, const std::vector<unsigned int> &indices, eVertexFormat format)
+{
+    std::vector<uint8_t> vertexData;
+    std::vector<uint8_t> indexData;
+    Mesh layout = meshEncode(vertices, indices, format, vertexData, indexData);
+
+    return meshCreate(layout, vertexData.data(), indexData.data());
+}
+
+Mesh meshCreate(const Mesh &layout, const void *vertexData, const void *indexData)
+{
+    Mesh mesh = layout;
+    eVertexFormat format = mesh.format;
+
+    detail::Arena& arena = detail::arena(format);
+    const std::size_t stride = detail::vertexStride(format);
+
+    detail::Allocation allocation;
+    allocation.alive = true;
+    allocation.vertexCount = mesh.size_vbo;
+    allocation.indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+    /* keep index ranges 4 byte aligned, 16 and 32 bit indices share one buffer */
+    allocation.indexBytes = (meshIndexBytes(mesh) + 3) & ~std::size_t(3);
+
+    /* grow the arena until the mesh fits */
+    while(!arena.vertices.allocate(allocation.vertexCount, allocation.vertexOffset))
+    {
+        std::size_t capacity = std::max(arena.vertices.capacity * 2, arena.vertices.capacity + allocation.vertexCount);
+        detail::relocate(arena, format, capacity, arena.indices.capacity, false);
+        std::cout << "[Mesh] Grew arena of format " << format << " to " << capacity << " vertices" << std::endl;
+    }
+    while(!arena.indices.allocate(allocation.indexBytes, allocation.indexOffset))
+    {
+        std::size_t capacity = std::max(arena.indices.capacity * 2, arena.indices.capacity + allocation.indexBytes);
+        detail::relocate(arena, format, arena.vertices.capacity, capacity, false);
+        std::cout << "[Mesh] Grew arena of format " << format << " to " << capacity / 1024 << " KiB indices" << std::endl;
+    }
+
+    if(arena.freeIds.empty())
+    {
+        mesh.id = static_cast<unsigned int>(arena.allocations.size());
+        arena.allocations.push_back(allocation);
+    }
+    else
+    {
+        mesh.id = arena.freeIds.back();
+        arena.freeIds.pop_back();
+        arena.allocations[mesh.id] = allocation;
+    }
+
+    /* copy the data into the arena, without touching the element buffer binding of a bound vertex array object */
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertexOffset * stride, meshVertexBytes(mesh), vertexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, arena.ebo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.indexOffset, meshIndexBytes(mesh), indexData);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glCheckError();
+
+    return mesh;
+}
+
+std::size_t meshVertexBytes(const Mesh &mesh)
+{
+    return mesh.size_vbo * detail::vertexStride(mesh.format);
+}
+
+std::size_t meshIndexBytes(const Mesh &mesh)
+{
+    return mesh.size_ibo * (mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(uint32_t));
+}
+
+void meshUpdateVertices(const Mesh &mesh, const std::vector<Vertex> &vertices)
+{
+    const detail::Allocation& allocation = detail::sArenas[mesh.format].allocations[mesh.id];
+    if(mesh.format != eVertexFormat::FLOAT || vertices.size() != allocation.vertexCount)
+    {
+        throw std::runtime_error("[Mesh] Only float meshes with the same vertex count can be updated");
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, detail::sArenas[mesh.format].vbo);
+    glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.vertexOffset * sizeof(Vertex), vertices.size() * sizeof(Vertex), vertices.data());
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glCheckError();
+}
+
+Vertex* meshMapVertices(const Mesh &mesh)
+{
+    const detail::Allocation& allocation = detail::sArenas[mesh.format].allocations[mesh.id];
+    if(mesh.format != eVertexFormat::FLOAT)
+    {
+        throw std::runtime_error("[Mesh] Only float meshes can be mapped");
+    }
+
+    glBindBuffer(GL_COPY_WRITE_BUFFER, detail::sArenas[mesh.format].vbo);
+    void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, allocation.vertexOffset * sizeof(Vertex),
+                                  allocation.vertexCount * sizeof(Vertex), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glCheckError();
+    if(!data)
+    {
+        throw std::runtime_error("[Mesh] Couldn't map the vertices of the mesh");
+    }
+
+    return static_cast<Vertex*>(data);
+}
+
+bool meshUnmapVertices(const Mesh &mesh)
+{
+    glBindBuffer(GL_COPY_WRITE_BUFFER, detail::sArenas[mesh.format].vbo);
+    GLboolean intact = glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+    glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+    glCheckError();
+
+    return intact == GL_TRUE;
+}
+
+GLuint meshVertexArray(eVertexFormat format)
+{
+    return detail::arena(format).vao;
+}
+
+GLint meshBaseVertex(const Mesh &mesh)
+{
+    return static_cast<GLint>(detail::sArenas[mesh.format].allocations[mesh.id].vertexOffset);
+}
+
+const void* meshIndexOffset(const Mesh &mesh, unsigned int index)
+{
+    const detail::Allocation& allocation = detail::sArenas[mesh.format].allocations[mesh.id];
+    return reinterpret_cast<const void*>(allocation.indexOffset + static_cast<std::size_t>(index) * allocation.indexSize);
 }
 
 void meshDelete(const Mesh &mesh)
 {
-    glDeleteBuffers(1, &mesh.vbo);
-    glDeleteBuffers(1, &mesh.ebo);
-    glDeleteVertexArrays(1, &mesh.vao);
+    detail::Arena& arena = detail::sArenas[mesh.format];
+    if(mesh.id == 0 || mesh.id >= arena.allocations.size() || !arena.allocations[mesh.id].alive)
+    {
+        return;
+    }
+
+    detail::Allocation& allocation = arena.allocations[mesh.id];
+    arena.vertices.release(allocation.vertexOffset, allocation.vertexCount);
+    arena.indices.release(allocation.indexOffset, allocation.indexBytes);
+    allocation.alive = false;
+    arena.freeIds.push_back(mesh.id);
+}
+
+void meshArenaCompact(eVertexFormat format)
+{
+    detail::Arena& arena = detail::sArenas[format];
+    if(!arena.vao)
+    {
+        return;
+    }
+
+    /* nothing to do if the free space is already one block at the end */
+    bool fragmented = arena.vertices.blocks.size() > 1 || arena.indices.blocks.size() > 1
+            || (arena.vertices.blocks.size() == 1 && arena.vertices.blocks[0].offset + arena.vertices.blocks[0].size != arena.vertices.capacity)
+            || (arena.indices.blocks.size() == 1 && arena.indices.blocks[0].offset + arena.indices.blocks[0].size != arena.indices.capacity);
+    if(fragmented && arena.vertices.used == 0 && arena.indices.used == 0)
+    {
+        /* empty arena, the buffers can stay as they are */
+        arena.vertices.blocks = {{0, arena.vertices.capacity}};
+        arena.indices.blocks = {{0, arena.indices.capacity}};
+    }
+    else if(fragmented)
+    {
+        detail::relocate(arena, format, arena.vertices.capacity, arena.indices.capacity, true);
+    }
+}
+
+void meshArenaDelete()
+{
+    for(auto& arena : detail::sArenas)
+    {
+        glDeleteBuffers(1, &arena.vbo);
+        glDeleteBuffers(1, &arena.ebo);
+        glDeleteVertexArrays(1, &arena.vao);
+        arena = detail::Arena();
+    }
 }
@@ -2,51 +2,183 @@
 
 #include "base.h"
 
+#include <cstdint>
 #include <vector>
 
-enum eDataIdx { Position = 0, Normal = 1, UV = 2 };
+enum eDataIdx { Position = 0, Normal = 1, UV = 2, MaterialID = 3 };
+
+/* vertex layout of a mesh in the vertex buffer */
+enum eVertexFormat
+{
+    FLOAT = 0,  // Vertex as is, required for meshes whose vertex buffer gets updated from the cpu
+    PACKED      // PackedVertex
+};
 
 struct Vertex
 {
     Vector3D pos;
     Vector4D normal;
     Vector2D uv;
+    /* index of the material in the material table of the OBJ file (see Model::materialBase) */
+    unsigned int material = 0;
 };
 
+/* compact gpu vertex (16 instead of 40 bytes), decoded by the shaders in src/shader */
+struct PackedVertex
+{
+    /* unsigned normalized position inside the mesh AABB (see Mesh::posScale/posOffset) */
+    uint16_t pos[3];
+    uint16_t material;
+    /* signed normalized normal, GL_INT_2_10_10_10_REV */
+    uint32_t normal;
+    /* half float texture coordinates */
+    uint16_t uv[2];
+};
 
+/**
+ * All meshes of one vertex format share a single vertex and index buffer (and vertex array object). A mesh is a handle to
+ * its sub-allocation in this geometry arena. The vertices are stored at baseVertex, the indices of a mesh are relative to
+ * its first vertex and are drawn with glDrawElementsBaseVertex. Because the arena moves allocations when it grows or gets
+ * compacted, the offsets are looked up through the handle id (see meshBaseVertex and meshIndexOffset).
+ */
 struct Mesh
 {
-    GLuint vao = 0;
-    GLuint vbo = 0;
-    GLuint ebo = 0;
+    /* allocation in the geometry arena of the vertex format, 0 is no allocation */
+    unsigned int id = 0;
 
     unsigned int size_vbo = 0;
     unsigned int size_ibo = 0;
+
+    eVertexFormat format = eVertexFormat::FLOAT;
+    /* GL_UNSIGNED_SHORT if all vertices can be adressed with 16 bit, otherwise GL_UNSIGNED_INT */
+    GLenum indexType = GL_UNSIGNED_INT;
+
+    /* dequantization of the position attribute: pos = aPosition * posScale + posOffset */
+    Vector3D posScale = {1.0f, 1.0f, 1.0f};
+    Vector3D posOffset = {0.0f, 0.0f, 0.0f};
 };
 
 /**
- * @brief Initializes all buffer objects (VBO, IBO) required for the mesh and fill it with data. Further, a vertex array
- * object (VAO) is created and the buffer objects are bind to it.
+ * @brief Copies the mesh data into the geometry arena of the given vertex format. The arena (one VBO, EBO and VAO per
+ * vertex format) is created on first use and grows if required.
  *
  * @param vertices Data for each vertex of the mesh (position, color, normal and uv coordinate data).
  * @param indices List of indices that form polygons in the mesh.
- * @param vertexBufferUsage enum to hint the usage of the vertex buffer (see usage parameter in glBufferData function).
- * @param indexBufferUsage enum to hint the usage of the index buffer (see usage parameter in glBufferData function).
+ * @param format Layout of the vertices in the vertex buffer, PACKED quantizes the vertices (see PackedVertex).
  *
- * @return Initialized mesh structure that can be drawn with OpenGL.
+ * @return Handle of the mesh in the arena that can be drawn with OpenGL.
  *
  * usage:
  *
- *   Mesh myMesh = meshCreate(vertex-data, index-data, GL_STATIC_DRAW, GL_STATIC_DRAW);
- *   glBindVertexArray(myMesh.vao);
- *   glDrawElements(GL_TRIANGLES, myMesh.size_ibo, GL_UNSIGNED_INT, nullptr);
+ *   Mesh myMesh = meshCreate(vertex-data, index-data);
+ *   glBindVertexArray(meshVertexArray(myMesh.format));
+ *   glDrawElementsBaseVertex(GL_TRIANGLES, myMesh.size_ibo, myMesh.indexType, meshIndexOffset(myMesh, 0), meshBaseVertex(myMesh));
+ *
+ */
+Mesh meshCreate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, eVertexFormat format = eVertexFormat::FLOAT);
+
+/**
+ * @brief Converts vertices and indices into the layout of the arena buffers, no OpenGL calls are made. This is what
+ * meshCreate uploads, it can be stored (see pack.h) and uploaded later on.
+ *
+ * @param vertices Data for each vertex of the mesh.
+ * @param indices List of indices that form polygons in the mesh.
+ * @param format Layout of the vertices in the vertex buffer.
+ * @param vertexData Receives the encoded vertices.
+ * @param indexData Receives the encoded indices (16 or 32 bit, see Mesh::indexType).
  *
+ * @return Layout of the mesh (format, sizes, index type and dequantization), not allocated in the arena yet.
  */
-Mesh meshCreate(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, GLenum vertexBufferUsage, GLenum indexBufferUsage);
+Mesh meshEncode(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, eVertexFormat format,
+                std::vector<uint8_t>& vertexData, std::vector<uint8_t>& indexData);
 
 /**
- * @brief Cleanup and delete all OpenGL buffers of a mesh. Has to be called for each mesh after it is not used anymore.
+ * @brief Inverse of meshEncode for FLOAT meshes, converts encoded data back into vertices and indices without OpenGL
+ * calls (e.g. to keep a cpu side copy of the vertices of a mesh that gets animated on the cpu).
+ *
+ * @param layout Layout of the encoded data, the format has to be FLOAT.
+ * @param vertexData meshVertexBytes(layout) bytes of encoded vertices.
+ * @param indexData meshIndexBytes(layout) bytes of encoded indices.
+ * @param vertices Receives the vertices.
+ * @param indices Receives the indices.
+ */
+void meshDecode(const Mesh& layout, const void* vertexData, const void* indexData,
+                std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+/**
+ * @brief Copies already encoded vertices and indices (see meshEncode) into the geometry arena.
+ *
+ * @param layout Layout of the encoded data.
+ * @param vertexData meshVertexBytes(layout) bytes of encoded vertices.
+ * @param indexData meshIndexBytes(layout) bytes of encoded indices.
+ *
+ * @return Handle of the mesh in the arena.
+ */
+Mesh meshCreate(const Mesh& layout, const void* vertexData, const void* indexData);
+
+/**
+ * @brief Size of the encoded vertices of a mesh in bytes.
+ */
+std::size_t meshVertexBytes(const Mesh& mesh);
+
+/**
+ * @brief Size of the encoded indices of a mesh in bytes.
+ */
+std::size_t meshIndexBytes(const Mesh& mesh);
+
+/**
+ * @brief Overwrites the vertices of a FLOAT mesh (e.g. for cpu side animations), the vertex count must not change.
+ */
+void meshUpdateVertices(const Mesh& mesh, const std::vector<Vertex>& vertices);
+
+/**
+ * @brief Maps the vertices of a FLOAT mesh for writing, e.g. from worker threads. The previous contents are invalidated,
+ * so all vertices have to be written before meshUnmapVertices, and the driver does not have to wait for draws that
+ * still read them. No draws or other mappings of the vertex format are allowed until the mesh is unmapped.
+ *
+ * @return Pointer to the vertex count vertices of the mesh.
+ */
+Vertex* meshMapVertices(const Mesh& mesh);
+
+/**
+ * @brief Unmaps the vertices mapped with meshMapVertices.
+ *
+ * @return False if the contents got lost while mapped (e.g. on a display mode change) and have to be written again.
+ */
+bool meshUnmapVertices(const Mesh& mesh);
+
+/**
+ * @brief Vertex array object of the geometry arena of a vertex format, shared by all meshes of that format.
+ */
+GLuint meshVertexArray(eVertexFormat format);
+
+/**
+ * @brief Position of the first vertex of the mesh in the arena, to be used as basevertex parameter of glDrawElementsBaseVertex.
+ */
+GLint meshBaseVertex(const Mesh& mesh);
+
+/**
+ * @brief Byte offset of an index of the mesh in the arena index buffer, to be used as indices parameter of glDrawElements*.
+ *
+ * @param mesh Mesh the indices belong to.
+ * @param index Number of the first index to draw (relative to the mesh).
+ */
+const void* meshIndexOffset(const Mesh& mesh, unsigned int index);
+
+/**
+ * @brief Returns the space of the mesh to its geometry arena. Has to be called for each mesh after it is not used anymore.
  *
  * @param mesh Mesh to delete.
  */
 void meshDelete(const Mesh& mesh);
+
+/**
+ * @brief Moves all live meshes of the arena of a vertex format next to each other, so that the space of deleted meshes
+ * becomes one free block at the end of the buffers again (see modelDelete).
+ */
+void meshArenaCompact(eVertexFormat format);
+
+/**
+ * @brief Deletes the OpenGL buffers of all geometry arenas. Has to be called after all meshes got deleted.
+ */
+void meshArenaDelete();
@@ -0,0 +1,625 @@
+#include "meshopt.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+
+namespace detail
+{
+
+/* size of the LRU cache modelled by the optimizer, larger than the analyzed FIFO to look ahead a bit */
+const std::size_t optimizerCacheSize = 32;
+
+/* vertex score from "Linear-Speed Vertex Cache Optimisation" (Tom Forsyth) */
+float vertexScore(int cachePosition, unsigned int remainingTriangles)
+{
+    if(remainingTriangles == 0)
+    {
+        return -1.0f;
+    }
+
+    float score = 0.0f;
+    if(cachePosition >= 0)
+    {
+        /* the last triangle was just emitted, its vertices get a fixed score to avoid strips */
+        if(cachePosition < 3)
+        {
+            score = 0.75f;
+        }
+        else
+        {
+            float scaler = 1.0f / (optimizerCacheSize - 3);
+            score = std::pow(1.0f - (cachePosition - 3) * scaler, 1.5f);
+        }
+    }
+
+    /* boost vertices with only a few triangles left, so that lonely triangles get finished early */
+    score += 2.0f / std::sqrt(static_cast<float>(remainingTriangles));
+
+    return score;
+}
+
+struct VertexHash
+{
+    std::size_t operator ()(const Vertex &vertex) const
+    {
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+        std::size_t h = 14695981039346656037ull;
+        for(std::size_t i = 0; i < sizeof(Vertex); i++)
+        {
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        }
+        return h;
+    }
+};
+
+struct VertexEqual
+{
+    bool operator ()(const Vertex &a, const Vertex &b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+/* relative position error up to which an object counts as transformed copy */
+const double instanceTolerance = 1e-4;
+
+/* hash of everything that does not change when an object gets translated, rotated or scaled */
+std::size_t topologyHash(const ModelData &model)
+{
+    std::size_t h = 14695981039346656037ull;
+    auto add = [&h](std::size_t value)
+    {
+        h = (h ^ value) * 1099511628211ull;
+    };
+
+    add(model.vertices.size());
+    for(unsigned int index : model.indices)
+    {
+        add(index);
+    }
+    for(const auto& material : model.material)
+    {
+        add(material.id);
+        add(material.indexCount);
+    }
+
+    return h;
+}
+
+bool sameTopology(const ModelData &a, const ModelData &b)
+{
+    if(a.vertices.size() != b.vertices.size() || a.indices != b.indices || a.material.size() != b.material.size())
+    {
+        return false;
+    }
+
+    for(std::size_t i = 0; i < a.material.size(); i++)
+    {
+        if(a.material[i].id != b.material[i].id || a.material[i].indexOffset != b.material[i].indexOffset
+           || a.material[i].indexCount != b.material[i].indexCount)
+        {
+            return false;
+        }
+    }
+
+    for(std::size_t i = 0; i < a.vertices.size(); i++)
+    {
+        const Vertex& va = a.vertices[i];
+        const Vertex& vb = b.vertices[i];
+        if(va.material != vb.material || std::abs(va.uv.x - vb.uv.x) > 1e-5f || std::abs(va.uv.y - vb.uv.y) > 1e-5f)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* inverse of a 3x3 matrix, false if it is (close to) singular */
+bool invert(const double m[3][3], double result[3][3])
+{
+    double det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1])
+               - m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0])
+               + m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+
+    double scale = 0.0;
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            scale = std::max(scale, std::abs(m[i][j]));
+        }
+    }
+    if(std::abs(det) <= 1e-9 * scale * scale * scale)
+    {
+        return false;
+    }
+
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            /* cofactor of m[j][i] */
+            int r0 = (j + 1) % 3, r1 = (j + 2) % 3;
+            int c0 = (i + 1) % 3, c1 = (i + 2) % 3;
+            result[i][j] = (m[r0][c0] * m[r1][c1] - m[r0][c1] * m[r1][c0]) / det;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Least squares fit of an affine transformation with positive determinant from the positions of a to the positions of
+ * b. Returns false if the fit does not reproduce the positions and normals of b.
+ */
+bool fitTransform(const ModelData &a, const ModelData &b, Matrix4D &transform)
+{
+    const std::size_t n = a.vertices.size();
+    if(n < 4)
+    {
+        return false;
+    }
+
+    double ca[3] = {0.0, 0.0, 0.0};
+    double cb[3] = {0.0, 0.0, 0.0};
+    double minB[3] = {DBL_MAX, DBL_MAX, DBL_MAX};
+    double maxB[3] = {-DBL_MAX, -DBL_MAX, -DBL_MAX};
+    for(std::size_t k = 0; k < n; k++)
+    {
+        for(int i = 0; i < 3; i++)
+        {
+            ca[i] += a.vertices[k].pos[i];
+            cb[i] += b.vertices[k].pos[i];
+            minB[i] = std::min(minB[i], static_cast<double>(b.vertices[k].pos[i]));
+            maxB[i] = std::max(maxB[i], static_cast<double>(b.vertices[k].pos[i]));
+        }
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        ca[i] /= n;
+        cb[i] /= n;
+    }
+
+    /* normal equations of the centered positions: L * sum(pa pa^T) = sum(pb pa^T) */
+    double aa[3][3] = {};
+    double ba[3][3] = {};
+    for(std::size_t k = 0; k < n; k++)
+    {
+        double pa[3], pb[3];
+        for(int i = 0; i < 3; i++)
+        {
+            pa[i] = a.vertices[k].pos[i] - ca[i];
+            pb[i] = b.vertices[k].pos[i] - cb[i];
+        }
+        for(int i = 0; i < 3; i++)
+        {
+            for(int j = 0; j < 3; j++)
+            {
+                aa[i][j] += pa[i] * pa[j];
+                ba[i][j] += pb[i] * pa[j];
+            }
+        }
+    }
+
+    /* flat objects have no unique fit */
+    double aaInverse[3][3];
+    if(!invert(aa, aaInverse))
+    {
+        return false;
+    }
+
+    double linear[3][3] = {};
+    double translation[3];
+    for(int i = 0; i < 3; i++)
+    {
+        for(int j = 0; j < 3; j++)
+        {
+            for(int k = 0; k < 3; k++)
+            {
+                linear[i][j] += ba[i][k] * aaInverse[k][j];
+            }
+        }
+    }
+    for(int i = 0; i < 3; i++)
+    {
+        translation[i] = cb[i] - (linear[i][0] * ca[0] + linear[i][1] * ca[1] + linear[i][2] * ca[2]);
+    }
+
+    /* normals transform with the inverse transpose, mirrored copies would flip the winding order */
+    double linearInverse[3][3];
+    if(!invert(linear, linearInverse))
+    {
+        return false;
+    }
+    double det = linear[0][0] * (linear[1][1] * linear[2][2] - linear[1][2] * linear[2][1])
+               - linear[0][1] * (linear[1][0] * linear[2][2] - linear[1][2] * linear[2][0])
+               + linear[0][2] * (linear[1][0] * linear[2][1] - linear[1][1] * linear[2][0]);
+    if(det <= 0.0)
+    {
+        return false;
+    }
+
+    double extent = std::max({maxB[0] - minB[0], maxB[1] - minB[1], maxB[2] - minB[2]});
+    double tolerance = instanceTolerance * extent;
+
+    for(std::size_t k = 0; k < n; k++)
+    {
+        const Vertex& va = a.vertices[k];
+        const Vertex& vb = b.vertices[k];
+
+        for(int i = 0; i < 3; i++)
+        {
+            double p = linear[i][0] * va.pos[0] + linear[i][1] * va.pos[1] + linear[i][2] * va.pos[2] + translation[i];
+            if(std::abs(p - vb.pos[i]) > tolerance)
+            {
+                return false;
+            }
+        }
+
+        double normal[3];
+        for(int i = 0; i < 3; i++)
+        {
+            normal[i] = linearInverse[0][i] * va.normal.x + linearInverse[1][i] * va.normal.y + linearInverse[2][i] * va.normal.z;
+        }
+        double length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        double lengthB = std::sqrt(vb.normal.x * vb.normal.x + vb.normal.y * vb.normal.y + vb.normal.z * vb.normal.z);
+        if(length > 0.0 && lengthB > 0.0)
+        {
+            double cosine = (normal[0] * vb.normal.x + normal[1] * vb.normal.y + normal[2] * vb.normal.z) / (length * lengthB);
+            if(cosine < 0.999)
+            {
+                return false;
+            }
+        }
+        else if(length > 0.0 || lengthB > 0.0)
+        {
+            return false;
+        }
+    }
+
+    transform = Matrix4D(static_cast<float>(linear[0][0]), static_cast<float>(linear[0][1]), static_cast<float>(linear[0][2]), static_cast<float>(translation[0]),
+                         static_cast<float>(linear[1][0]), static_cast<float>(linear[1][1]), static_cast<float>(linear[1][2]), static_cast<float>(translation[1]),
+                         static_cast<float>(linear[2][0]), static_cast<float>(linear[2][1]), static_cast<float>(linear[2][2]), static_cast<float>(translation[2]),
+                         0.0f, 0.0f, 0.0f, 1.0f);
+
+    return true;
+}
+
+}
+
+VertexCacheStats meshAnalyzeVertexCache(const unsigned int* indices, std::size_t indexCount, std::size_t vertexCount, unsigned int cacheSize)
+{
+    VertexCacheStats stats;
+    stats.triangles = static_cast<unsigned int>(indexCount / 3);
+
+    /* a vertex is in the FIFO if less than cacheSize misses happend since it was inserted */
+    std::vector<unsigned int> insertedAt(vertexCount, 0);
+    std::vector<bool> referenced(vertexCount, false);
+    unsigned int misses = cacheSize + 1;
+
+    for(std::size_t i = 0; i < indexCount; i++)
+    {
+        unsigned int v = indices[i];
+        if(misses - insertedAt[v] > cacheSize)
+        {
+            insertedAt[v] = misses++;
+            stats.transformed++;
+        }
+        if(!referenced[v])
+        {
+            referenced[v] = true;
+            stats.vertices++;
+        }
+    }
+
+    return stats;
+}
+
+std::size_t meshWeld(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    std::unordered_map<Vertex, unsigned int, detail::VertexHash, detail::VertexEqual> lookup;
+    lookup.reserve(vertices.size());
+
+    std::vector<unsigned int> remap(vertices.size());
+    std::vector<Vertex> welded;
+    welded.reserve(vertices.size());
+
+    for(std::size_t i = 0; i < vertices.size(); i++)
+    {
+        auto [it, inserted] = lookup.try_emplace(vertices[i], static_cast<unsigned int>(welded.size()));
+        if(inserted)
+        {
+            welded.push_back(vertices[i]);
+        }
+        remap[i] = it->second;
+    }
+
+    for(auto& index : indices)
+    {
+        index = remap[index];
+    }
+
+    std::size_t removed = vertices.size() - welded.size();
+    vertices.swap(welded);
+
+    return removed;
+}
+
+void meshOptimizeVertexCache(unsigned int* indices, std::size_t indexCount, std::size_t vertexCount)
+{
+    const std::size_t triangleCount = indexCount / 3;
+    if(triangleCount < 2)
+    {
+        return;
+    }
+
+    /* triangle adjacency per vertex, the first remaining[v] entries are the triangles not emitted yet */
+    std::vector<unsigned int> remaining(vertexCount, 0);
+    for(std::size_t i = 0; i < indexCount; i++)
+    {
+        remaining[indices[i]]++;
+    }
+
+    std::vector<unsigned int> adjacencyOffset(vertexCount + 1, 0);
+    for(std::size_t v = 0; v < vertexCount; v++)
+    {
+        adjacencyOffset[v + 1] = adjacencyOffset[v] + remaining[v];
+    }
+
+    std::vector<unsigned int> adjacency(indexCount);
+    {
+        std::vector<unsigned int> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+        for(std::size_t i = 0; i < indexCount; i++)
+        {
+            adjacency[fill[indices[i]]++] = static_cast<unsigned int>(i / 3);
+        }
+    }
+
+    std::vector<int> cachePosition(vertexCount, -1);
+    std::vector<float> vertexScore(vertexCount);
+    for(std::size_t v = 0; v < vertexCount; v++)
+    {
+        vertexScore[v] = detail::vertexScore(-1, remaining[v]);
+    }
+
+    std::vector<float> triangleScore(triangleCount);
+    std::vector<bool> emitted(triangleCount, false);
+    for(std::size_t t = 0; t < triangleCount; t++)
+    {
+        const unsigned int* tri = &indices[t * 3];
+        triangleScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+    }
+
+    std::vector<unsigned int> output;
+    output.reserve(indexCount);
+
+    std::vector<unsigned int> cache;
+    std::vector<unsigned int> newCache;
+    cache.reserve(detail::optimizerCacheSize + 3);
+    newCache.reserve(detail::optimizerCacheSize + 3);
+
+    std::size_t scan = 0;
+    long best = 0;
+    for(std::size_t t = 1; t < triangleCount; t++)
+    {
+        if(triangleScore[t] > triangleScore[best])
+        {
+            best = static_cast<long>(t);
+        }
+    }
+
+    while(output.size() < indexCount)
+    {
+        /* no candidate in the cache, continue with the next triangle not emitted yet */
+        if(best < 0)
+        {
+            while(emitted[scan])
+            {
+                scan++;
+            }
+            best = static_cast<long>(scan);
+        }
+
+        const unsigned int tri[3] = {indices[best * 3], indices[best * 3 + 1], indices[best * 3 + 2]};
+        emitted[best] = true;
+
+        for(unsigned int v : tri)
+        {
+            output.push_back(v);
+
+            /* remove triangle from adjacency of the vertex */
+            unsigned int* adj = &adjacency[adjacencyOffset[v]];
+            for(unsigned int i = 0; i < remaining[v]; i++)
+            {
+                if(adj[i] == static_cast<unsigned int>(best))
+                {
+                    std::swap(adj[i], adj[remaining[v] - 1]);
+                    remaining[v]--;
+                    break;
+                }
+            }
+        }
+
+        /* move the triangle vertices to the front of the LRU cache */
+        newCache.assign(tri, tri + 3);
+        for(unsigned int v : cache)
+        {
+            if(v != tri[0] && v != tri[1] && v != tri[2])
+            {
+                newCache.push_back(v);
+            }
+        }
+
+        for(std::size_t i = 0; i < newCache.size(); i++)
+        {
+            unsigned int v = newCache[i];
+            cachePosition[v] = i < detail::optimizerCacheSize ? static_cast<int>(i) : -1;
+            vertexScore[v] = detail::vertexScore(cachePosition[v], remaining[v]);
+        }
+
+        /* update triangles touching the cache and pick the best one as next candidate */
+        best = -1;
+        float bestScore = -1.0f;
+        for(unsigned int v : newCache)
+        {
+            const unsigned int* adj = &adjacency[adjacencyOffset[v]];
+            for(unsigned int i = 0; i < remaining[v]; i++)
+            {
+                unsigned int t = adj[i];
+                const unsigned int* other = &indices[t * 3];
+                triangleScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+
+                if(triangleScore[t] > bestScore)
+                {
+                    bestScore = triangleScore[t];
+                    best = static_cast<long>(t);
+                }
+            }
+        }
+
+        if(newCache.size() > detail::optimizerCacheSize)
+        {
+            newCache.resize(detail::optimizerCacheSize);
+        }
+        cache.swap(newCache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void meshOptimizeVertexFetch(std::vector<Vertex> &vertices, std::vector<unsigned int> &indices)
+{
+    const unsigned int unused = ~0u;
+    std::vector<unsigned int> remap(vertices.size(), unused);
+
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for(auto& index : indices)
+    {
+        if(remap[index] == unused)
+        {
+            remap[index] = static_cast<unsigned int>(reordered.size());
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices.swap(reordered);
+}
+
+void modelOptimize(std::vector<ModelData> &models, const std::string &label)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    VertexCacheStats before;
+    VertexCacheStats after;
+    std::size_t welded = 0;
+
+    auto accumulate = [](VertexCacheStats& total, const VertexCacheStats& stats)
+    {
+        total.triangles += stats.triangles;
+        total.vertices += stats.vertices;
+        total.transformed += stats.transformed;
+    };
+
+    /* per object statistics, logged after the file total for the objects the optimization changed */
+    std::stringstream details;
+
+    for(auto& model : models)
+    {
+        welded += meshWeld(model.vertices, model.indices);
+
+        VertexCacheStats modelBefore;
+        VertexCacheStats modelAfter;
+        for(const auto& material : model.material)
+        {
+            unsigned int* range = model.indices.data() + material.indexOffset;
+
+            accumulate(modelBefore, meshAnalyzeVertexCache(range, material.indexCount, model.vertices.size()));
+            meshOptimizeVertexCache(range, material.indexCount, model.vertices.size());
+            accumulate(modelAfter, meshAnalyzeVertexCache(range, material.indexCount, model.vertices.size()));
+        }
+
+        meshOptimizeVertexFetch(model.vertices, model.indices);
+
+        accumulate(before, modelBefore);
+        accumulate(after, modelAfter);
+        if(modelBefore.transformed != modelAfter.transformed)
+        {
+            details << "[Model]   " << model.name << ": "
+                    << "ACMR " << modelBefore.acmr() << " -> " << modelAfter.acmr() << ", "
+                    << "ATVR " << modelBefore.atvr() << " -> " << modelAfter.atvr() << std::endl;
+        }
+    }
+
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "[Model] Optimized " << label << " in " << duration.count() << " ms, "
+              << "ACMR " << before.acmr() << " -> " << after.acmr() << ", "
+              << "ATVR " << before.atvr() << " -> " << after.atvr() << ", "
+              << welded << " duplicate vertices removed" << std::endl
+              << details.str();
+}
+
+void modelFindInstances(std::vector<ModelData> &models, const std::string &label)
+{
+    auto start = std::chrono::steady_clock::now();
+
+    /* candidates by topology hash, positions in the output */
+    std::unordered_map<std::size_t, std::vector<std::size_t>> groups;
+    std::vector<ModelData> output;
+    std::size_t copies = 0;
+    std::size_t savedVertices = 0;
+
+    for(auto& model : models)
+    {
+        auto& candidates = groups[detail::topologyHash(model)];
+
+        bool instanced = false;
+        for(std::size_t candidate : candidates)
+        {
+            ModelData& first = output[candidate];
+
+            Matrix4D transform;
+            if(detail::sameTopology(first, model) && detail::fitTransform(first, model, transform))
+            {
+                if(first.instances.empty())
+                {
+                    first.instances.push_back(Matrix4D::identity());
+                }
+                first.instances.push_back(transform);
+
+                copies++;
+                savedVertices += model.vertices.size();
+                instanced = true;
+                break;
+            }
+        }
+
+        if(!instanced)
+        {
+            candidates.push_back(output.size());
+            output.push_back(std::move(model));
+        }
+    }
+
+    std::size_t groupCount = 0;
+    for(const auto& model : output)
+    {
+        groupCount += model.instances.empty() ? 0 : 1;
+    }
+
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "[Model] Instanced " << label << " in " << duration.count() << " ms, " << models.size() << " -> "
+              << output.size() << " objects, " << copies << " copies merged into " << groupCount << " instanced objects, "
+              << savedVertices << " vertices saved" << std::endl;
+
+    models.swap(output);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "model.h"
+
+/* result of a post-transform vertex cache simulation */
+struct VertexCacheStats
+{
+    unsigned int triangles = 0;
+    unsigned int vertices = 0;
+    unsigned int transformed = 0;
+
+    /* average cache miss ratio, vertex shader invocations per triangle (0.5 is optimal) */
+    float acmr() const { return triangles ? static_cast<float>(transformed) / triangles : 0.0f; }
+    /* average transformed vertex ratio, vertex shader invocations per referenced vertex (1.0 is optimal) */
+    float atvr() const { return vertices ? static_cast<float>(transformed) / vertices : 0.0f; }
+};
+
+/**
+ * @brief Simulates a FIFO post-transform vertex cache for a triangle list.
+ *
+ * @param indices Triangle list indices.
+ * @param indexCount Number of indices.
+ * @param vertexCount Number of vertices referenced by the indices.
+ * @param cacheSize Number of entries of the simulated cache.
+ *
+ * @return Number of triangles, referenced vertices and vertex shader invocations.
+ */
+VertexCacheStats meshAnalyzeVertexCache(const unsigned int* indices, std::size_t indexCount, std::size_t vertexCount, unsigned int cacheSize = 16);
+
+/**
+ * @brief Merges vertices with bit-identical attributes and remaps the indices accordingly.
+ *
+ * @return Number of removed vertices.
+ */
+std::size_t meshWeld(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+/**
+ * @brief Reorders the triangles of a triangle list for post-transform vertex cache locality (Forsyth's algorithm).
+ *
+ * @param indices Triangle list indices, reordered in place.
+ * @param indexCount Number of indices.
+ * @param vertexCount Number of vertices referenced by the indices.
+ */
+void meshOptimizeVertexCache(unsigned int* indices, std::size_t indexCount, std::size_t vertexCount);
+
+/**
+ * @brief Reorders the vertices in order of their first use in the index buffer, unreferenced vertices are dropped.
+ */
+void meshOptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+/**
+ * @brief Optimization stage between modelParse and modelUpload. Welds duplicate vertices, reorders the triangles of
+ * each material range for the post-transform vertex cache and the vertices for fetch locality. ACMR/ATVR before and
+ * after the optimization are logged for the whole file and for every object whose ACMR changed.
+ *
+ * @param models Parsed objects, optimized in place.
+ * @param label Name used in the log output (e.g. path of the OBJ file).
+ */
+void modelOptimize(std::vector<ModelData>& models, const std::string& label);
+
+/**
+ * @brief Merges objects that are transformed copies of each other into one object with instances. Objects with the
+ * same topology (indices, materials and texture coordinates) are candidates, a least squares fit of an affine
+ * transformation from the positions of the first object to the candidate decides whether it is a copy (positions and
+ * normals have to match). The first object of each group keeps its mesh and gets the transformations of all copies
+ * (starting with the identity) in ModelData::instances, the copies are removed.
+ *
+ * @param models Parsed objects, merged in place.
+ * @param label Name used in the log output (e.g. path of the OBJ file).
+ */
+void modelFindInstances(std::vector<ModelData>& models, const std::string& label);
@@ -1,25 +1,112 @@
 #include "model.h"
+#include "freelist.h"
+#include "jobs.h"
+#include "meshopt.h"
+#include "pack.h"
+#include "shader.h"
+#include "stats.h"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <fstream>
 #include <map>
-#include <sstream>
+#include <memory>
 #include <iostream>
 #include <stdexcept>
+#include <string_view>
+#include <unordered_map>
 
 namespace detail
 {
 
-void tokenize(std::string const &str, const char delim, std::vector<std::string> &out)
+/* reads the whole file into one buffer, all parsing below works on views into this buffer */
+std::string fileRead(const std::string &filepath, const std::string &errorPrefix)
 {
-    size_t start;
-    size_t end = 0;
+    std::ifstream file(filepath, std::ios::binary | std::ios::ate);
+    if(!file.is_open())
+    {
+        throw std::runtime_error(errorPrefix + " Couldn't open OBJ file at " + filepath);
+    }
+
+    std::string buffer;
+    buffer.resize(static_cast<std::size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(&buffer[0], static_cast<std::streamsize>(buffer.size()));
+
+    return buffer;
+}
+
+struct Tokenizer
+{
+    const char* pos;
+    const char* end;
+
+    explicit Tokenizer(std::string_view buffer) : pos(buffer.data()), end(buffer.data() + buffer.size()) {}
+
+    /* returns the next line (without line break), the tokenizer is empty after the last line */
+    std::string_view line()
+    {
+        const char* start = pos;
+        while(pos < end && *pos != '\n')
+        {
+            pos++;
+        }
+
+        std::string_view result(start, pos - start);
+        if(pos < end)
+        {
+            pos++;
+        }
+        if(!result.empty() && result.back() == '\r')
+        {
+            result.remove_suffix(1);
+        }
+
+        return result;
+    }
+
+    bool empty() const
+    {
+        return pos >= end;
+    }
+};
+
+inline bool isSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+/* pops the next whitespace separated token from the front of the line */
+std::string_view token(std::string_view &line)
+{
+    std::size_t start = 0;
+    while(start < line.size() && isSpace(line[start]))
+    {
+        start++;
+    }
 
-    while( (start = str.find_first_not_of(delim, end)) != std::string::npos )
+    std::size_t stop = start;
+    while(stop < line.size() && !isSpace(line[stop]))
     {
-        end = str.find(delim, start);
-        out.push_back(str.substr(start, end - start));
+        stop++;
     }
+
+    std::string_view result = line.substr(start, stop - start);
+    line.remove_prefix(stop);
+
+    return result;
+}
+
+/* parses the next token as number, value stays untouched if the token is not a number */
+template<typename T>
+std::string_view& operator >>(std::string_view &line, T &value)
+{
+    std::string_view data = token(line);
+    std::from_chars(data.data(), data.data() + data.size(), value);
+
+    return line;
 }
 
 struct Index
@@ -39,130 +126,377 @@ struct Index
     unsigned int vt = 0;
     unsigned int vn = 0;
 
-    friend std::stringstream& operator >>(std::stringstream& in, Index& index)
+    /* material of the face, corners of different materials are not welded */
+    unsigned int material = 0;
+
+    /* face corner in the form v, v/vt, v//vn or v/vt/vn */
+    friend std::string_view& operator >>(std::string_view &line, Index &index)
+    {
+        std::string_view data = token(line);
+        const char* p = data.data();
+        const char* end = data.data() + data.size();
+
+        unsigned int* fields[3] = {&index.v, &index.vt, &index.vn};
+        int type = 0;
+
+        for(int i = 0; i < 3 && p < end; i++)
+        {
+            auto result = std::from_chars(p, end, *fields[i]);
+            if(result.ptr != p)
+            {
+                type |= (i == 0) ? V : (i == 1) ? VT : VN;
+            }
+
+            p = result.ptr;
+            if(p < end && *p == '/')
+            {
+                p++;
+            }
+        }
+
+        if(type & V)
+        {
+            index.type = static_cast<eType>(type);
+        }
+
+        return line;
+    }
+
+    friend bool operator ==(const Index &a, const Index &b)
+    {
+        return a.v == b.v && a.vt == b.vt && a.vn == b.vn && a.material == b.material;
+    }
+};
+
+struct IndexHash
+{
+    std::size_t operator ()(const Index &index) const
     {
-        std::string data;
-        in >> data;
+        std::size_t h = index.v;
+        h = h * 0x9E3779B97F4A7C15ull + index.vt;
+        h = h * 0x9E3779B97F4A7C15ull + index.vn;
+        h = h * 0x9E3779B97F4A7C15ull + index.material;
+        return h ^ (h >> 29);
+    }
+};
 
-        std::vector<std::string> tokens;
-        tokenize(data, '/', tokens);
+/* welds face corners with identical (v, vt, vn) triple of one object into a single vertex */
+struct Welder
+{
+    std::unordered_map<Index, unsigned int, IndexHash> lookup;
+    std::size_t corners = 0;
+
+    unsigned int vertex(const Index &index, const std::vector<Vector3D> &vertices, const std::vector<Vector3D> &normals,
+                        const std::vector<Vector2D> &uvs, std::vector<Vertex> &glVertices)
+    {
+        corners++;
 
-        if(tokens.empty())
+        auto [it, inserted] = lookup.try_emplace(index, static_cast<unsigned int>(glVertices.size()));
+        if(!inserted)
         {
-            return in;
+            return it->second;
         }
 
-        index.v = std::stoi( tokens[0] );
+        Vertex& vertex = glVertices.emplace_back();
+        vertex.pos = vertices[index.v - 1];
+        vertex.material = index.material;
 
-        if(tokens.size() == 2)
+        if(index.type & Index::VN)
         {
-            index.vn = std::stoi( tokens[1] );
-            index.type = V_VN;
+            vertex.normal = normals[index.vn - 1];
         }
-        else if(tokens.size() == 3)
+        if(index.type & Index::VT)
         {
-            index.vt = std::stoi( tokens[1] );
-            index.vn = std::stoi( tokens[2] );
-            index.type = V_VT_VN;
+            vertex.uv = uvs[index.vt - 1];
         }
 
-        return in;
+        return it->second;
+    }
+
+    void clear()
+    {
+        lookup.clear();
     }
 };
 
+/* std140 layout of struct Material in the shaders, the emission is animated per model on the cpu and not part of it */
+struct GpuMaterial
+{
+    Vector4D ambient;
+    Vector4D diffuse;
+    Vector4D specular;  // w is the shininess
+};
+
+/* has to match the array size of the Materials block in src/shader */
+const std::size_t maxMaterials = 256;
+
+struct
+{
+    GLuint ubo = 0;
+    FreeList entries;
+
+    /* models of the OBJ file per first entry of its range, the range is freed with the last one (see modelDelete) */
+    std::map<unsigned int, std::size_t> models;
+} sMaterialTable;
+
+/* adds the materials of one OBJ file (indexed by Material::id) for the given number of models and returns the position
+ * of the first one */
+unsigned int materialTableAdd(const std::vector<Material> &materials, std::size_t models)
+{
+    auto& table = sMaterialTable;
+    if(!table.ubo)
+    {
+        glGenBuffers(1, &table.ubo);
+        glBindBuffer(GL_UNIFORM_BUFFER, table.ubo);
+        glBufferData(GL_UNIFORM_BUFFER, maxMaterials * sizeof(GpuMaterial), nullptr, GL_STATIC_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, eUniformBlock::MaterialBlock, table.ubo);
+        table.entries.grow(maxMaterials);
+    }
+    if(materials.empty() || models == 0)
+    {
+        return 0;
+    }
+
+    std::size_t base = 0;
+    if(!table.entries.allocate(materials.size(), base))
+    {
+        throw std::runtime_error("[Model] Material table is full, at most " + std::to_string(maxMaterials) + " materials are supported");
+    }
+    table.models[static_cast<unsigned int>(base)] = models;
+
+    std::vector<GpuMaterial> entries;
+    entries.reserve(materials.size());
+    for(const auto& m : materials)
+    {
+        entries.push_back({Vector4D(m.ambient, 1.0f), Vector4D(m.diffuse, 1.0f), Vector4D(m.specular, m.shininess)});
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, table.ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, base * sizeof(GpuMaterial), entries.size() * sizeof(GpuMaterial), entries.data());
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glCheckError();
+
+    return static_cast<unsigned int>(base);
 }
 
-std::map<std::string, Material> materialLoad(const std::string &filepath)
+/* frees the materials of an OBJ file after the last of its models is deleted */
+void materialTableRelease(unsigned int base, unsigned int count)
 {
-    std::ifstream materialFile(filepath);
-    if(!materialFile.is_open())
+    auto& table = sMaterialTable;
+    auto it = table.models.find(base);
+    if(count == 0 || it == table.models.end())
+    {
+        return;
+    }
+
+    if(--it->second == 0)
     {
-        throw std::runtime_error("[Model] Couldn't open OBJ file at " + filepath);
+        table.entries.release(base, count);
+        table.models.erase(it);
     }
+}
 
-    std::map<std::string, Material> materials;
+/* six RGBA32F texels per instance, the rows of the affine transformation followed by the rows of its normal matrix */
+const unsigned int instanceRows = 6;
+
+struct
+{
+    GLuint buffer = 0;
+    GLuint texture = 0;
+
+    /* in instances, the rows are the cpu side copy of the whole buffer for when it grows */
+    FreeList instances;
+    std::size_t uploaded = 0;
+    std::vector<Vector4D> rows;
+} sInstanceTable;
+
+/* adds instance transformations and returns the position of the first one, no transformations is one identity */
+unsigned int instanceTableAdd(const std::vector<Matrix4D> &transforms)
+{
+    auto& table = sInstanceTable;
+    if(!table.buffer)
+    {
+        /* entry 0 is shared by all models that are not instanced */
+        std::size_t identity = 0;
+        table.instances.grow(1);
+        table.instances.allocate(1, identity);
+        table.rows = {{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f},
+                      {1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}};
+
+        /* the buffer object only exists after its first bind, glTexBuffer fails on a name that was just generated */
+        glGenBuffers(1, &table.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, table.buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glGenTextures(1, &table.texture);
+        glActiveTexture(GL_TEXTURE0 + eTextureUnit::InstanceUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, table.texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, table.buffer);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    std::size_t offset = 0;
+    while(!table.instances.allocate(transforms.size(), offset))
+    {
+        table.instances.grow(std::max(table.instances.capacity * 2, table.instances.capacity + transforms.size()));
+        table.rows.resize(table.instances.capacity * instanceRows);
+    }
+
+    Vector4D* rows = table.rows.data() + offset * instanceRows;
+    for(const auto& transform : transforms)
+    {
+        for(int i = 0; i < 3; i++)
+        {
+            *rows++ = Vector4D(transform(i, 0), transform(i, 1), transform(i, 2), transform(i, 3));
+        }
+
+        Matrix3D normal = normalMatrix(transform);
+        for(int i = 0; i < 3; i++)
+        {
+            *rows++ = Vector4D(normal(i, 0), normal(i, 1), normal(i, 2), 0.0f);
+        }
+    }
+
+    /* the whole table only after the buffer grew, otherwise only the added rows */
+    glBindBuffer(GL_TEXTURE_BUFFER, table.buffer);
+    if(table.uploaded != table.instances.capacity)
+    {
+        glBufferData(GL_TEXTURE_BUFFER, table.rows.size() * sizeof(Vector4D), table.rows.data(), GL_STATIC_DRAW);
+        table.uploaded = table.instances.capacity;
+    }
+    else if(!transforms.empty())
+    {
+        glBufferSubData(GL_TEXTURE_BUFFER, offset * instanceRows * sizeof(Vector4D),
+                        transforms.size() * instanceRows * sizeof(Vector4D), table.rows.data() + offset * instanceRows);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glCheckError();
+
+    return static_cast<unsigned int>(offset);
+}
+
+/* frees the instance transformations of a model, entry 0 stays */
+void instanceTableRelease(unsigned int offset, unsigned int count)
+{
+    if(offset != 0)
+    {
+        sInstanceTable.instances.release(offset, count);
+    }
+}
+
+/* reused arguments of glMultiDrawElementsBaseVertex */
+struct
+{
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+} sDrawRanges;
+
+}
+
+std::map<std::string, Material, std::less<>> materialLoad(const std::string &filepath)
+{
+    using detail::operator>>;
+
+    const std::string buffer = detail::fileRead(filepath, "[Model]");
+
+    std::map<std::string, Material, std::less<>> materials;
     Material* current = nullptr;
 
     /* consume material commands */
-    std::string line;
-    while(std::getline(materialFile, line))
+    detail::Tokenizer tokenizer(buffer);
+    while(!tokenizer.empty())
     {
-        std::stringstream ss(line);
+        std::string_view line = tokenizer.line();
 
         /* command code */
-        std::string code;
-        ss >> code;
+        std::string_view code = detail::token(line);
 
         /* create new material */
         if(code == "newmtl")
         {
             Material material;
-            ss >> material.name;
+            material.name = detail::token(line);
 
-            materials[material.name] = material;
-            current = &materials[material.name];
+            auto it = materials.find(material.name);
+            material.id = it != materials.end() ? it->second.id : static_cast<unsigned int>(materials.size());
+
+            current = &(materials[material.name] = material);
         }
         /* shininess parameter */
         else if(code == "Ns" && current)
         {
             float ns = 1.0f;
-            ss >> ns;
+            line >> ns;
 
             current->shininess = ns;
         }
         /* ambient color */
         else if(code == "Ka" && current)
         {
-            ss >> current->ambient.x >> current->ambient.y >> current->ambient.z;
+            line >> current->ambient.x >> current->ambient.y >> current->ambient.z;
         }
         /* diffuse color */
         else if(code == "Kd" && current)
         {
-            ss >> current->diffuse.x >> current->diffuse.y >> current->diffuse.z;
+            line >> current->diffuse.x >> current->diffuse.y >> current->diffuse.z;
         }
         /* specular color */
         else if(code == "Ks" && current)
         {
-            ss >> current->specular.x >> current->specular.y >> current->specular.z;
+            line >> current->specular.x >> current->specular.y >> current->specular.z;
         }
         /* emission color */
         else if(code == "Ke" && current)
         {
-            ss >> current->emission.x >> current->emission.y >> current->emission.z;
+            line >> current->emission.x >> current->emission.y >> current->emission.z;
         }
     }
 
     return materials;
 }
 
-std::vector<Model> modelLoad(const std::string &filepath)
+namespace detail
 {
-    std::ifstream objFile(filepath);
-    if(!objFile.is_open())
-    {
-        throw std::runtime_error("[Model] Couldn't open OBJ file at " + filepath);
-    }
 
+/* object that faces and materials in front of the first "o" line (or files without any) belong to */
+const char* const implicitObjectName = "default";
+
+/* parses the OBJ file line by line on the calling thread, the reference for objParseParallel */
+std::vector<ModelData> objParseSerial(std::string_view buffer, const std::string &filepath, std::size_t &corners)
+{
     /* container for GL related stuff */
-    std::vector<Model> models;
-    std::vector<Vertex> glVertices;
-    std::vector<unsigned int> glIndices;
+    std::vector<ModelData> models;
 
     /* container for OBJ related stuff */
-    std::map<std::string, Material> materials;
+    std::map<std::string, Material, std::less<>> materials;
     std::vector<Vector3D> vertices;
     std::vector<Vector3D> normals;
     std::vector<Vector2D> uvs;
 
+    /* material of the following faces */
+    unsigned int currentMaterial = 0;
+
+    /* vertex welding per object */
+    Welder welder;
+
+    /* current object, opens the implicit object for faces and materials in front of the first object */
+    auto object = [&models]() -> ModelData&
+    {
+        if(models.empty())
+        {
+            models.emplace_back().name = implicitObjectName;
+        }
+        return models.back();
+    };
+
     /* consume commonds from obj file */
-    std::string line;
-    while(std::getline(objFile, line))
+    Tokenizer tokenizer(buffer);
+    while(!tokenizer.empty())
     {
-        std::stringstream ss(line);
+        std::string_view line = tokenizer.line();
 
         /* command code */
-        std::string code;
-        ss >> code;
+        std::string_view code = token(line);
 
         if(code == "")
         {
@@ -173,199 +507,649 @@ std::vector<Model> modelLoad(const std::string &filepath)
         {
             if(!models.empty())
             {
-                Model& model = models.back();
-                model.mesh = meshCreate(glVertices, glIndices, GL_STATIC_DRAW, GL_STATIC_DRAW);
+                ModelData& model = models.back();
 
                 if(!model.material.empty())
                 {
                     auto& material = model.material.back();
-                    material.indexCount = glVertices.size() - material.indexOffset;
+                    material.indexCount = model.indices.size() - material.indexOffset;
                 }
 
-                glVertices.clear();
-                glIndices.clear();
+                welder.clear();
             }
 
-            Model& model = models.emplace_back();
-            ss >> model.name;
+            ModelData& model = models.emplace_back();
+            model.name = token(line);
         }
         /* vertex postion */
         else if(code == "v")
         {
             auto& v = vertices.emplace_back();
-            ss >> v.x >> v.y >> v.z;
+            line >> v.x >> v.y >> v.z;
         }
         /* vertex texture coordinates */
         else if(code == "vt")
         {
             auto& vt = uvs.emplace_back();
-            ss >> vt.x >> vt.y;
+            line >> vt.x >> vt.y;
         }
         /* vertex normal */
         else if(code == "vn")
         {
             auto& vn = normals.emplace_back();
-            ss >> vn.x >> vn.y >> vn.z;
+            line >> vn.x >> vn.y >> vn.z;
         }
         /* face definition (currently only triangles) */
         else if(code == "f")
         {
-            detail::Index _idx[3];
-            ss >> _idx[0] >> _idx[1] >> _idx[2];
+            ModelData& model = object();
+
+            Index _idx[3];
+            line >> _idx[0] >> _idx[1] >> _idx[2];
 
             for(int i = 0; i < 3; i++)
             {
-                glIndices.emplace_back(glVertices.size());
-
-                Vertex& vertex = glVertices.emplace_back();
-                vertex.pos = vertices[_idx[i].v - 1];
-
-                if(_idx[i].type == detail::Index::V_VN)
-                {
-                    vertex.normal = normals[_idx[i].vn - 1];
-                }
-                else if(_idx[i].type == detail::Index::V_VT_VN)
-                {
-                    vertex.normal = normals[_idx[i].vn - 1];
-                    vertex.uv = uvs[_idx[i].vt - 1];
-                }
+                _idx[i].material = currentMaterial;
+                model.indices.emplace_back(welder.vertex(_idx[i], vertices, normals, uvs, model.vertices));
             }
         }
         /* load material file (path in respect to .obj file) */
         else if(code == "mtllib")
         {
-            std::string file;
-            ss >> file;
-            materials = materialLoad( filepath.substr(0, filepath.find_last_of("\\/")) + "/" + file );
+            std::string_view file = token(line);
+            materials = materialLoad( filepath.substr(0, filepath.find_last_of("\\/")) + "/" + std::string(file) );
         }
         /* switch to material for next face definitions */
         else if(code == "usemtl")
         {
-            auto& model = models.back();
-            std::string name;
-            ss >> name;
+            auto& model = object();
+            std::string_view name = token(line);
 
             if(!model.material.empty())
             {
                 auto& material = model.material.back();
-                material.indexCount = glVertices.size() - material.indexOffset;
+                material.indexCount = model.indices.size() - material.indexOffset;
             }
 
-            auto& material = model.material.emplace_back( materials[name] );
-            material.indexOffset = glVertices.size();
+            /* unknown materials get a default material with its own id */
+            auto it = materials.find(name);
+            if(it == materials.end())
+            {
+                Material unknown{};
+                unknown.name = name;
+                unknown.id = static_cast<unsigned int>(materials.size());
+                it = materials.emplace(unknown.name, unknown).first;
+            }
+
+            auto& material = model.material.emplace_back(it->second);
+            material.indexOffset = model.indices.size();
+            currentMaterial = material.id;
         }
     }
 
     /* finnish up last object */
-    Model& model = models.back();
-    model.mesh = meshCreate(glVertices, glIndices, GL_STATIC_DRAW, GL_STATIC_DRAW);
-    if(!model.material.empty())
+    if(!models.empty() && !models.back().material.empty())
     {
-        auto& material = model.material.back();
-        material.indexCount = glVertices.size() - material.indexOffset;
+        auto& material = models.back().material.back();
+        material.indexCount = models.back().indices.size() - material.indexOffset;
     }
 
+    corners = welder.corners;
     return models;
+
 }
 
-std::vector<Vertex> verticesLoad(const std::string &filepath)
+/* chunks smaller than this are not worth a task of their own */
+const std::size_t minChunkBytes = 256 * 1024;
+
+/* splits the OBJ file into about four chunks per thread, in front of an "o" line if there is one near the intended
+ * size, otherwise at the next line break (huge objects then span several chunks) */
+std::vector<std::string_view> objSplit(std::string_view buffer, unsigned int threads)
 {
-    std::ifstream objFile(filepath);
-    if(!objFile.is_open())
+    std::size_t target = std::max(minChunkBytes, buffer.size() / (threads * 4) + 1);
+
+    std::vector<std::string_view> chunks;
+    std::size_t begin = 0;
+    while(begin < buffer.size())
     {
-        throw std::runtime_error("[Flag] Couldn't open OBJ file at " + filepath);
+        std::size_t end = begin + target;
+        if(end + minChunkBytes / 2 >= buffer.size())
+        {
+            end = buffer.size();
+        }
+        else
+        {
+            std::size_t object = buffer.substr(end - 1, target / 2).find("\no ");
+            std::size_t line = buffer.find('\n', end);
+            end = object != std::string_view::npos ? end + object : line == std::string_view::npos ? buffer.size() : line + 1;
+        }
+
+        chunks.push_back(buffer.substr(begin, end - begin));
+        begin = end;
     }
 
-    /* container for GL related stuff */
-    std::vector<Vertex> glVertices;
-    std::vector<unsigned int> glIndices;
+    return chunks;
+}
 
-    /* container for OBJ related stuff */
+/* command of an OBJ file that has to be applied in file order, corner is the number of face corners in front of it */
+struct ObjEvent
+{
+    enum eType
+    {
+        Object,
+        Material,
+        Library
+    };
+
+    eType type;
+    std::string_view name;
+    std::size_t corner;
+};
+
+/* everything a chunk of the OBJ file defines, face corners still refer to the file global v/vt/vn numbering */
+struct ObjChunk
+{
     std::vector<Vector3D> vertices;
     std::vector<Vector3D> normals;
     std::vector<Vector2D> uvs;
+    std::vector<Index> corners;
+    std::vector<ObjEvent> events;
+};
 
-    int modelCount = 0;
-
-    /* consume commonds from obj file */
-    std::string line;
-    while(std::getline(objFile, line))
+/* parses one chunk without touching any shared state, the number parsing is the same as in objParseSerial */
+void objParseChunk(std::string_view text, ObjChunk &chunk)
+{
+    Tokenizer tokenizer(text);
+    while(!tokenizer.empty())
     {
-        std::stringstream ss(line);
-
-        /* command code */
-        std::string code;
-        ss >> code;
+        std::string_view line = tokenizer.line();
+        std::string_view code = token(line);
 
-        if(code == "")
+        if(code == "v")
         {
-            continue;
+            auto& v = chunk.vertices.emplace_back();
+            line >> v.x >> v.y >> v.z;
         }
-        /* create new object */
-        else if(code == "o")
+        else if(code == "vt")
         {
-            if(modelCount > 1)
-            {
-                throw std::runtime_error("[Flag] More than one object not supported");
-            }
-            modelCount++;
+            auto& vt = chunk.uvs.emplace_back();
+            line >> vt.x >> vt.y;
         }
-        /* vertex postion */
-        else if(code == "v")
+        else if(code == "vn")
         {
-            auto& v = vertices.emplace_back();
-            ss >> v.x >> v.y >> v.z;
+            auto& vn = chunk.normals.emplace_back();
+            line >> vn.x >> vn.y >> vn.z;
         }
-        /* vertex texture coordinates */
-        else if(code == "vt")
+        else if(code == "f")
         {
-            auto& vt = uvs.emplace_back();
-            ss >> vt.x >> vt.y;
+            Index _idx[3];
+            line >> _idx[0] >> _idx[1] >> _idx[2];
+            chunk.corners.insert(chunk.corners.end(), _idx, _idx + 3);
         }
-        /* vertex normal */
-        else if(code == "vn")
+        else if(code == "o")
         {
-            auto& vn = normals.emplace_back();
-            ss >> vn.x >> vn.y >> vn.z;
+            chunk.events.push_back({ObjEvent::Object, token(line), chunk.corners.size()});
         }
-        /* face definition (currently only triangles) */
-        else if(code == "f")
+        else if(code == "usemtl")
+        {
+            chunk.events.push_back({ObjEvent::Material, token(line), chunk.corners.size()});
+        }
+        else if(code == "mtllib")
         {
-            detail::Index _idx[3];
-            ss >> _idx[0] >> _idx[1] >> _idx[2];
+            chunk.events.push_back({ObjEvent::Library, token(line), chunk.corners.size()});
+        }
+    }
+}
 
-            for(int i = 0; i < 3; i++)
+/* face corners of one object that lie in one chunk and share a material */
+struct ObjSegment
+{
+    const ObjChunk* chunk;
+    std::size_t begin;
+    std::size_t end;
+    unsigned int material;
+};
+
+/* parses the chunks concurrently, replays their object and material commands in file order and welds the objects
+ * concurrently, the result is identical to objParseSerial */
+std::vector<ModelData> objParseParallel(const std::vector<std::string_view> &texts, const std::string &filepath,
+                                        unsigned int threads, std::size_t &corners)
+{
+    std::vector<ObjChunk> chunks(texts.size());
+    jobsParallelFor(chunks.size(), [&](std::size_t i) { objParseChunk(texts[i], chunks[i]); }, threads);
+
+    /* file global attribute arrays in file order */
+    std::vector<Vector3D> vertices;
+    std::vector<Vector3D> normals;
+    std::vector<Vector2D> uvs;
+    for(const auto& chunk : chunks)
+    {
+        vertices.insert(vertices.end(), chunk.vertices.begin(), chunk.vertices.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        uvs.insert(uvs.end(), chunk.uvs.begin(), chunk.uvs.end());
+    }
+
+    /* objects and material ranges, the index count of an object equals the number of its face corners */
+    std::vector<ModelData> models;
+    std::vector<std::vector<ObjSegment>> segments;
+    std::vector<std::size_t> counts;
+
+    std::map<std::string, Material, std::less<>> materials;
+    unsigned int currentMaterial = 0;
+
+    auto finishMaterial = [&]()
+    {
+        if(!models.empty() && !models.back().material.empty())
+        {
+            auto& material = models.back().material.back();
+            material.indexCount = counts.back() - material.indexOffset;
+        }
+    };
+    auto openObject = [&](std::string_view name)
+    {
+        models.emplace_back().name = name;
+        segments.emplace_back();
+        counts.push_back(0);
+    };
+
+    for(const auto& chunk : chunks)
+    {
+        std::size_t pos = 0;
+        auto addSegment = [&](std::size_t end)
+        {
+            if(end > pos)
             {
-                glIndices.emplace_back(glVertices.size());
+                if(models.empty())
+                {
+                    openObject(implicitObjectName);
+                }
+                segments.back().push_back({&chunk, pos, end, currentMaterial});
+                counts.back() += end - pos;
+            }
+            pos = end;
+        };
 
-                Vertex& vertex = glVertices.emplace_back();
-                vertex.pos = vertices[_idx[i].v - 1];
+        for(const auto& event : chunk.events)
+        {
+            addSegment(event.corner);
 
-                if(_idx[i].type == detail::Index::V_VN)
+            if(event.type == ObjEvent::Object)
+            {
+                finishMaterial();
+                openObject(event.name);
+            }
+            else if(event.type == ObjEvent::Library)
+            {
+                materials = materialLoad( filepath.substr(0, filepath.find_last_of("\\/")) + "/" + std::string(event.name) );
+            }
+            else if(event.type == ObjEvent::Material)
+            {
+                if(models.empty())
                 {
-                    vertex.normal = normals[_idx[i].vn - 1];
+                    openObject(implicitObjectName);
                 }
-                else if(_idx[i].type == detail::Index::V_VT_VN)
+                finishMaterial();
+
+                /* unknown materials get a default material with its own id */
+                auto it = materials.find(event.name);
+                if(it == materials.end())
                 {
-                    vertex.normal = normals[_idx[i].vn - 1];
-                    vertex.uv = uvs[_idx[i].vt - 1];
+                    Material unknown{};
+                    unknown.name = event.name;
+                    unknown.id = static_cast<unsigned int>(materials.size());
+                    it = materials.emplace(unknown.name, unknown).first;
                 }
+
+                auto& material = models.back().material.emplace_back(it->second);
+                material.indexOffset = counts.back();
+                currentMaterial = material.id;
+            }
+        }
+        addSegment(chunk.corners.size());
+    }
+    finishMaterial();
+
+    /* vertex welding per object, a single huge object is welded by one thread */
+    std::vector<std::size_t> welderCorners(models.size());
+    jobsParallelFor(models.size(), [&](std::size_t m)
+    {
+        ModelData& model = models[m];
+        model.indices.reserve(counts[m]);
+
+        Welder welder;
+        for(const auto& segment : segments[m])
+        {
+            for(std::size_t c = segment.begin; c < segment.end; c++)
+            {
+                Index index = segment.chunk->corners[c];
+                index.material = segment.material;
+                model.indices.emplace_back(welder.vertex(index, vertices, normals, uvs, model.vertices));
             }
         }
+        welderCorners[m] = welder.corners;
+    }, threads);
+
+    corners = 0;
+    for(std::size_t c : welderCorners)
+    {
+        corners += c;
+    }
+
+    return models;
+}
+
+}
+
+std::vector<ModelData> modelParse(const std::string &filepath, unsigned int threads)
+{
+    auto start = std::chrono::steady_clock::now();
+    const std::string buffer = detail::fileRead(filepath, "[Model]");
+
+    threads = threads == 0 ? jobsThreads() : threads;
+    std::vector<std::string_view> chunks = threads > 1 ? detail::objSplit(buffer, threads) : std::vector<std::string_view>();
+
+    std::size_t corners = 0;
+    std::vector<ModelData> models = chunks.size() > 1 ? detail::objParseParallel(chunks, filepath, threads, corners)
+                                                      : detail::objParseSerial(buffer, filepath, corners);
+
+    std::size_t welded = 0;
+    for(const auto& model : models)
+    {
+        welded += model.vertices.size();
+    }
+
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "[Model] Parsed " << filepath << " (" << models.size() << " objects) in " << duration.count() << " ms";
+    if(chunks.size() > 1)
+    {
+        std::cout << " (" << chunks.size() << " chunks on " << threads << " threads)";
+    }
+    std::cout << ", welded " << corners << " -> " << welded << " vertices, "
+              << (corners - welded) * sizeof(Vertex) / 1024 << " KiB VBO saved" << std::endl;
+
+    return models;
+}
+
+std::vector<ModelData> modelPrepare(const std::string &filepath, const ModelOptions &options)
+{
+    std::vector<ModelData> data = modelParse(filepath);
+
+    if(options.instancing)
+    {
+        modelFindInstances(data, filepath);
+    }
+
+    if(options.optimize)
+    {
+        modelOptimize(data, filepath);
+    }
+
+    return data;
+}
+
+std::vector<ModelBlob> modelEncode(const std::vector<ModelData> &data, eVertexFormat format, std::vector<std::vector<uint8_t>> &storage)
+{
+    std::vector<ModelBlob> blobs;
+    blobs.reserve(data.size());
+
+    for(const auto& d : data)
+    {
+        /* moving the vectors on reallocation of the storage keeps the data the blobs point to */
+        storage.resize(storage.size() + 2);
+        std::vector<uint8_t>& vertexData = storage[storage.size() - 2];
+        std::vector<uint8_t>& indexData = storage[storage.size() - 1];
+
+        ModelBlob& blob = blobs.emplace_back();
+        blob.name = d.name;
+        blob.layout = meshEncode(d.vertices, d.indices, format, vertexData, indexData);
+        blob.material = d.material;
+        blob.instances = d.instances;
+        blob.vertexData = vertexData.data();
+        blob.indexData = indexData.data();
     }
 
-    return glVertices;
+    return blobs;
+}
+
+std::vector<ModelData> modelDecode(const std::vector<ModelBlob> &blobs)
+{
+    std::vector<ModelData> data;
+    data.reserve(blobs.size());
+
+    for(const auto& blob : blobs)
+    {
+        ModelData& d = data.emplace_back();
+        d.name = blob.name;
+        meshDecode(blob.layout, blob.vertexData, blob.indexData, d.vertices, d.indices);
+        d.material = blob.material;
+        d.instances = blob.instances;
+    }
+
+    return data;
+}
+
+std::vector<Model> modelUpload(const std::vector<ModelData> &data, eVertexFormat format)
+{
+    std::vector<std::vector<uint8_t>> storage;
+    return modelUpload(modelEncode(data, format, storage));
+}
+
+std::vector<Model> modelUpload(const std::vector<ModelBlob> &blobs)
+{
+    std::vector<Model> models;
+    models.reserve(blobs.size());
+
+    std::size_t vertexBytes = 0;
+    std::size_t indexBytes = 0;
+
+    /* material table of the OBJ file, indexed by the material of the vertices */
+    std::vector<Material> materials;
+    for(const auto& blob : blobs)
+    {
+        for(const auto& material : blob.material)
+        {
+            if(material.id >= materials.size())
+            {
+                materials.resize(material.id + 1, Material{});
+            }
+            materials[material.id] = material;
+        }
+    }
+    unsigned int materialBase = detail::materialTableAdd(materials, blobs.size());
+
+    for(const auto& blob : blobs)
+    {
+        Model& model = models.emplace_back();
+        model.mesh = meshCreate(blob.layout, blob.vertexData, blob.indexData);
+        model.name = blob.name;
+        model.material = blob.material;
+        model.materialBase = materialBase;
+        model.materialCount = static_cast<unsigned int>(materials.size());
+        model.instanceOffset = detail::instanceTableAdd(blob.instances);
+        model.instanceCount = static_cast<unsigned int>(std::max<std::size_t>(blob.instances.size(), 1));
+
+        vertexBytes += meshVertexBytes(model.mesh);
+        indexBytes += meshIndexBytes(model.mesh);
+    }
+
+    std::cout << "[Model] Uploaded " << models.size() << " objects, " << vertexBytes / 1024 << " KiB vertex and "
+              << indexBytes / 1024 << " KiB index data, " << materials.size() << " materials" << std::endl;
+
+    return models;
+}
+
+ModelSource modelFetch(const std::string &filepath, const ModelOptions &options)
+{
+    ModelSource source;
+    if(packFind(filepath, options, source.blobs))
+    {
+        return source;
+    }
+
+    source.blobs = modelEncode(modelPrepare(filepath, options), options.format, source.storage);
+    packAdd(filepath, options, source.blobs);
+
+    return source;
+}
+
+std::vector<Model> modelLoad(const std::string &filepath, const ModelOptions &options)
+{
+    return modelUpload(modelFetch(filepath, options).blobs);
+}
+
+std::vector<Model> modelLoad(const std::string &filepath, const ModelOptions &options, std::vector<ModelData> &data)
+{
+    ModelSource source = modelFetch(filepath, options);
+    data = modelDecode(source.blobs);
+    return modelUpload(source.blobs);
+}
+
+void modelLoadAsync(const std::string &filepath, const ModelOptions &options, std::function<void(std::vector<Model>)> done)
+{
+    jobsEnqueue([filepath, options, done]()
+    {
+        /* moving the source keeps the storage buffers the blobs point to */
+        auto source = std::make_shared<ModelSource>();
+        std::exception_ptr error;
+        try
+        {
+            *source = modelFetch(filepath, options);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+
+        jobsComplete([source, error, done]()
+        {
+            if(error)
+            {
+                std::rethrow_exception(error);
+            }
+            done(modelUpload(source->blobs));
+        });
+    });
+}
+
+void modelLoadAsync(const std::string &filepath, const ModelOptions &options, std::function<void(std::vector<Model>, std::vector<ModelData>)> done)
+{
+    jobsEnqueue([filepath, options, done]()
+    {
+        /* moving the source keeps the storage buffers the blobs point to */
+        auto source = std::make_shared<ModelSource>();
+        auto data = std::make_shared<std::vector<ModelData>>();
+        std::exception_ptr error;
+        try
+        {
+            *source = modelFetch(filepath, options);
+            *data = modelDecode(source->blobs);
+        }
+        catch(...)
+        {
+            error = std::current_exception();
+        }
+
+        jobsComplete([source, data, error, done]()
+        {
+            if(error)
+            {
+                std::rethrow_exception(error);
+            }
+            done(modelUpload(source->blobs), std::move(*data));
+        });
+    });
 }
 
 void modelDelete(std::vector<Model> &models)
 {
     for(auto& m : models)
     {
-        meshDelete(m.mesh);
+        modelDelete(m);
+    }
+
+    /* give the freed ranges back as one block */
+    if(!models.empty())
+    {
+        meshArenaCompact(models.front().mesh.format);
     }
 }
 
 void modelDelete(Model &model)
 {
     meshDelete(model.mesh);
+    detail::materialTableRelease(model.materialBase, model.materialCount);
+    detail::instanceTableRelease(model.instanceOffset, model.instanceCount);
+}
+
+void modelDraw(const Model &model)
+{
+    auto& ranges = detail::sDrawRanges;
+    ranges.counts.clear();
+    ranges.offsets.clear();
+    ranges.baseVertices.clear();
+
+    /* neighbouring material ranges are merged, the material is read from the vertices anyway */
+    GLint baseVertex = meshBaseVertex(model.mesh);
+    unsigned int end = 0;
+    for(const auto& material : model.material)
+    {
+        if(material.indexCount == 0)
+        {
+            continue;
+        }
+        statsFrame().drawRanges += model.instanceCount;
+
+        if(!ranges.counts.empty() && material.indexOffset == end)
+        {
+            ranges.counts.back() += material.indexCount;
+        }
+        else
+        {
+            ranges.counts.push_back(material.indexCount);
+            ranges.offsets.push_back(meshIndexOffset(model.mesh, material.indexOffset));
+            ranges.baseVertices.push_back(baseVertex);
+        }
+        end = material.indexOffset + material.indexCount;
+    }
+
+    if(ranges.counts.empty())
+    {
+        return;
+    }
+    statsFrame().instances += model.instanceCount;
+
+    if(model.instanceCount > 1)
+    {
+        /* there is no instanced multi-draw, but the ranges of a model are usually merged into one */
+        for(std::size_t i = 0; i < ranges.counts.size(); i++)
+        {
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, ranges.counts[i], model.mesh.indexType, ranges.offsets[i],
+                                              static_cast<GLsizei>(model.instanceCount), ranges.baseVertices[i]);
+            statsFrame().drawCalls++;
+        }
+        return;
+    }
+
+    glMultiDrawElementsBaseVertex(GL_TRIANGLES, ranges.counts.data(), model.mesh.indexType, ranges.offsets.data(),
+                                  static_cast<GLsizei>(ranges.counts.size()), ranges.baseVertices.data());
+    statsFrame().drawCalls++;
+}
+
+void materialTableDelete()
+{
+    glDeleteBuffers(1, &detail::sMaterialTable.ubo);
+    detail::sMaterialTable.ubo = 0;
+    detail::sMaterialTable.entries = FreeList();
+    detail::sMaterialTable.models.clear();
+}
+
+void instanceTableDelete()
+{
+    glDeleteBuffers(1, &detail::sInstanceTable.buffer);
+    glDeleteTextures(1, &detail::sInstanceTable.texture);
+    detail::sInstanceTable.buffer = 0;
+    detail::sInstanceTable.texture = 0;
+    detail::sInstanceTable.instances = FreeList();
+    detail::sInstanceTable.uploaded = 0;
+    detail::sInstanceTable.rows.clear();
 }
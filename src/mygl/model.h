@@ -2,6 +2,8 @@
 
 #include "mesh.h"
 
+#include <functional>
+
 struct Material
 {
     std::string name;
@@ -12,6 +14,9 @@ struct Material
     Vector3D specular;
     float shininess;
 
+    /* position in the material file, the per vertex material index refers to it */
+    unsigned int id = 0;
+
     unsigned int indexOffset;
     unsigned int indexCount;
 };
@@ -21,9 +26,160 @@ struct Model
     Mesh mesh;
     std::string name;
     std::vector<Material> material;
+
+    /* first entry of the materials of the OBJ file in the material table, shaders read uMaterials[uMaterialBase + aMaterial] */
+    unsigned int materialBase = 0;
+
+    /* materials of the OBJ file in the material table, they are freed when the last model of the file is deleted */
+    unsigned int materialCount = 0;
+
+    /* transformations of the instances in the instance table, entry 0 of the table is the identity */
+    unsigned int instanceOffset = 0;
+    unsigned int instanceCount = 1;
 };
 
-std::vector<Model> modelLoad(const std::string &filepath);
-std::vector<Vertex> verticesLoad(const std::string &filepath);
+/* cpu side geometry of one object, before it gets uploaded with meshCreate */
+struct ModelData
+{
+    std::string name;
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    std::vector<Material> material;
+
+    /* transformations of the copies of this object (see modelFindInstances), empty if it is not instanced */
+    std::vector<Matrix4D> instances;
+};
+
+/* gpu ready data of one object (see meshEncode), the vertex and index data is owned by the caller (e.g. the mapped asset pack) */
+struct ModelBlob
+{
+    std::string name;
+    Mesh layout;
+    std::vector<Material> material;
+    std::vector<Matrix4D> instances;
+
+    const void* vertexData = nullptr;
+    const void* indexData = nullptr;
+};
+
+/* processing of an OBJ file between parsing and upload, part of the key of an asset pack entry */
+struct ModelOptions
+{
+    bool optimize = true;                           // vertex cache optimization (see modelOptimize)
+    bool instancing = false;                        // merge copies into instances (see modelFindInstances)
+    eVertexFormat format = eVertexFormat::PACKED;   // vertex layout of the meshes (see meshCreate)
+};
+
+/* cpu side result of modelFetch, the blobs point into the storage or into the mapped asset pack */
+struct ModelSource
+{
+    std::vector<ModelBlob> blobs;
+    std::vector<std::vector<uint8_t>> storage;
+};
+
+/**
+ * @brief Parses all objects of an OBJ file (and its material file) into indexed cpu side meshes, no OpenGL calls are made.
+ * Larger files are split into chunks that are parsed on the job system (see jobsParallelFor), the result is identical
+ * to the one of the serial parser. Faces and materials in front of the first object (or in a file without objects)
+ * belong to an implicit object named "default".
+ *
+ * @param filepath Path of the OBJ file.
+ * @param threads Maximal number of threads, 0 uses all threads of the job system and 1 the serial parser.
+ */
+std::vector<ModelData> modelParse(const std::string &filepath, unsigned int threads = 0);
+
+/**
+ * @brief Parses an OBJ file and runs the processing steps of the options on it, no OpenGL calls are made.
+ */
+std::vector<ModelData> modelPrepare(const std::string &filepath, const ModelOptions &options);
+
+/**
+ * @brief Encodes the objects into the vertex format (see meshEncode), no OpenGL calls are made.
+ *
+ * @param data Parsed objects.
+ * @param format Vertex layout of the encoded meshes.
+ * @param storage Receives the encoded data the blobs point to.
+ */
+std::vector<ModelBlob> modelEncode(const std::vector<ModelData> &data, eVertexFormat format, std::vector<std::vector<uint8_t>> &storage);
+
+/**
+ * @brief Decodes encoded FLOAT objects back into cpu side objects (see meshDecode), no OpenGL calls are made.
+ */
+std::vector<ModelData> modelDecode(const std::vector<ModelBlob> &blobs);
+
+/**
+ * @brief Creates the OpenGL meshes for the given parsed objects and appends their materials to the material table, a
+ * uniform buffer bound to the "Materials" block of all shader programs (see eUniformBlock). Instance transformations are
+ * appended to the instance table, a buffer texture bound to "uInstances" (see eTextureUnit).
+ *
+ * @param data Parsed objects.
+ * @param format Vertex layout of the created meshes (see meshCreate).
+ */
+std::vector<Model> modelUpload(const std::vector<ModelData> &data, eVertexFormat format = eVertexFormat::PACKED);
+
+/**
+ * @brief Creates the OpenGL meshes for already encoded objects, the data is copied as is (see modelUpload).
+ */
+std::vector<Model> modelUpload(const std::vector<ModelBlob> &blobs);
+
+/**
+ * @brief Takes the encoded objects of an OBJ file from the open asset pack (see packOpen). If the pack has no up to date
+ * entry for the file and options, the OBJ file is parsed, processed (see modelPrepare) and added to the pack. No OpenGL
+ * calls are made, so it can run on the job system.
+ */
+ModelSource modelFetch(const std::string &filepath, const ModelOptions &options = ModelOptions());
+
+/**
+ * @brief Loads the objects of an OBJ file (see modelFetch) and uploads them.
+ */
+std::vector<Model> modelLoad(const std::string &filepath, const ModelOptions &options = ModelOptions());
+
+/**
+ * @brief Loads the objects of an OBJ file like modelLoad and keeps a cpu side copy of their vertices and indices,
+ * decoded from the fetched data (see modelDecode). Only for the FLOAT vertex format.
+ *
+ * @param data Receives the cpu side objects, in the order of the returned models.
+ */
+std::vector<Model> modelLoad(const std::string &filepath, const ModelOptions &options, std::vector<ModelData> &data);
+
+/**
+ * @brief Fetches the objects of an OBJ file on the job system (see modelFetch) and hands the upload to the main thread.
+ * The upload and the call of done happen in jobsPoll, exceptions of the fetch are passed on there as well.
+ *
+ * @param filepath Path of the OBJ file.
+ * @param options Processing of the objects.
+ * @param done Receives the uploaded models.
+ */
+void modelLoadAsync(const std::string &filepath, const ModelOptions &options, std::function<void(std::vector<Model>)> done);
+
+/**
+ * @brief Loads the objects of an OBJ file like modelLoadAsync, done receives the cpu side objects as well. They are
+ * decoded on the job system (see modelDecode). Only for the FLOAT vertex format.
+ */
+void modelLoadAsync(const std::string &filepath, const ModelOptions &options,
+                    std::function<void(std::vector<Model>, std::vector<ModelData>)> done);
+
+/**
+ * @brief Deletes the meshes of the models, frees their instance transformations and their materials in the material
+ * table once all models of their OBJ file are deleted. The vector overload compacts the mesh arena afterwards (see meshArenaCompact).
+ */
 void modelDelete(std::vector<Model>& models);
 void modelDelete(Model& model);
+
+/**
+ * @brief Draws all material ranges of a model with a single glMultiDrawElementsBaseVertex call, instanced models with
+ * glDrawElementsInstancedBaseVertex. The vertex array of the mesh format has to be bound, the material of each vertex
+ * is looked up in the material table and the instance transformation (uInstanceOffset + gl_InstanceID) in the instance
+ * table by the shader.
+ */
+void modelDraw(const Model& model);
+
+/**
+ * @brief Deletes the uniform buffer of the material table. Has to be called after all models got deleted.
+ */
+void materialTableDelete();
+
+/**
+ * @brief Deletes the buffer texture of the instance table. Has to be called after all models got deleted.
+ */
+void instanceTableDelete();
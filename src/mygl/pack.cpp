@@ -0,0 +1,561 @@
+#include "pack.h"
+
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <type_traits>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace detail
+{
+
+/* "A4PK", followed by the version and the size of the vertex layouts the blobs were encoded with */
+const uint32_t packMagic = 0x4B503441u;
+const uint32_t packVersion = 1;
+
+struct Mapping
+{
+    const uint8_t* data = nullptr;
+    std::size_t size = 0;
+
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#endif
+};
+
+bool mapFile(const std::string &path, Mapping &mapping)
+{
+#ifdef _WIN32
+    mapping.file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if(mapping.file == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(mapping.file, &size);
+    mapping.size = static_cast<std::size_t>(size.QuadPart);
+    mapping.mapping = mapping.size ? CreateFileMappingA(mapping.file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    if(!mapping.mapping)
+    {
+        CloseHandle(mapping.file);
+        mapping = Mapping();
+        return false;
+    }
+    mapping.data = static_cast<const uint8_t*>(MapViewOfFile(mapping.mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+    {
+        return false;
+    }
+
+    struct stat info;
+    void* data = MAP_FAILED;
+    if(fstat(fd, &info) == 0 && info.st_size > 0)
+    {
+        mapping.size = static_cast<std::size_t>(info.st_size);
+        data = mmap(nullptr, mapping.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    /* the mapping stays valid after closing the file */
+    close(fd);
+
+    if(data == MAP_FAILED)
+    {
+        mapping = Mapping();
+        return false;
+    }
+    mapping.data = static_cast<const uint8_t*>(data);
+#endif
+
+    return mapping.data != nullptr;
+}
+
+void unmapFile(Mapping &mapping)
+{
+#ifdef _WIN32
+    if(mapping.data)
+    {
+        UnmapViewOfFile(mapping.data);
+    }
+    if(mapping.mapping)
+    {
+        CloseHandle(mapping.mapping);
+    }
+    if(mapping.file != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mapping.file);
+    }
+#else
+    if(mapping.data)
+    {
+        munmap(const_cast<uint8_t*>(mapping.data), mapping.size);
+    }
+#endif
+    mapping = Mapping();
+}
+
+struct Writer
+{
+    std::vector<uint8_t> bytes;
+
+    template<typename T>
+    void put(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain data can be written");
+        putBytes(&value, sizeof(T));
+    }
+
+    void putBytes(const void *data, std::size_t size)
+    {
+        const uint8_t* begin = static_cast<const uint8_t*>(data);
+        bytes.insert(bytes.end(), begin, begin + size);
+    }
+
+    void putString(const std::string &value)
+    {
+        put(static_cast<uint32_t>(value.size()));
+        putBytes(value.data(), value.size());
+    }
+};
+
+struct Reader
+{
+    const uint8_t* pos;
+    const uint8_t* end;
+
+    const uint8_t* getBytes(std::size_t size)
+    {
+        if(static_cast<std::size_t>(end - pos) < size)
+        {
+            throw std::runtime_error("[Pack] Unexpected end of pack");
+        }
+
+        const uint8_t* data = pos;
+        pos += size;
+        return data;
+    }
+
+    template<typename T>
+    T get()
+    {
+        T value;
+        std::memcpy(&value, getBytes(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    std::string getString()
+    {
+        uint32_t size = get<uint32_t>();
+        const uint8_t* data = getBytes(size);
+        return std::string(reinterpret_cast<const char*>(data), size);
+    }
+};
+
+/* FNV-1a hash of a whole file, 0 if it can't be read */
+uint64_t fileHash(const std::string &path, std::string *content = nullptr)
+{
+    std::ifstream file(path, std::ios::binary);
+    if(!file.is_open())
+    {
+        return 0;
+    }
+
+    std::string buffer((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : buffer)
+    {
+        h = (h ^ c) * 1099511628211ull;
+    }
+
+    if(content)
+    {
+        content->swap(buffer);
+    }
+    return h;
+}
+
+/* path of the material file referenced by an OBJ file (resolved like modelParse does) */
+std::string materialPath(const std::string &filepath, const std::string &content)
+{
+    std::size_t pos = 0;
+    while(pos < content.size())
+    {
+        std::size_t end = content.find('\n', pos);
+        end = end == std::string::npos ? content.size() : end;
+
+        if(content.compare(pos, 7, "mtllib ") == 0)
+        {
+            std::size_t start = content.find_first_not_of(" \t", pos + 7);
+            std::size_t stop = content.find_last_not_of(" \t\r", end - 1);
+            if(start != std::string::npos && stop != std::string::npos && stop >= start && stop < end)
+            {
+                return filepath.substr(0, filepath.find_last_of("\\/")) + "/" + content.substr(start, stop - start + 1);
+            }
+        }
+        pos = end + 1;
+    }
+
+    return std::string();
+}
+
+bool sameOptions(const ModelOptions &a, const ModelOptions &b)
+{
+    return a.optimize == b.optimize && a.instancing == b.instancing && a.format == b.format;
+}
+
+/* one OBJ file, data is the entry without the size prefix (mapped or added) */
+struct Entry
+{
+    std::string path;
+    ModelOptions options;
+
+    const uint8_t* data = nullptr;
+    std::size_t size = 0;
+
+    /* used entries are kept when the pack is written again */
+    bool used = false;
+    std::vector<uint8_t> added;
+};
+
+void readEntryKey(Reader &reader, Entry &entry)
+{
+    entry.path = reader.getString();
+    entry.options.optimize = reader.get<uint8_t>() != 0;
+    entry.options.instancing = reader.get<uint8_t>() != 0;
+    entry.options.format = static_cast<eVertexFormat>(reader.get<uint32_t>());
+}
+
+/* packFind and packAdd are called by the loading jobs, the mutex guards the entries and counters (the mapped data is
+ * only read) */
+struct
+{
+    std::string path;
+    Mapping mapping;
+    std::vector<Entry> entries;
+    PackStats stats;
+    bool dirty = false;
+    std::mutex mutex;
+} sPack;
+
+/* counts a lookup, on a hit the entry is kept when the pack is written again */
+void packCount(std::size_t entry, bool hit)
+{
+    std::lock_guard<std::mutex> lock(sPack.mutex);
+    if(hit)
+    {
+        sPack.entries[entry].used = true;
+        sPack.stats.hits++;
+    }
+    else
+    {
+        sPack.stats.misses++;
+    }
+}
+
+}
+
+void packOpen(const std::string &path)
+{
+    using namespace detail;
+
+    packClose();
+    sPack.path = path;
+    sPack.stats = PackStats();
+
+    if(!mapFile(path, sPack.mapping))
+    {
+        std::cout << "[Pack] No asset pack at " << path << ", it gets written after loading" << std::endl;
+        sPack.dirty = true;
+        return;
+    }
+
+    try
+    {
+        Reader reader{sPack.mapping.data, sPack.mapping.data + sPack.mapping.size};
+        if(reader.get<uint32_t>() != packMagic || reader.get<uint32_t>() != packVersion
+           || reader.get<uint32_t>() != sizeof(Vertex) || reader.get<uint32_t>() != sizeof(PackedVertex))
+        {
+            throw std::runtime_error("[Pack] Version of " + path + " is outdated");
+        }
+
+        uint32_t count = reader.get<uint32_t>();
+        for(uint32_t i = 0; i < count; i++)
+        {
+            Entry entry;
+            entry.size = static_cast<std::size_t>(reader.get<uint64_t>());
+            entry.data = reader.getBytes(entry.size);
+
+            Reader key{entry.data, entry.data + entry.size};
+            readEntryKey(key, entry);
+            sPack.entries.push_back(std::move(entry));
+        }
+    }
+    catch(const std::runtime_error &error)
+    {
+        std::cout << error.what() << ", it gets written again after loading" << std::endl;
+        sPack.entries.clear();
+        sPack.dirty = true;
+        return;
+    }
+
+    std::cout << "[Pack] Mapped " << path << " (" << sPack.entries.size() << " entries, " << sPack.mapping.size / 1024
+              << " KiB)" << std::endl;
+}
+
+bool packFind(const std::string &filepath, const ModelOptions &options, std::vector<ModelBlob> &blobs)
+{
+    using namespace detail;
+
+    auto start = std::chrono::steady_clock::now();
+
+    /* the entries only grow while the pack is open, so the index stays valid without the lock */
+    std::size_t index = 0;
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock(sPack.mutex);
+        for(std::size_t i = 0; i < sPack.entries.size(); i++)
+        {
+            const Entry& e = sPack.entries[i];
+            if(e.data && e.path == filepath && sameOptions(e.options, options))
+            {
+                index = i;
+                entry.data = e.data;
+                entry.size = e.size;
+            }
+        }
+        if(!entry.data)
+        {
+            sPack.stats.misses++;
+            return false;
+        }
+    }
+
+    try
+    {
+        Reader reader{entry.data, entry.data + entry.size};
+        readEntryKey(reader, entry);
+
+        std::string materialFile = reader.getString();
+        uint64_t objHash = reader.get<uint64_t>();
+        uint64_t mtlHash = reader.get<uint64_t>();
+        if(fileHash(filepath) != objHash || (!materialFile.empty() && fileHash(materialFile) != mtlHash))
+        {
+            std::cout << "[Pack] " << filepath << " changed since the pack was written, parsing it again" << std::endl;
+            packCount(index, false);
+            return false;
+        }
+
+        uint32_t objectCount = reader.get<uint32_t>();
+        blobs.clear();
+        blobs.resize(objectCount);
+        for(auto& blob : blobs)
+        {
+            blob.name = reader.getString();
+
+            blob.layout.format = static_cast<eVertexFormat>(reader.get<uint32_t>());
+            blob.layout.indexType = reader.get<uint32_t>();
+            blob.layout.size_vbo = reader.get<uint32_t>();
+            blob.layout.size_ibo = reader.get<uint32_t>();
+            blob.layout.posScale = reader.get<Vector3D>();
+            blob.layout.posOffset = reader.get<Vector3D>();
+
+            blob.material.resize(reader.get<uint32_t>());
+            for(auto& material : blob.material)
+            {
+                material.name = reader.getString();
+                material.emission = reader.get<Vector3D>();
+                material.ambient = reader.get<Vector3D>();
+                material.diffuse = reader.get<Vector3D>();
+                material.specular = reader.get<Vector3D>();
+                material.shininess = reader.get<float>();
+                material.id = reader.get<uint32_t>();
+                material.indexOffset = reader.get<uint32_t>();
+                material.indexCount = reader.get<uint32_t>();
+            }
+
+            blob.instances.resize(reader.get<uint32_t>());
+            for(auto& instance : blob.instances)
+            {
+                instance = reader.get<Matrix4D>();
+            }
+
+            blob.vertexData = reader.getBytes(meshVertexBytes(blob.layout));
+            blob.indexData = reader.getBytes(meshIndexBytes(blob.layout));
+        }
+    }
+    catch(const std::runtime_error &error)
+    {
+        std::cout << error.what() << " in entry of " << filepath << ", parsing it again" << std::endl;
+        packCount(index, false);
+        return false;
+    }
+
+    packCount(index, true);
+
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "[Pack] Found " << filepath << " (" << blobs.size() << " objects) in " << duration.count() << " ms" << std::endl;
+
+    return true;
+}
+
+void packAdd(const std::string &filepath, const ModelOptions &options, const std::vector<ModelBlob> &blobs)
+{
+    using namespace detail;
+
+    {
+        std::lock_guard<std::mutex> lock(sPack.mutex);
+        if(sPack.path.empty())
+        {
+            return;
+        }
+    }
+
+    std::string content;
+    uint64_t objHash = fileHash(filepath, &content);
+    std::string materialFile = materialPath(filepath, content);
+    uint64_t mtlHash = materialFile.empty() ? 0 : fileHash(materialFile);
+
+    Writer writer;
+    writer.putString(filepath);
+    writer.put(static_cast<uint8_t>(options.optimize));
+    writer.put(static_cast<uint8_t>(options.instancing));
+    writer.put(static_cast<uint32_t>(options.format));
+    writer.putString(materialFile);
+    writer.put(objHash);
+    writer.put(mtlHash);
+
+    writer.put(static_cast<uint32_t>(blobs.size()));
+    for(const auto& blob : blobs)
+    {
+        writer.putString(blob.name);
+
+        writer.put(static_cast<uint32_t>(blob.layout.format));
+        writer.put(static_cast<uint32_t>(blob.layout.indexType));
+        writer.put(static_cast<uint32_t>(blob.layout.size_vbo));
+        writer.put(static_cast<uint32_t>(blob.layout.size_ibo));
+        writer.put(blob.layout.posScale);
+        writer.put(blob.layout.posOffset);
+
+        writer.put(static_cast<uint32_t>(blob.material.size()));
+        for(const auto& material : blob.material)
+        {
+            writer.putString(material.name);
+            writer.put(material.emission);
+            writer.put(material.ambient);
+            writer.put(material.diffuse);
+            writer.put(material.specular);
+            writer.put(material.shininess);
+            writer.put(static_cast<uint32_t>(material.id));
+            writer.put(static_cast<uint32_t>(material.indexOffset));
+            writer.put(static_cast<uint32_t>(material.indexCount));
+        }
+
+        writer.put(static_cast<uint32_t>(blob.instances.size()));
+        for(const auto& instance : blob.instances)
+        {
+            writer.put(instance);
+        }
+
+        writer.putBytes(blob.vertexData, meshVertexBytes(blob.layout));
+        writer.putBytes(blob.indexData, meshIndexBytes(blob.layout));
+    }
+
+    /* replace an outdated entry of the same file and options */
+    std::lock_guard<std::mutex> lock(sPack.mutex);
+    for(auto& e : sPack.entries)
+    {
+        if(e.path == filepath && sameOptions(e.options, options))
+        {
+            e.data = nullptr;
+            e.used = false;
+        }
+    }
+
+    Entry& entry = sPack.entries.emplace_back();
+    entry.path = filepath;
+    entry.options = options;
+    entry.added.swap(writer.bytes);
+    entry.used = true;
+    sPack.dirty = true;
+}
+
+void packClose()
+{
+    using namespace detail;
+
+    if(!sPack.path.empty() && sPack.dirty)
+    {
+        Writer writer;
+        writer.put(packMagic);
+        writer.put(packVersion);
+        writer.put(static_cast<uint32_t>(sizeof(Vertex)));
+        writer.put(static_cast<uint32_t>(sizeof(PackedVertex)));
+
+        uint32_t count = 0;
+        for(const auto& entry : sPack.entries)
+        {
+            count += entry.used ? 1 : 0;
+        }
+        writer.put(count);
+
+        for(const auto& entry : sPack.entries)
+        {
+            if(!entry.used)
+            {
+                continue;
+            }
+
+            const uint8_t* data = entry.added.empty() ? entry.data : entry.added.data();
+            std::size_t size = entry.added.empty() ? entry.size : entry.added.size();
+            writer.put(static_cast<uint64_t>(size));
+            writer.putBytes(data, size);
+        }
+
+        /* the old pack may still be mapped, write a new file and replace it afterwards */
+        unmapFile(sPack.mapping);
+
+        std::string temporary = sPack.path + ".tmp";
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(writer.bytes.data()), static_cast<std::streamsize>(writer.bytes.size()));
+        file.close();
+
+        std::error_code error;
+        std::filesystem::rename(temporary, sPack.path, error);
+        if(!file || error)
+        {
+            std::cerr << "[Pack] Couldn't write asset pack " << sPack.path << std::endl;
+        }
+        else
+        {
+            std::cout << "[Pack] Wrote " << sPack.path << " (" << count << " entries, " << writer.bytes.size() / 1024
+                      << " KiB)" << std::endl;
+        }
+    }
+
+    unmapFile(sPack.mapping);
+    sPack.path.clear();
+    sPack.entries.clear();
+    sPack.dirty = false;
+}
+
+PackStats packStats()
+{
+    std::lock_guard<std::mutex> lock(detail::sPack.mutex);
+    return detail::sPack.stats;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "model.h"
+
+/* number of OBJ files taken from the pack and parsed since packOpen */
+struct PackStats
+{
+    unsigned int hits = 0;
+    unsigned int misses = 0;
+};
+
+/**
+ * @brief Maps the asset pack at the given path. An asset pack holds the encoded objects (see modelEncode) of OBJ files,
+ * keyed by path and ModelOptions, so that modelLoad can upload them without parsing. A missing, outdated or corrupt
+ * pack is ignored and written again by packClose. packFind and packAdd can be called from the job system while the
+ * pack is open.
+ *
+ * @param path Path of the pack file (written by the assignment_04_bake tool or by packClose).
+ */
+void packOpen(const std::string& path);
+
+/**
+ * @brief Looks up the entry of an OBJ file. The entry is only used if the OBJ and MTL file still have the hashes they
+ * had when the entry was written.
+ *
+ * @param filepath Path of the OBJ file.
+ * @param options Processing the entry has to be created with.
+ * @param blobs Receives the objects, their data points into the mapped pack and stays valid until packClose.
+ *
+ * @return True if the pack has an up to date entry.
+ */
+bool packFind(const std::string& filepath, const ModelOptions& options, std::vector<ModelBlob>& blobs);
+
+/**
+ * @brief Adds (or replaces) the entry of an OBJ file, the data is copied. Nothing happens if no pack is open.
+ */
+void packAdd(const std::string& filepath, const ModelOptions& options, const std::vector<ModelBlob>& blobs);
+
+/**
+ * @brief Writes the pack again if entries were added (together with the entries that were used) and unmaps it. Has to
+ * be called after all models that were found in the pack got uploaded.
+ */
+void packClose();
+
+/**
+ * @brief Hits and misses of packFind since packOpen.
+ */
+PackStats packStats();
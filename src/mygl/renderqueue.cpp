@@ -0,0 +1,231 @@
+#include "renderqueue.h"
+#include "drawdata.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace detail
+{
+
+constexpr ShaderUniformHandle posScale = shaderUniformHandle("uPosScale");
+constexpr ShaderUniformHandle posOffset = shaderUniformHandle("uPosOffset");
+constexpr ShaderUniformHandle instanceOffset = shaderUniformHandle("uInstanceOffset");
+constexpr ShaderUniformHandle materialBase = shaderUniformHandle("uMaterialBase");
+
+/* values of the per draw uniforms a program got last, uniforms keep their values across frames */
+struct ProgramUniforms
+{
+    GLuint program = 0;
+    bool valid = false;
+    Vector3D posScale;
+    Vector3D posOffset;
+    int instanceOffset = 0;
+    /* -1 until the program got a material */
+    int materialBase = -1;
+};
+
+struct
+{
+    std::vector<RenderItem> items;
+
+    /* key and item index, sorted with two buffers */
+    std::vector<std::pair<uint64_t, uint32_t>> sorted;
+    std::vector<std::pair<uint64_t, uint32_t>> scratch;
+    std::vector<RenderItem> ordered;
+
+    std::vector<ProgramUniforms> uniforms;
+} sRenderQueue;
+
+/* LSD radix sort with 8 bit digits, stable so draws with the same key keep the order they were queued in */
+void radixSort(std::vector<std::pair<uint64_t, uint32_t>>& keys, std::vector<std::pair<uint64_t, uint32_t>>& scratch)
+{
+    scratch.resize(keys.size());
+    for(unsigned int shift = 0; shift < 64; shift += 8)
+    {
+        std::size_t counts[256] = {};
+        for(const auto& key : keys)
+        {
+            counts[(key.first >> shift) & 0xFF]++;
+        }
+
+        /* digits that are the same for all keys (e.g. the pass) need no pass */
+        if(counts[(keys.front().first >> shift) & 0xFF] == keys.size())
+        {
+            continue;
+        }
+
+        std::size_t offset = 0;
+        for(auto& count : counts)
+        {
+            std::size_t c = count;
+            count = offset;
+            offset += c;
+        }
+        for(const auto& key : keys)
+        {
+            scratch[counts[(key.first >> shift) & 0xFF]++] = key;
+        }
+        keys.swap(scratch);
+    }
+}
+
+ProgramUniforms& programUniforms(GLuint program)
+{
+    auto& queue = sRenderQueue;
+    for(auto& uniforms : queue.uniforms)
+    {
+        if(uniforms.program == program)
+        {
+            return uniforms;
+        }
+    }
+
+    queue.uniforms.push_back(ProgramUniforms{program});
+    return queue.uniforms.back();
+}
+
+bool equal(const Vector3D& a, const Vector3D& b)
+{
+    return a.x == b.x && a.y == b.y && a.z == b.z;
+}
+
+}
+
+uint64_t renderSortKey(eRenderPass pass, GLuint program, GLuint vertexArray, unsigned int material, float depth)
+{
+    /* the bits of a positive float sort like the float */
+    uint32_t depthBits = 0;
+    float positive = std::max(depth, 0.0f);
+    std::memcpy(&depthBits, &positive, sizeof(depthBits));
+
+    return (static_cast<uint64_t>(pass & 0xF) << 60) | (static_cast<uint64_t>(program & 0xFF) << 52) |
+           (static_cast<uint64_t>(vertexArray & 0xFF) << 44) | (static_cast<uint64_t>(material & 0xFFF) << 32) |
+           depthBits;
+}
+
+Vector3D renderCenter(const Mesh &mesh)
+{
+    /* packed positions are unsigned normalized, the AABB center is at 0.5 */
+    return mesh.format == eVertexFormat::PACKED ? mesh.posOffset + mesh.posScale * 0.5f : mesh.posOffset;
+}
+
+float renderDepth(const Vector3D &cameraPosition, const Matrix4D &model, const Vector3D &center)
+{
+    Vector4D world = model * Vector4D(center, 1.0f);
+
+    return length(Vector3D(world.x, world.y, world.z) - cameraPosition);
+}
+
+float renderDepth(const Vector3D &cameraPosition, const Matrix4D &model, const Mesh &mesh)
+{
+    return renderDepth(cameraPosition, model, renderCenter(mesh));
+}
+
+void renderQueueAdd(const RenderItem &item)
+{
+    detail::sRenderQueue.items.push_back(item);
+}
+
+void renderItemsSort(std::vector<RenderItem> &items)
+{
+    auto& queue = detail::sRenderQueue;
+    if(items.empty())
+    {
+        return;
+    }
+
+    queue.sorted.clear();
+    for(uint32_t i = 0; i < items.size(); i++)
+    {
+        queue.sorted.emplace_back(items[i].key, i);
+    }
+    detail::radixSort(queue.sorted, queue.scratch);
+
+    queue.ordered.clear();
+    for(const auto& [key, index] : queue.sorted)
+    {
+        queue.ordered.push_back(items[index]);
+    }
+    items.swap(queue.ordered);
+}
+
+void renderItemsSubmit(const std::vector<RenderItem> &items, unsigned int entryBase)
+{
+    FrameStats& stats = statsFrame();
+    const ShaderProgram* program = nullptr;
+    detail::ProgramUniforms* uniforms = nullptr;
+    GLuint vertexArray = 0;
+    bool drawEntryBound = false;
+    unsigned int drawEntry = 0;
+    for(const RenderItem& item : items)
+    {
+        const Model& model = *item.model;
+
+        if(item.program != program)
+        {
+            program = item.program;
+            glUseProgram(program->id);
+            uniforms = &detail::programUniforms(program->id);
+            stats.binds++;
+        }
+        if(item.vertexArray != vertexArray)
+        {
+            vertexArray = item.vertexArray;
+            glBindVertexArray(vertexArray);
+            stats.binds++;
+        }
+        if(!drawEntryBound || entryBase + item.drawEntry != drawEntry)
+        {
+            drawEntry = entryBase + item.drawEntry;
+            drawEntryBound = true;
+            drawDataBind(drawEntry);
+            stats.binds++;
+        }
+
+        /* the first draw of a program sets all of its uniforms */
+        bool all = !uniforms->valid;
+        uniforms->valid = true;
+        if(all || !detail::equal(uniforms->posScale, model.mesh.posScale))
+        {
+            uniforms->posScale = model.mesh.posScale;
+            shaderUniform(*program, detail::posScale, model.mesh.posScale);
+            stats.uniformUploads++;
+        }
+        if(all || !detail::equal(uniforms->posOffset, model.mesh.posOffset))
+        {
+            uniforms->posOffset = model.mesh.posOffset;
+            shaderUniform(*program, detail::posOffset, model.mesh.posOffset);
+            stats.uniformUploads++;
+        }
+        if(all || uniforms->instanceOffset != static_cast<int>(model.instanceOffset))
+        {
+            uniforms->instanceOffset = static_cast<int>(model.instanceOffset);
+            shaderUniform(*program, detail::instanceOffset, uniforms->instanceOffset);
+            stats.uniformUploads++;
+        }
+        if(item.materialBase >= 0 && uniforms->materialBase != item.materialBase)
+        {
+            uniforms->materialBase = item.materialBase;
+            shaderUniform(*program, detail::materialBase, item.materialBase);
+            stats.uniformUploads++;
+        }
+
+        modelDraw(model);
+    }
+
+    /* cleanup opengl state */
+    glBindVertexArray(0);
+    glUseProgram(0);
+}
+
+void renderQueueSubmit()
+{
+    auto& queue = detail::sRenderQueue;
+
+    renderItemsSort(queue.items);
+    renderItemsSubmit(queue.items, 0);
+    queue.items.clear();
+}
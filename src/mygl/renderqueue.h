@@ -0,0 +1,82 @@
+#pragma once
+
+#include "model.h"
+#include "shader.h"
+
+#include <cstdint>
+#include <vector>
+
+/* passes of the render queue, the pass is the most significant part of the sort key */
+enum eRenderPass
+{
+    OpaquePass = 0
+};
+
+/* one draw of the render queue, the state it needs is only set if it differs from the state of the previous draw */
+struct RenderItem
+{
+    /* order of the draw, see renderSortKey */
+    uint64_t key = 0;
+
+    const ShaderProgram* program = nullptr;
+    GLuint vertexArray = 0;
+    const Model* model = nullptr;
+    /* entry of the draw in the per draw data ring (see drawDataAdd) */
+    unsigned int drawEntry = 0;
+    /* first material of the model in the material table, -1 if the program reads no materials */
+    int materialBase = -1;
+};
+
+/**
+ * @brief Builds the 64 bit sort key of a draw. From the most to the least significant bits it holds the pass (4 bits),
+ * the program (8 bits), the vertex array (8 bits), the material (12 bits) and the depth (32 bits), so that sorting the
+ * keys groups the draws by state and orders the draws of one state front to back for early depth rejection. Program
+ * and vertex array names are truncated, a collision only costs a state change.
+ *
+ * @param pass Pass of the draw.
+ * @param program Name of the shader program.
+ * @param vertexArray Name of the vertex array object.
+ * @param material Material of the draw (e.g. Model::materialBase), 0 if the program reads no materials.
+ * @param depth Distance of the draw to the camera (see renderDepth), not negative.
+ */
+uint64_t renderSortKey(eRenderPass pass, GLuint program, GLuint vertexArray, unsigned int material, float depth);
+
+/**
+ * @brief Center of the mesh AABB in model space.
+ */
+Vector3D renderCenter(const Mesh& mesh);
+
+/**
+ * @brief Distance from the camera to a point in model space transformed with the model matrix.
+ */
+float renderDepth(const Vector3D& cameraPosition, const Matrix4D& model, const Vector3D& center);
+
+/**
+ * @brief Distance from the camera to the center of the mesh AABB transformed with the model matrix.
+ */
+float renderDepth(const Vector3D& cameraPosition, const Matrix4D& model, const Mesh& mesh);
+
+/**
+ * @brief Sorts draws by key with a radix sort, draws with the same key keep their order.
+ */
+void renderItemsSort(std::vector<RenderItem>& items);
+
+/**
+ * @brief Draws the items in the given order. Program, vertex array, draw data and uniform changes are skipped if the
+ * state is already set, the number of binds and uniform uploads is counted in the frame statistics (see statsFrame).
+ *
+ * @param items Draws, usually sorted with renderItemsSort.
+ * @param entryBase Added to the drawEntry of the items, e.g. the index of the first entry of a retained draw list.
+ */
+void renderItemsSubmit(const std::vector<RenderItem>& items, unsigned int entryBase);
+
+/**
+ * @brief Appends a draw to the render queue of the frame.
+ */
+void renderQueueAdd(const RenderItem& item);
+
+/**
+ * @brief Sorts the queued draws by key and draws them (see renderItemsSort and renderItemsSubmit). The queue is empty
+ * afterwards.
+ */
+void renderQueueSubmit();
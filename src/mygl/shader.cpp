@@ -1,18 +1,32 @@
 #include "shader.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <fstream>
+#include <iomanip>
+#include <map>
 #include <sstream>
 #include <iostream>
 #include <stdexcept>
 
 namespace detail
 {
-    void compile(GLuint handle, const char* source, const int size)
+    /* compiles and links are only started, their status is checked later (see finishProgram), every status query waits
+     * for the driver to finish and would serialize the compiles */
+    void compileStart(GLuint handle, const std::string& source)
     {
-        GLint compileResult = 0;
+        const char* text = source.c_str();
+        const GLint size = static_cast<GLint>(source.size());
 
-        glShaderSource(handle, 1, &source, &size);
+        glShaderSource(handle, 1, &text, &size);
         glCompileShader(handle);
+    }
+
+    void compileCheck(GLuint handle)
+    {
+        GLint compileResult = 0;
         glGetShaderiv(handle, GL_COMPILE_STATUS, &compileResult);
 
         if(compileResult == GL_FALSE)
@@ -31,10 +45,8 @@ namespace detail
         }
     }
 
-    void link(GLuint handle)
+    void linkCheck(GLuint handle)
     {
-        glLinkProgram(handle);
-
         GLint result;
         glGetProgramiv(handle, GL_LINK_STATUS, &result);
 
@@ -57,121 +69,625 @@ namespace detail
             throw std::runtime_error((std::string("[Shader] ERROR link shaderprogram: \n") + programLog));
         }
     }
-}
 
-ShaderProgram shaderCreate(const std::string &vertexSource, const std::string &fragmentSource)
-{
-    ShaderProgram program{glCreateProgram(), glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER)};
+    /* assigns the binding points of eUniformBlock to the uniform blocks the program declares */
+    void bindUniformBlocks(GLuint handle)
+    {
+        const std::pair<const char*, eUniformBlock> blocks[] = {
+            { "Materials", eUniformBlock::MaterialBlock },
+            { "FrameData", eUniformBlock::FrameBlock },
+            { "DrawData", eUniformBlock::DrawBlock },
+            { "FlagWaves", eUniformBlock::FlagBlock },
+        };
+
+        for(const auto& [name, binding] : blocks)
+        {
+            GLuint index = glGetUniformBlockIndex(handle, name);
+            if(index != GL_INVALID_INDEX)
+            {
+                glUniformBlockBinding(handle, index, binding);
+            }
+        }
+    }
+
+    /* builds the uniform table of the program, the only place where uniform locations are queried */
+    std::vector<ShaderUniformInfo> reflectUniforms(GLuint handle)
+    {
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(handle, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(handle, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<ShaderUniformInfo> uniforms;
+        std::string name(static_cast<std::size_t>(std::max(maxLength, 1)), '\0');
+        for(GLint i = 0; i < count; i++)
+        {
+            GLsizei length = 0;
+            ShaderUniformInfo info{};
+            glGetActiveUniform(handle, static_cast<GLuint>(i), maxLength, &length, &info.size, &info.type, &name[0]);
+            info.name = name.substr(0, static_cast<std::size_t>(length));
+            statsFrame().uniformQueries++;
+
+            /* members of uniform blocks have no location */
+            info.location = glGetUniformLocation(handle, info.name.c_str());
+            statsFrame().uniformQueries++;
+            if(info.location < 0)
+            {
+                continue;
+            }
+
+            /* arrays are reported as "name[0]", they are set by their plain name */
+            if(info.size > 1 && info.name.size() > 3 && info.name.compare(info.name.size() - 3, 3, "[0]") == 0)
+            {
+                info.name.resize(info.name.size() - 3);
+            }
+            info.hash = shaderUniformHandle(info.name).hash;
+            uniforms.push_back(info);
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const auto& a, const auto& b) { return a.hash < b.hash; });
+        for(std::size_t i = 1; i < uniforms.size(); i++)
+        {
+            if(uniforms[i - 1].hash == uniforms[i].hash)
+            {
+                throw std::runtime_error("[Shader] Uniforms " + uniforms[i - 1].name + " and " + uniforms[i].name + " have the same hash");
+            }
+        }
+
+        return uniforms;
+    }
+
+    /* assigns the texture units of eTextureUnit to the samplers the program declares */
+    void bindSamplers(const ShaderProgram& program)
+    {
+        const std::pair<ShaderUniformHandle, eTextureUnit> samplers[] = {
+            { shaderUniformHandle("uInstances"), eTextureUnit::InstanceUnit },
+        };
+
+        glUseProgram(program.id);
+        for(const auto& [handle, unit] : samplers)
+        {
+            shaderUniform(program, handle, static_cast<int>(unit));
+        }
+        glUseProgram(0);
+    }
+
+    std::string readFile(const std::string& path, const char* kind)
+    {
+        std::ifstream file(path);
+        if(!file.is_open())
+        {
+            std::cerr << "[Shader] Couldn't open " << kind << " shader file at " << path << std::endl;
+            std::cerr.flush();
+            throw std::runtime_error(std::string("[Shader] Couldn't open ") + kind + " shader file at " + path);
+        }
+
+        std::stringstream buffer;
+        buffer << file.rdbuf();
+        return buffer.str();
+    }
+
+    /* the defines have to follow the #version line, which has to be the first statement of the source */
+    std::string injectDefines(const std::string& source, const ShaderDefines& defines)
+    {
+        if(defines.empty())
+        {
+            return source;
+        }
+
+        std::string block;
+        for(const auto& [name, value] : defines)
+        {
+            block += "#define " + name + (value.empty() ? "" : " " + value) + "\n";
+        }
+
+        std::size_t version = source.find("#version");
+        if(version == std::string::npos)
+        {
+            return block + source;
+        }
+
+        std::size_t lineEnd = source.find('\n', version);
+        std::size_t insert = lineEnd == std::string::npos ? source.size() : lineEnd + 1;
+        std::string result = source.substr(0, insert);
+        if(lineEnd == std::string::npos)
+        {
+            result += '\n';
+        }
+        return result + block + source.substr(insert);
+    }
+
+    /* starts compiling and linking the sources, the program binary can only be read later if it is marked retrievable
+     * before linking */
+    ShaderProgram createProgram(const std::string& vertexSource, const std::string& fragmentSource, bool retrievable)
+    {
+        ShaderProgram program{glCreateProgram(), glCreateShader(GL_VERTEX_SHADER), glCreateShader(GL_FRAGMENT_SHADER)};
+
+        if(!program._vertexID || !program._fragmentID || !program.id)
+        {
+            std::cerr << "[Shader] Couldn't create shader program!" << std::endl;
+            std::cerr.flush();
+            throw std::runtime_error("[Shader] Couldn't create shader program!");
+        }
+
+        compileStart(program._vertexID, vertexSource);
+        glAttachShader(program.id, program._vertexID);
+
+        compileStart(program._fragmentID, fragmentSource);
+        glAttachShader(program.id, program._fragmentID);
+
+        if(retrievable)
+        {
+            glProgramParameteri(program.id, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(program.id);
+        program.ready = false;
+
+        return program;
+    }
+
+    /* waits for the compile and link of createProgram and throws with the log of the first error */
+    void finishProgram(ShaderProgram& program)
+    {
+        compileCheck(program._vertexID);
+        compileCheck(program._fragmentID);
+        linkCheck(program.id);
+    }
+
+    /* true if the driver finished compiling and linking, i.e. finishProgram does not wait. Without
+     * GL_KHR_parallel_shader_compile the driver may compile synchronously or only when the status is queried, so
+     * there is no way to tell. */
+    bool programCompleted(const ShaderProgram& program)
+    {
+        if(!GLAD_GL_KHR_parallel_shader_compile && !GLAD_GL_ARB_parallel_shader_compile)
+        {
+            return true;
+        }
+
+        GLint completed = GL_FALSE;
+        glGetProgramiv(program.id, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    /* state that is not part of a program binary, set after linking or loading a binary */
+    void setupProgram(ShaderProgram& program)
+    {
+        program.uniforms = reflectUniforms(program.id);
+        bindUniformBlocks(program.id);
+        bindSamplers(program);
+    }
+
+    /* on-disk cache of linked programs, keyed by the sources and the driver (see shaderCacheOpen) */
+    const uint32_t cacheMagic = 0x4E494250;  // "PBIN"
+    const uint32_t cacheVersion = 1;
+
+    struct
+    {
+        std::string directory;
+        std::string driver;
+    } sProgramCache;
+
+    uint64_t cacheKey(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        const std::string* parts[] = {&sProgramCache.driver, &vertexSource, &fragmentSource};
+
+        uint64_t h = 14695981039346656037ull;
+        for(const std::string* part : parts)
+        {
+            for(unsigned char c : *part)
+            {
+                h = (h ^ c) * 1099511628211ull;
+            }
+            /* separator, so that moving text from one part to the next changes the key */
+            h = (h ^ 0xFFu) * 1099511628211ull;
+        }
+
+        return h;
+    }
+
+    std::string cachePath(uint64_t key)
+    {
+        std::ostringstream path;
+        path << sProgramCache.directory << "/" << std::hex << std::setw(16) << std::setfill('0') << key << ".bin";
+        return path.str();
+    }
+
+    /* file layout: magic, version, binary format, compile time in ms, binary size, binary */
+    struct CacheHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t format;
+        uint32_t size;
+        double compileTime;
+    };
+
+    /* loads the program from its cached binary, false if there is none or the driver rejects it */
+    bool cacheLoad(const std::string& path, ShaderProgram& program, double& compileTime)
+    {
+        std::ifstream file(path, std::ios::binary);
+        CacheHeader header{};
+        if(!file.is_open() || !file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+           header.magic != cacheMagic || header.version != cacheVersion)
+        {
+            return false;
+        }
+
+        std::vector<char> binary(header.size);
+        if(!file.read(binary.data(), binary.size()))
+        {
+            return false;
+        }
+
+        GLuint id = glCreateProgram();
+        glProgramBinary(id, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(id, GL_LINK_STATUS, &linked);
+        if(linked == GL_FALSE)
+        {
+            /* e.g. after a driver update that kept the version string, the program is compiled from source instead */
+            glDeleteProgram(id);
+            while(glGetError() != GL_NO_ERROR)
+            {
+            }
+            return false;
+        }
+
+        program = ShaderProgram{};
+        program.id = id;
+        compileTime = header.compileTime;
+        return true;
+    }
+
+    void cacheStore(const std::string& path, const ShaderProgram& program, double compileTime)
+    {
+        GLint length = 0;
+        glGetProgramiv(program.id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if(length <= 0)
+        {
+            return;
+        }
+
+        std::vector<char> binary(static_cast<std::size_t>(length));
+        GLenum format = 0;
+        glGetProgramBinary(program.id, length, &length, &format, binary.data());
+
+        CacheHeader header{cacheMagic, cacheVersion, format, static_cast<uint32_t>(length), compileTime};
+
+        /* written next to the final file and renamed, a crash never leaves a truncated binary behind */
+        std::error_code error;
+        std::filesystem::create_directories(sProgramCache.directory, error);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            file.write(binary.data(), length);
+            if(!file)
+            {
+                std::cerr << "[Shader] Couldn't write program cache file " << temporary << std::endl;
+                return;
+            }
+        }
+        std::filesystem::rename(temporary, path, error);
+    }
+
+    /* short description of a program for the log, e.g. "default.vert + default.frag [FLAG, NORMAL_OUTPUT]" */
+    std::string programName(const std::string& vertexPath, const std::string& fragmentPath, const ShaderDefines& defines)
+    {
+        std::string name = std::filesystem::path(vertexPath).filename().string() + " + " +
+                           std::filesystem::path(fragmentPath).filename().string();
+        for(std::size_t i = 0; i < defines.size(); i++)
+        {
+            name += (i == 0 ? " [" : ", ") + defines[i].first;
+        }
+        return defines.empty() ? name : name + "]";
+    }
+
+    double millisecondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
 
-    if(!program._vertexID || !program._fragmentID || !program.id)
+    /* program of shaderLoad whose compile and link were started but not checked yet */
+    struct PendingLoad
     {
-        std::cerr << "[Shader] Couldn't create shader program!" << std::endl;
-        std::cerr.flush();
-        throw std::runtime_error("[Shader] Couldn't create shader program!");
+        ShaderProgram program;
+        std::string name;
+        /* cache file of the program, empty if the program cache is off */
+        std::string cachePath;
+        /* the program was loaded from the cache, compileTime is the time of the compile it replaced */
+        bool cached = false;
+        double compileTime = 0.0;
+        std::chrono::steady_clock::time_point start;
+    };
+
+    /* compiled permutations by key, see shaderPermutation */
+    std::map<std::string, PendingLoad> sPermutations;
+
+    /* lets the driver use as many compiler threads as it likes, called before the first compile */
+    void parallelCompileInit()
+    {
+        static bool initialized = false;
+        if(initialized)
+        {
+            return;
+        }
+        initialized = true;
+
+        if(GLAD_GL_KHR_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+        }
+        else if(GLAD_GL_ARB_parallel_shader_compile)
+        {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+        }
+        std::cout << "[Shader] Parallel shader compile "
+                  << (GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile ? "on" : "not supported")
+                  << std::endl;
     }
 
-    detail::compile(program._vertexID, vertexSource.c_str(), vertexSource.size());
-    glAttachShader(program.id, program._vertexID);
+    PendingLoad loadStart(const std::string& vertexPath, const std::string& fragmentPath, const ShaderDefines& defines)
+    {
+        parallelCompileInit();
 
-    detail::compile(program._fragmentID, fragmentSource.c_str(), fragmentSource.size());
-    glAttachShader(program.id, program._fragmentID);
+        std::string vertexSource = injectDefines(readFile(vertexPath, "vertex"), defines);
+        std::string fragmentSource = injectDefines(readFile(fragmentPath, "fragment"), defines);
 
-    detail::link(program.id);
+        PendingLoad load;
+        load.name = programName(vertexPath, fragmentPath, defines);
+        load.start = std::chrono::steady_clock::now();
+        if(!sProgramCache.directory.empty())
+        {
+            load.cachePath = cachePath(cacheKey(vertexSource, fragmentSource));
+            load.cached = cacheLoad(load.cachePath, load.program, load.compileTime);
+            load.program.ready = false;
+        }
+        if(!load.cached)
+        {
+            load.program = createProgram(vertexSource, fragmentSource, !load.cachePath.empty());
+        }
+
+        return load;
+    }
+
+    /* waits for the program of loadStart, stores it in the program cache and makes it ready for use */
+    void loadFinish(PendingLoad& load)
+    {
+        if(load.program.ready)
+        {
+            return;
+        }
+
+        if(!load.cached)
+        {
+            finishProgram(load.program);
+        }
+        setupProgram(load.program);
+        load.program.ready = true;
+
+        double time = millisecondsSince(load.start);
+        if(load.cached)
+        {
+            std::cout << "[Shader] Program cache hit for " << load.name << ", loaded in " << time << " ms ("
+                      << std::max(load.compileTime - time, 0.0) << " ms saved)" << std::endl;
+        }
+        else if(!load.cachePath.empty())
+        {
+            cacheStore(load.cachePath, load.program, time);
+            std::cout << "[Shader] Program cache miss for " << load.name << ", compiled in " << time << " ms" << std::endl;
+        }
+    }
+
+    /* cache entry of a permutation, the compile is started if it does not exist yet */
+    PendingLoad& permutationStart(const std::string& vertexPath, const std::string& fragmentPath, ShaderDefines& defines)
+    {
+        std::sort(defines.begin(), defines.end());
+
+        std::string key = vertexPath + "|" + fragmentPath;
+        for(const auto& [name, value] : defines)
+        {
+            key += "|" + name + "=" + value;
+        }
+
+        auto it = sPermutations.find(key);
+        if(it == sPermutations.end())
+        {
+            it = sPermutations.emplace(key, loadStart(vertexPath, fragmentPath, defines)).first;
+        }
+        return it->second;
+    }
+}
+
+ShaderProgram shaderCreate(const std::string &vertexSource, const std::string &fragmentSource)
+{
+    ShaderProgram program = detail::createProgram(vertexSource, fragmentSource, false);
+    detail::finishProgram(program);
+    detail::setupProgram(program);
+    program.ready = true;
 
     return program;
 }
 
 ShaderProgram shaderLoad(const std::string &vertexPath, const std::string &fragmentPath)
 {
-    std::ifstream vertexFile(vertexPath);
-    std::ifstream fragmentFile(fragmentPath);
+    return shaderLoad(vertexPath, fragmentPath, {});
+}
 
-    if(!vertexFile.is_open())
+ShaderProgram shaderLoad(const std::string &vertexPath, const std::string &fragmentPath, const ShaderDefines &defines)
+{
+    detail::PendingLoad load = detail::loadStart(vertexPath, fragmentPath, defines);
+    detail::loadFinish(load);
+
+    return load.program;
+}
+
+void shaderCacheOpen(const std::string &directory)
+{
+    auto& cache = detail::sProgramCache;
+    cache.directory.clear();
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if(!GLAD_GL_ARB_get_program_binary || formats <= 0)
     {
-        std::cerr << "[Shader] Couldn't open vertex shader file at " << std::endl;
-        std::cerr.flush();
-        throw std::runtime_error("[Shader] Couldn't open vertex shader file at " + vertexPath);
+        std::cout << "[Shader] Program binaries are not supported by the driver, the program cache is off" << std::endl;
+        return;
     }
 
-    if(!fragmentFile.is_open())
+    /* binaries are only valid for the driver that created them */
+    for(GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION})
     {
-        std::cerr << "[Shader] Couldn't open fragment shader file at " << std::endl;
-        std::cerr.flush();
-        throw std::runtime_error("[Shader] Couldn't open fragment shader file at " + fragmentPath);
+        const GLubyte* value = glGetString(name);
+        cache.driver += value ? reinterpret_cast<const char*>(value) : "";
+        cache.driver += '\n';
     }
+    cache.directory = directory;
+}
 
-    std::stringstream vertexSourceBuffer;
-    vertexSourceBuffer << vertexFile.rdbuf();
+const ShaderProgram& shaderPermutation(const std::string &vertexPath, const std::string &fragmentPath, ShaderDefines defines)
+{
+    detail::PendingLoad& load = detail::permutationStart(vertexPath, fragmentPath, defines);
+    detail::loadFinish(load);
+
+    return load.program;
+}
+
+const ShaderProgram& shaderPermutationPrefetch(const std::string &vertexPath, const std::string &fragmentPath, ShaderDefines defines)
+{
+    return detail::permutationStart(vertexPath, fragmentPath, defines).program;
+}
+
+void shaderPermutationWait(const ShaderProgram &program)
+{
+    for(auto& [key, load] : detail::sPermutations)
+    {
+        if(&load.program == &program)
+        {
+            detail::loadFinish(load);
+            return;
+        }
+    }
+}
+
+unsigned int shaderPermutationsPoll()
+{
+    bool parallel = GLAD_GL_KHR_parallel_shader_compile || GLAD_GL_ARB_parallel_shader_compile;
+
+    unsigned int finished = 0;
+    for(auto& [key, load] : detail::sPermutations)
+    {
+        if(load.program.ready || !detail::programCompleted(load.program))
+        {
+            continue;
+        }
+
+        detail::loadFinish(load);
+        finished++;
+
+        /* without parallel compile the driver may only compile now, one program per frame keeps the frames short */
+        if(!parallel)
+        {
+            break;
+        }
+    }
 
-    std::stringstream fragmentSourceBuffer;
-    fragmentSourceBuffer << fragmentFile.rdbuf();
+    return finished;
+}
 
-    return shaderCreate(vertexSourceBuffer.str(), fragmentSourceBuffer.str());
+void shaderPermutationsDelete()
+{
+    for(const auto& [key, load] : detail::sPermutations)
+    {
+        shaderDelete(load.program);
+    }
+    detail::sPermutations.clear();
 }
 
 void shaderDelete(const ShaderProgram &program)
 {
-    glDetachShader(program.id, program._vertexID);
-    glDetachShader(program.id, program._fragmentID);
-    glDeleteShader(program._vertexID);
-    glDeleteShader(program._fragmentID);
+    /* programs loaded from the program cache have no shader objects */
+    if(program._vertexID)
+    {
+        glDetachShader(program.id, program._vertexID);
+        glDeleteShader(program._vertexID);
+    }
+    if(program._fragmentID)
+    {
+        glDetachShader(program.id, program._fragmentID);
+        glDeleteShader(program._fragmentID);
+    }
 
     glDeleteProgram(program.id);
 }
 
 
-namespace detail
+GLint shaderUniformLocation(const ShaderProgram &shader, ShaderUniformHandle handle)
 {
+    auto it = std::lower_bound(shader.uniforms.begin(), shader.uniforms.end(), handle.hash,
+                               [](const ShaderUniformInfo& info, uint32_t hash) { return info.hash < hash; });
 
-GLint uniform_index(ShaderProgram &shader, const std::string &name)
+    return (it != shader.uniforms.end() && it->hash == handle.hash) ? it->location : -1;
+}
+
+/* the location -1 of inactive uniforms makes glUniform* a no-op */
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, const Matrix4D& value)
 {
-    GLint index = glGetUniformLocation(shader.id, name.c_str());
-    if(index < 0)
-    {
-        std::cerr << "[Shader] Couldn't set value for uniform " << name << std::endl;
-        std::cerr.flush();
-        throw std::runtime_error("[Shader] Couldn't set value for uniform " + name);
-    }
+    glUniformMatrix4fv(shaderUniformLocation(shader, handle), 1, GL_FALSE, value.ptr());
+}
+
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, int value)
+{
+    glUniform1i(shaderUniformLocation(shader, handle), value);
+}
+
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, const Vector2D& vec)
+{
+    glUniform2f(shaderUniformLocation(shader, handle), vec.x, vec.y);
+}
 
-    return index;
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, const Vector3D& vec)
+{
+    glUniform3f(shaderUniformLocation(shader, handle), vec.x, vec.y, vec.z);
 }
 
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, const Vector4D& vec)
+{
+    glUniform4f(shaderUniformLocation(shader, handle), vec.x, vec.y, vec.z, vec.w);
+}
+
+void shaderUniform(const ShaderProgram &shader, ShaderUniformHandle handle, float value)
+{
+    glUniform1f(shaderUniformLocation(shader, handle), value);
 }
 
 void shaderUniform(ShaderProgram &shader, const std::string &name, const Matrix4D& value)
 {
-    GLint index = detail::uniform_index(shader, name);
-    glUniformMatrix4fv(index, 1, GL_FALSE, value.ptr());
+    shaderUniform(shader, shaderUniformHandle(name), value);
 }
 
 void shaderUniform(ShaderProgram &shader, const std::string &name, int value)
 {
-    GLint index = detail::uniform_index(shader, name);
-    glUniform1i(index, value);
+    shaderUniform(shader, shaderUniformHandle(name), value);
 }
 
 void shaderUniform(ShaderProgram &shader, const std::string &name, const Vector2D& vec)
 {
-    GLint index = detail::uniform_index(shader, name);
-    glUniform2f(index, vec.x, vec.y);
+    shaderUniform(shader, shaderUniformHandle(name), vec);
 }
 
-
 void shaderUniform(ShaderProgram &shader, const std::string &name, const Vector3D& vec)
 {
-    GLint index = detail::uniform_index(shader, name);
-    glUniform3f(index, vec.x, vec.y, vec.z);
+    shaderUniform(shader, shaderUniformHandle(name), vec);
 }
 
 void shaderUniform(ShaderProgram &shader, const std::string &name, const Vector4D& vec)
 {
-    GLint index = detail::uniform_index(shader, name);
-
-    glUniform4f(index, vec.x, vec.y, vec.z, vec.w);
+    shaderUniform(shader, shaderUniformHandle(name), vec);
 }
 
 void shaderUniform(ShaderProgram &shader, const std::string &name, float value)
 {
-    GLint index = detail::uniform_index(shader, name);
-    glUniform1f(index, value);
+    shaderUniform(shader, shaderUniformHandle(name), value);
 }
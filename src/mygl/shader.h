@@ -2,13 +2,85 @@
 
 #include "base.h"
 
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/* binding points of the uniform blocks shared by all shader programs, blocks are bound by name when a program gets linked */
+enum eUniformBlock
+{
+    MaterialBlock = 0,  // "Materials", see modelUpload
+    FrameBlock = 1,     // "FrameData", see frameDataUpdate
+    DrawBlock = 2,      // "DrawData", see drawDataBind
+    FlagBlock = 3       // "FlagWaves", see flagWavesUpdate
+};
+
+/* texture units of the samplers shared by all shader programs, samplers are assigned by name when a program gets linked */
+enum eTextureUnit
+{
+    InstanceUnit = 0    // "uInstances", see modelUpload
+};
+
+/* preprocessor defines of a shader permutation as name and value, e.g. {{"FLAG", ""}, {"FLAG_MAX_WAVES", "256"}} */
+using ShaderDefines = std::vector<std::pair<std::string, std::string>>;
+
+/* handle of a uniform, the FNV-1a hash of its name (see shaderUniformHandle) */
+struct ShaderUniformHandle
+{
+    uint32_t hash;
+};
+
+/* active uniform of a linked shader program, reflected once by shaderCreate */
+struct ShaderUniformInfo
+{
+    uint32_t hash;
+    GLint location;
+    GLenum type;
+    GLint size;
+    std::string name;
+};
+
 struct ShaderProgram
 {
     GLuint id = 0;
     GLuint _vertexID = 0;
     GLuint _fragmentID = 0;
+
+    /* active uniforms outside of uniform blocks, sorted by hash */
+    std::vector<ShaderUniformInfo> uniforms;
+
+    /* false while the program is compiled in the background (see shaderPermutationPrefetch), it must not be used yet */
+    bool ready = true;
 };
 
+/**
+ * @brief Computes the handle of a uniform name. Handles of constant names are computed at compile time, so setting a
+ * uniform by handle needs neither string work nor OpenGL queries.
+ *
+ * usage:
+ *
+ *   constexpr ShaderUniformHandle uModel = shaderUniformHandle("uModel");
+ *   shaderUniform(shader, uModel, model);
+ */
+constexpr ShaderUniformHandle shaderUniformHandle(std::string_view name)
+{
+    uint32_t hash = 2166136261u;
+    for(char c : name)
+    {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+    }
+
+    return {hash};
+}
+
+/**
+ * @brief Looks up the location of a uniform in the reflected uniform table of the shader program.
+ *
+ * @return Location of the uniform, -1 if the program has no active uniform with that name.
+ */
+GLint shaderUniformLocation(const ShaderProgram& shader, ShaderUniformHandle handle);
+
 /**
  * @brief Function to load vertex and fragment shader from file and compile and link them to create shader program.
  *
@@ -19,6 +91,75 @@ struct ShaderProgram
  */
 ShaderProgram shaderLoad(const std::string& vertexPath, const std::string& fragmentPath);
 
+/**
+ * @brief Turns on the on-disk program cache of shaderLoad. Linked programs are stored with glGetProgramBinary, keyed by
+ * a hash of their sources (including the defines) and the vendor, renderer and version strings of the driver, and
+ * loaded with glProgramBinary on later runs. A binary the driver rejects is silently replaced by compiling from
+ * source. Does nothing if the driver supports no program binary formats. Needs a current OpenGL context.
+ *
+ * @param directory Directory of the cache files, created when the first program is stored.
+ */
+void shaderCacheOpen(const std::string& directory);
+
+/**
+ * @brief Loads vertex and fragment shader from file and compiles them with the given defines, which are inserted as
+ * "#define name value" lines behind the #version line of both sources. Uses the program cache if it is turned on (see
+ * shaderCacheOpen).
+ *
+ * @param vertexPath Path to vertex shader file.
+ * @param fragmentPath Path to fragment shader file.
+ * @param defines Defines of the permutation.
+ *
+ * @return Shader program.
+ */
+ShaderProgram shaderLoad(const std::string& vertexPath, const std::string& fragmentPath, const ShaderDefines& defines);
+
+/**
+ * @brief Returns the permutation of a shader program for the given defines. Each combination of files and defines is
+ * compiled once and cached, the order of the defines does not matter. The programs are owned by the cache and stay
+ * valid until shaderPermutationsDelete. Waits for the compile of a prefetched permutation (see
+ * shaderPermutationPrefetch).
+ *
+ * usage:
+ *
+ *   const ShaderProgram& flagNormal = shaderPermutation("shader/default.vert", "shader/default.frag", {{"FLAG", ""}, {"NORMAL_OUTPUT", ""}});
+ *
+ * @param vertexPath Path to vertex shader file.
+ * @param fragmentPath Path to fragment shader file.
+ * @param defines Defines of the permutation.
+ *
+ * @return Shader program of the permutation.
+ */
+const ShaderProgram& shaderPermutation(const std::string& vertexPath, const std::string& fragmentPath, ShaderDefines defines);
+
+/**
+ * @brief Starts compiling the permutation of a shader program without waiting for it. The driver compiles in the
+ * background (with GL_KHR_parallel_shader_compile on its own threads), the program becomes ready in a later
+ * shaderPermutationsPoll or when it is waited for with shaderPermutation or shaderPermutationWait. Starting all
+ * permutations before waiting for the first one lets the driver compile them at the same time.
+ *
+ * @return Shader program of the permutation, only to be used once it is ready.
+ */
+const ShaderProgram& shaderPermutationPrefetch(const std::string& vertexPath, const std::string& fragmentPath, ShaderDefines defines);
+
+/**
+ * @brief Waits until a program of shaderPermutationPrefetch is ready.
+ */
+void shaderPermutationWait(const ShaderProgram& program);
+
+/**
+ * @brief Makes the prefetched permutations ready whose compile finished, to be called once per frame. Without parallel
+ * compile support it is unknown whether a compile finished, then one program is finished per call.
+ *
+ * @return Number of programs that became ready.
+ */
+unsigned int shaderPermutationsPoll();
+
+/**
+ * @brief Deletes all cached shader permutations (see shaderPermutation).
+ */
+void shaderPermutationsDelete();
+
 /**
  * @brief Function to compile and link vertex and fragement source strings to create shader program.
  *
@@ -37,7 +178,8 @@ ShaderProgram shaderCreate(const std::string& vertexSource, const std::string& f
 void shaderDelete(const ShaderProgram& program);
 
 /**
- * @brief Function to set uniform in shader program.
+ * @brief Function to set uniform in shader program. The location is taken from the uniform table of the program, a
+ * uniform the program does not use (e.g. because the compiler removed it) is ignored.
  *
  * @param shader Shader program.
  * @param name Uniform naem.
@@ -89,3 +231,57 @@ void shaderUniform(ShaderProgram& shader, const std::string& name, int value);
  * @param value Value to which the uniform should be set.
  */
 void shaderUniform(ShaderProgram& shader, const std::string& name, float value);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, const Matrix4D& value);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, const Vector2D& vec);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, const Vector3D& vec);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, const Vector4D& vec);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, int value);
+
+/**
+ * @brief Function to set uniform in shader program by handle (see shaderUniformHandle).
+ *
+ * @param shader Shader program.
+ * @param handle Uniform handle.
+ * @param value Value to which the uniform should be set.
+ */
+void shaderUniform(const ShaderProgram& shader, ShaderUniformHandle handle, float value);
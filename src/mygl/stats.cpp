@@ -0,0 +1,155 @@
+#include "stats.h"
+
+#include <iomanip>
+#include <sstream>
+
+namespace detail
+{
+
+/* queries of the frames the gpu may still work on, a query is only reused once its result was read */
+const unsigned int timerQueries = 4;
+
+struct
+{
+    FrameStats current;
+
+    unsigned int frames = 0;
+    double lastReport = 0.0;
+
+    GLuint queries[timerQueries] = {};
+    bool pending[timerQueries] = {};
+    unsigned int query = 0;
+    bool measuring = false;
+
+    /* summed gpu time and number of measured frames since the last report */
+    GLuint64 gpuTime = 0;
+    unsigned int gpuFrames = 0;
+} sStats;
+
+/* reads the results of the finished queries */
+void timerCollect()
+{
+    auto& stats = sStats;
+    for(unsigned int i = 0; i < timerQueries; i++)
+    {
+        if(!stats.pending[i])
+        {
+            continue;
+        }
+
+        GLint available = GL_FALSE;
+        glGetQueryObjectiv(stats.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if(available)
+        {
+            GLuint64 time = 0;
+            glGetQueryObjectui64v(stats.queries[i], GL_QUERY_RESULT, &time);
+            stats.gpuTime += time;
+            stats.gpuFrames++;
+            stats.pending[i] = false;
+        }
+    }
+}
+
+}
+
+FrameStats& statsFrame()
+{
+    return detail::sStats.current;
+}
+
+void statsGpuBegin()
+{
+    auto& stats = detail::sStats;
+    if(!GLAD_GL_ARB_timer_query)
+    {
+        return;
+    }
+
+    if(!stats.queries[0])
+    {
+        glGenQueries(detail::timerQueries, stats.queries);
+    }
+
+    /* skip the frame if the gpu is so far behind that all queries are still in use */
+    detail::timerCollect();
+    stats.query = (stats.query + 1) % detail::timerQueries;
+    if(stats.pending[stats.query])
+    {
+        return;
+    }
+
+    glBeginQuery(GL_TIME_ELAPSED, stats.queries[stats.query]);
+    stats.measuring = true;
+}
+
+void statsGpuEnd()
+{
+    auto& stats = detail::sStats;
+    if(!stats.measuring)
+    {
+        return;
+    }
+
+    glEndQuery(GL_TIME_ELAPSED);
+    stats.pending[stats.query] = true;
+    stats.measuring = false;
+}
+
+void statsDelete()
+{
+    auto& stats = detail::sStats;
+    if(stats.queries[0])
+    {
+        glDeleteQueries(detail::timerQueries, stats.queries);
+    }
+    for(unsigned int i = 0; i < detail::timerQueries; i++)
+    {
+        stats.queries[i] = 0;
+        stats.pending[i] = false;
+    }
+}
+
+void statsFrameEnd(GLFWwindow *window, const std::string &title)
+{
+    auto& stats = detail::sStats;
+    stats.frames++;
+
+    double time = glfwGetTime();
+    if(time - stats.lastReport >= 1.0)
+    {
+        std::ostringstream text;
+        text << title << " | " << static_cast<int>(stats.frames / (time - stats.lastReport) + 0.5) << " fps | "
+             << stats.current.drawCalls << " draw calls (" << stats.current.drawRanges << " material ranges, "
+             << stats.current.instances << " instances) | " << stats.current.binds << " binds, "
+             << stats.current.uniformUploads << " uniform uploads | " << stats.current.uniformQueries << " uniform queries, "
+             << stats.current.ringWaits << " ring waits";
+        if(stats.current.commandBuffers > 0)
+        {
+            text << " | " << stats.current.commandBuffers << " command buffers (" << stats.current.recordedBuffers
+                 << " recorded)";
+        }
+        if(stats.current.recordedBuffers > 0)
+        {
+            text << ", record ms per thread:" << std::fixed << std::setprecision(3);
+            for(std::size_t thread = 0; thread < stats.current.recordTime.size(); thread++)
+            {
+                if(stats.current.recordTime[thread] > 0.0)
+                {
+                    text << " " << thread << ":" << stats.current.recordTime[thread];
+                }
+            }
+        }
+        if(stats.gpuFrames > 0)
+        {
+            text << " | gpu " << std::fixed << std::setprecision(2) << stats.gpuTime / 1e6 / stats.gpuFrames << " ms";
+        }
+        glfwSetWindowTitle(window, text.str().c_str());
+
+        stats.frames = 0;
+        stats.lastReport = time;
+        stats.gpuTime = 0;
+        stats.gpuFrames = 0;
+    }
+
+    stats.current = FrameStats();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "base.h"
+
+#include <vector>
+
+/* counters of the current frame, filled by the draw functions (see modelDraw) */
+struct FrameStats
+{
+    /* number of glDraw* calls */
+    unsigned int drawCalls = 0;
+    /* number of drawn material ranges, i.e. the draw calls with one draw per material */
+    unsigned int drawRanges = 0;
+    /* number of drawn model instances */
+    unsigned int instances = 0;
+    /* number of glGetUniformLocation/glGetActiveUniform calls, only shaderCreate makes them */
+    unsigned int uniformQueries = 0;
+    /* number of program, vertex array and draw data binds of the render queue (see renderQueueSubmit) */
+    unsigned int binds = 0;
+    /* number of per draw uniform uploads of the render queue, uploads of unchanged values are skipped */
+    unsigned int uniformUploads = 0;
+    /* number of replayed command buffers and their recording time in ms per thread (see commandBuffersReplay and
+     * drawListReplay) */
+    unsigned int commandBuffers = 0;
+    std::vector<double> recordTime;
+    /* number of command buffers of retained draw lists that were recorded again in this frame (see drawListRecord) */
+    unsigned int recordedBuffers = 0;
+    /* number of times the cpu waited for the gpu to release a region of the per draw data ring (see drawDataBegin) */
+    unsigned int ringWaits = 0;
+};
+
+/**
+ * @brief Counters of the frame that is currently rendered.
+ */
+FrameStats& statsFrame();
+
+/**
+ * @brief Starts measuring the gpu time of the scene draws of this frame with a GL_TIME_ELAPSED query. The result is
+ * read a few frames later without waiting for the gpu, the average of the report interval is shown in the window title
+ * (see statsFrameEnd). Measures nothing if the context has no timer queries.
+ */
+void statsGpuBegin();
+
+/**
+ * @brief Ends the gpu time measurement of this frame (see statsGpuBegin).
+ */
+void statsGpuEnd();
+
+/**
+ * @brief Deletes the timer queries.
+ */
+void statsDelete();
+
+/**
+ * @brief Finishes the counters of the current frame. About once per second the frame rate and the counters of the last
+ * frame are shown in the window title.
+ *
+ * @param window Window whose title is updated.
+ * @param title Base title of the window, the statistics are appended.
+ */
+void statsFrameEnd(GLFWwindow* window, const std::string& title);
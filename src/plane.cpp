@@ -1,11 +1,10 @@
 #include "plane.h"
 
+#include <memory>
 #include <stdexcept>
 
-Plane planeLoad(const std::string& planeFilePath, const std::string& flagFilePath)
+Plane planeFromModels(const std::vector<Model>& models, const Flag& flag)
 {
-    std::vector<Model> models = modelLoad(planeFilePath);
-
     if(models.size() != Plane::ePart::PART_COUNT)
     {
         throw std::runtime_error("[Plane] number of parts do not match!" + std::to_string(models.size()));
@@ -60,21 +59,52 @@ Plane planeLoad(const std::string& planeFilePath, const std::string& flagFilePat
         else throw std::runtime_error("[Plane] unkown part name: " + obj.name);
     }
 
-    plane.flag = flagCreate(flagFilePath);
+    plane.flag = flag;
     plane.flagModelMatrix = flagPlane::trans;
 
     return plane;
 }
 
-void planeDelete(Plane &plane)
+Plane planeLoad(const std::string& planeFilePath, const std::string& flagFilePath)
 {
-    flagDelete(plane.flag);
+    return planeFromModels(modelLoad(planeFilePath), flagCreate(flagFilePath));
+}
 
-    for (auto &model : plane.partModel)
+void planeLoadAsync(const std::string& planeFilePath, const std::string& flagFilePath, std::function<void(Plane)> done)
+{
+    /* plane and flag are loaded concurrently, the plane is created with the second of both uploads */
+    struct Parts
     {
-        modelDelete(model);
-    }
+        std::vector<Model> models;
+        Flag flag;
+        int pending = 2;
+    };
+    auto parts = std::make_shared<Parts>();
 
+    modelLoadAsync(planeFilePath, ModelOptions(), [parts, done](std::vector<Model> models)
+    {
+        parts->models = std::move(models);
+        if(--parts->pending == 0)
+        {
+            done(planeFromModels(parts->models, parts->flag));
+        }
+    });
+    flagCreateAsync(flagFilePath, [parts, done](Flag flag)
+    {
+        parts->flag = flag;
+        if(--parts->pending == 0)
+        {
+            done(planeFromModels(parts->models, parts->flag));
+        }
+    });
+}
+
+void planeDelete(Plane &plane)
+{
+    flagDelete(plane.flag);
+
+    /* deletes all parts at once, so that the mesh arena is compacted afterwards */
+    modelDelete(plane.partModel);
     plane.partModel.clear();
     plane.partTransformations.clear();
 }
@@ -155,6 +185,14 @@ void planeMove(Plane &plane, bool control[], float dt)
 
     /* update flag simulation */
     updateSimulation(plane.flagSim, getSpeedFactor(plane), dt);
+    if (plane.flagSimulation == eFlagSimulation::CLOTH)
+    {
+        /* the plane flies along +z, the flag is rotated by flagNegativeRotation within the plane */
+        Matrix3D flagRotation = Matrix3D(plane.flagNegativeRotation);
+        Vector3D wind = transpose(flagRotation) * Vector3D(0.0f, 0.0f, -plane.speed);
+        Vector3D gravity = transpose(Matrix3D(plane.rotation) * flagRotation) * Vector3D(0.0f, -9.81f, 0.0f);
+        flagClothStep(plane.flag, wind, gravity, dt);
+    }
 }
 
 Vector3D getPlaneTurningVector(Plane &plane)
@@ -173,6 +211,20 @@ float getSpeedFov(Plane &plane)
     return static_cast<float>(to_radians(fovInDegrees));
 }
 
+void setFlagSimulation(Plane &plane, eFlagSimulation simulation)
+{
+    if (plane.flagSimulation != simulation)
+    {
+        if (simulation == eFlagSimulation::CLOTH)
+        {
+            flagClothCreate(plane.flag);
+        }
+        flagClothReset(plane.flag);
+        plane.flagSimulation = simulation;
+        plane.revision++;
+    }
+}
+
 void setEmission(Plane &plane, bool emission)
 {
     for (auto const& [part, color] : plane.emissionColors)
@@ -180,4 +232,5 @@ void setEmission(Plane &plane, bool emission)
         /* assumes that each part in emission color has only one material */
         plane.partModel[part].material[0].emission = emission ? color : Vector3D(0.0f, 0.0f, 0.0f);
     }
+    plane.revision++;
 }
@@ -50,6 +50,8 @@ struct Plane
     std::vector<Matrix4D> partTransformations;
     std::vector<Model> partModel;
     std::map<int, Vector3D> emissionColors;
+    /* incremented when the parts or their materials change, retained draw lists of the plane are recorded again */
+    unsigned int revision = 0;
 
     Matrix4D transformation = Matrix4D::identity();
     Matrix4D rotation = Matrix4D::identity();
@@ -74,6 +76,7 @@ struct Plane
 
     /* flag */
     FlagSim flagSim;
+    eFlagSimulation flagSimulation = eFlagSimulation::WAVES;
     Flag flag;
     Matrix4D flagModelMatrix;
     Matrix4D flagNegativeRotation = Matrix4D::identity();
@@ -86,6 +89,11 @@ struct Plane
  */
 Plane planeLoad(const std::string& planeFilePath, const std::string& flagFilePath);
 
+/**
+ * @brief Loads plane and flag on the job system like planeLoad, done receives the plane on the main thread (see jobsPoll).
+ */
+void planeLoadAsync(const std::string& planeFilePath, const std::string& flagFilePath, std::function<void(Plane)> done);
+
 /**
  * @brief Deletes the given plane object, including its flag object.
  */
@@ -121,6 +129,13 @@ float getSpeedFactor(Plane &plane);
 float getSpeedFov(Plane &plane);
 
 /**
- * @brief Sets the emission of the lights of the given plane model to be on or off.
+ * @brief Switches the animation of the flag, the cloth starts at rest and the waves get the rest vertices back. The
+ * cloth is created on the first switch to CLOTH (see flagClothCreate). Increments Plane::revision, since the flag is
+ * drawn with another shader permutation.
+ */
+void setFlagSimulation(Plane &plane, eFlagSimulation simulation);
+
+/**
+ * @brief Sets the emission of the lights of the given plane model to be on or off, increments Plane::revision.
  */
 void setEmission(Plane &plane, bool emission);
@@ -2,11 +2,18 @@
 
 #include <stdexcept>
 
-Planet planetLoad(const std::string &planetFilePath)
+/* the planet contains many copies of the same objects (trees, houses, boats), they are drawn instanced */
+ModelOptions planetModelOptions()
 {
+    ModelOptions options;
+    options.instancing = true;
+    return options;
+}
 
+Planet planetFromModels(std::vector<Model> models)
+{
     Planet planet;
-    planet.partModel = modelLoad(planetFilePath);
+    planet.partModel = std::move(models);
 
     if(planet.partModel.size() <= 0)
     {
@@ -34,13 +41,20 @@ Planet planetLoad(const std::string &planetFilePath)
     return planet;
 }
 
-void planetDelete(Planet &planet)
+Planet planetLoad(const std::string &planetFilePath)
 {
-    for (auto &model : planet.partModel)
-    {
-        modelDelete(model);
-    }
+    return planetFromModels(modelLoad(planetFilePath, planetModelOptions()));
+}
+
+void planetLoadAsync(const std::string &planetFilePath, std::function<void(Planet)> done)
+{
+    modelLoadAsync(planetFilePath, planetModelOptions(), [done](std::vector<Model> models) { done(planetFromModels(std::move(models))); });
+}
 
+void planetDelete(Planet &planet)
+{
+    /* deletes all parts at once, so that the mesh arena is compacted afterwards */
+    modelDelete(planet.partModel);
     planet.partModel.clear();
 }
 
@@ -64,4 +78,5 @@ void setEmisson(Planet &planet, bool emission)
             planet.partModel[part_id].material[mat_id].emission = emission ? color : Vector3D(0.0, 0.0, 0.0);
         }
     }
+    planet.revision++;
 }
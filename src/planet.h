@@ -9,6 +9,8 @@ struct Planet
 {
     std::vector<Model> partModel;
     std::map<int, std::map<int, Vector3D>> emissionColors;
+    /* incremented when the parts or their materials change, retained draw lists of the planet are recorded again */
+    unsigned int revision = 0;
 
     Matrix4D transformation = Matrix4D::identity();
     Matrix4D rotation = Matrix4D::identity();
@@ -16,6 +18,12 @@ struct Planet
     Vector3D position = {0.0, 0.0, 0.0};
 };
 
+/**
+ * @brief Options planetLoad passes to modelLoad, the planet objects are drawn instanced. The asset baker bakes the
+ * planet with the same options.
+ */
+ModelOptions planetModelOptions();
+
 /**
  * @brief Initializes the planet object with all its meshes.
  *
@@ -23,6 +31,11 @@ struct Planet
  */
 Planet planetLoad(const std::string &planetFilePath);
 
+/**
+ * @brief Loads the planet on the job system like planetLoad, done receives the planet on the main thread (see jobsPoll).
+ */
+void planetLoadAsync(const std::string &planetFilePath, std::function<void(Planet)> done);
+
 /**
  * @brief Deletes the given planet object.
  */
@@ -34,6 +47,6 @@ void planetDelete(Planet &planet);
 void planetRotate(Planet &planet, Vector3D rotationVec, float planeSpeed, float dt);
 
 /**
- * @brief Sets the emission of the given planet model to be on or off.
+ * @brief Sets the emission of the given planet model to be on or off, increments Planet::revision.
  */
 void setEmisson(Planet &planet, bool emission);
@@ -0,0 +1,56 @@
+#version 330 core
+
+// permutations (see shaderPermutation):
+//   NORMAL_OUTPUT  output the normals instead of the diffuse material colors
+//   FLAG           two sided normals, the normals of the flag are turned towards the camera
+
+#ifdef NORMAL_OUTPUT
+in vec3 tNormal;
+in vec3 tFragPos;
+
+// per frame data shared by all programs (see frameDataUpdate)
+layout(std140) uniform FrameData
+{
+    mat4 uView;
+    mat4 uProj;
+    mat4 uViewProj;
+    vec4 uCameraPosition;
+    float uTime;
+};
+#else
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;  // w is the shininess
+};
+
+// material table of all models (see modelUpload)
+layout(std140) uniform Materials
+{
+    Material uMaterials[256];
+};
+
+flat in int tMaterial;
+#endif
+
+out vec4 FragColor;
+
+void main(void)
+{
+#ifdef NORMAL_OUTPUT
+    vec3 normal = normalize(tNormal);
+
+#ifdef FLAG
+    /* for flag check if normal is facing the camera */
+    vec3 viewDir = normalize(uCameraPosition.xyz - tFragPos);
+    if (dot(normal, viewDir) < 0.0)
+    {
+        normal = -normal;
+    }
+#endif
+    FragColor = vec4((normal + vec3(1.0, 1.0, 1.0)) * 0.5, 1.0);
+#else
+    FragColor = vec4(uMaterials[tMaterial].diffuse.rgb, 1.0);
+#endif
+}
@@ -1,19 +1,130 @@
 #version 330 core
 
+// permutations (see shaderPermutation):
+//   FLAG        flag of the plane, displaced by the waves of the FlagWaves block instead of instanced
+//   FLAG_MAX_WAVES  size of the wave table of the FlagWaves block (see flagMaxWaves)
+//   FLAG_MIN_POS_Z  z coordinate of the flag edge with the full displacement (see Flag::minPosZ)
+//   CLOTH       with FLAG, the cloth simulation wrote positions and normals into the vertex buffer (see flagClothStep)
+
+#if defined(FLAG) && !defined(FLAG_MAX_WAVES)
+#define FLAG_MAX_WAVES 256
+#endif
+#if defined(FLAG) && !defined(FLAG_MIN_POS_Z)
+#define FLAG_MIN_POS_Z -8.0
+#endif
+
 layout(location = 0) in vec3 aPosition;
 layout(location = 1) in vec3 aNormal;
 layout(location = 2) in vec2 aUV;
+layout(location = 3) in uint aMaterial;
+
+// per frame data shared by all programs (see frameDataUpdate)
+layout(std140) uniform FrameData
+{
+    mat4 uView;
+    mat4 uProj;
+    mat4 uViewProj;
+    vec4 uCameraPosition;
+    float uTime;
+};
+
+// per draw data, the entry of the draw is selected with glBindBufferRange (see drawDataBind)
+layout(std140) uniform DrawData
+{
+    mat4 uModel;
+    mat3 uNormalMatrix;
+};
 
-uniform mat4 uModel;
-uniform mat4 uView;
-uniform mat4 uProj;
+// dequantization of packed positions (mesh AABB)
+uniform vec3 uPosScale;
+uniform vec3 uPosOffset;
+
+// first material of the model in the material table
+uniform int uMaterialBase;
+
+#ifdef FLAG
+// waves of the flag simulation (see flagWavesUpdate), two entries per wave: the normalized direction in the y/z plane,
+// omega and phase speed, then amplitude and phase offset. Only the time changes every frame
+layout(std140) uniform FlagWaves
+{
+    float uAccumTime;
+    int uWaveCount;
+    vec4 uWaves[2 * FLAG_MAX_WAVES];
+};
+#else
+// affine instance transformations and their normal matrices, six rows per instance (see modelUpload)
+uniform samplerBuffer uInstances;
+uniform int uInstanceOffset;
+#endif
 
 out vec3 tNormal;
 out vec3 tFragPos;
+flat out int tMaterial;
+
+#if defined(FLAG) && !defined(CLOTH)
+// displacement of the flag along x at a position in its y/z plane and the partial derivatives of the displacement along
+// y and z, the same sum of waves as flagDisplacement and flagNormal in flag.cpp
+vec3 flagWave(vec2 position)
+{
+    float displacement = 0.0;
+    vec2 slope = vec2(0.0);
+    for (int i = 0; i < uWaveCount; i++)
+    {
+        vec4 wave = uWaves[2 * i];
+        vec2 shape = uWaves[2 * i + 1].xy;
+        float argument = dot(wave.xy, position) * wave.z + (uAccumTime * wave.w + shape.y);
+        displacement += shape.x * sin(argument);
+        slope += wave.xy * (shape.x * cos(argument) * wave.z);
+    }
+
+    float positionScale = position.y / FLAG_MIN_POS_Z;
+    return vec3(displacement * positionScale, slope * positionScale + vec2(0.0, displacement / FLAG_MIN_POS_Z));
+}
+#endif
+
+#ifndef FLAG
+mat4 instanceTransform()
+{
+    int row = (uInstanceOffset + gl_InstanceID) * 6;
+    return transpose(mat4(texelFetch(uInstances, row),
+                          texelFetch(uInstances, row + 1),
+                          texelFetch(uInstances, row + 2),
+                          vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat3 instanceNormalMatrix()
+{
+    int row = (uInstanceOffset + gl_InstanceID) * 6 + 3;
+    return transpose(mat3(texelFetch(uInstances, row).xyz,
+                          texelFetch(uInstances, row + 1).xyz,
+                          texelFetch(uInstances, row + 2).xyz));
+}
+#endif
 
 void main(void)
 {
-    gl_Position = uProj * uView * uModel * vec4(aPosition, 1.0);
-    tFragPos = vec3(uModel * vec4(aPosition, 1.0));
-    tNormal = normalize(mat3(transpose(inverse(uModel))) * aNormal);
+    vec3 position = aPosition * uPosScale + uPosOffset;
+
+#if defined(FLAG) && defined(CLOTH)
+    vec3 normal = aNormal;
+    mat4 model = uModel;
+    mat3 normalMatrix = uNormalMatrix;
+#elif defined(FLAG)
+    // displace along x, the normal of the surface (D(y, z), y, z) is (1, -dD/dy, -dD/dz) on the side of the rest normal
+    vec3 wave = flagWave(position.yz);
+    position.x += wave.x;
+    vec3 normal = normalize(vec3(1.0, -wave.y, -wave.z)) * (aNormal.x < 0.0 ? -1.0 : 1.0);
+
+    mat4 model = uModel;
+    mat3 normalMatrix = uNormalMatrix;
+#else
+    vec3 normal = aNormal;
+    mat4 model = uModel * instanceTransform();
+    mat3 normalMatrix = uNormalMatrix * instanceNormalMatrix();
+#endif
+
+    gl_Position = uViewProj * model * vec4(position, 1.0);
+    tFragPos = vec3(model * vec4(position, 1.0));
+    tNormal = normalize(normalMatrix * normal);
+    tMaterial = uMaterialBase + int(aMaterial);
 }
@@ -0,0 +1,66 @@
+#include <chrono>
+#include <cstdlib>
+#include <filesystem>
+#include <iostream>
+#include <stdexcept>
+
+#include "mygl/jobs.h"
+#include "mygl/pack.h"
+
+#include "flag.h"
+#include "planet.h"
+
+/*
+ * Offline baker of the asset pack, run from the directory that contains the assets folder:
+ *
+ *   assignment_04_bake [pack path, default assets/assets.pack]
+ *
+ * The paths and options have to be the ones planeLoad, flagCreate and planetLoad pass to modelLoad, otherwise the
+ * entries are not found at runtime (the application then parses the OBJ files and writes the pack itself). The flag
+ * and planet options come from flagModelOptions and planetModelOptions for that reason.
+ */
+struct Asset
+{
+    const char* path;
+    ModelOptions options;
+};
+
+int main(int argc, char **argv)
+{
+    std::string packPath = argc > 1 ? argv[1] : "assets/assets.pack";
+
+    const Asset assets[] = {
+        { "assets/plane/cartoon-plane.obj", ModelOptions() },
+        { "assets/plane/flag_uibk.obj", flagModelOptions() },
+        { "assets/planet/cute-little-planet.obj", planetModelOptions() },
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    try
+    {
+        /* start from an empty pack */
+        std::filesystem::remove(packPath);
+        packOpen(packPath);
+
+        for(const auto& asset : assets)
+        {
+            std::vector<std::vector<uint8_t>> storage;
+            std::vector<ModelBlob> blobs = modelEncode(modelPrepare(asset.path, asset.options), asset.options.format, storage);
+            packAdd(asset.path, asset.options, blobs);
+        }
+
+        packClose();
+    }
+    catch(const std::exception &error)
+    {
+        std::cerr << error.what() << std::endl;
+        jobsShutdown();
+        return EXIT_FAILURE;
+    }
+    jobsShutdown();
+
+    auto duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "[Bake] Baked " << std::size(assets) << " OBJ files in " << duration.count() << " ms" << std::endl;
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,1075 @@
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+
+#include "mygl/jobs.h"
+#include "mygl/model.h"
+
+#include "cloth.h"
+#include "flag.h"
+
+/*
+ * Benchmarks of the cpu side code paths, run from the directory that contains the assets folder:
+ *
+ *   assignment_04_bench parse [OBJ file] [copies] [repeats]
+ *       Parses the OBJ file with 1, 2, 4, ... threads and checks that the result is identical to the serial parser.
+ *       With copies > 1 the objects of the file are repeated (with shifted indices) into a temporary OBJ file next
+ *       to it, to measure the scaling on large files.
+ *
+ *   assignment_04_bench parse-legacy [repeats]
+ *       Parses the shipped plane, flag and planet with the stringstream parser the loader started with and with
+ *       modelParse (serial and parallel), and checks that the objects and materials are identical.
+ *
+ *   assignment_04_bench parse-implicit
+ *       Parses generated OBJ files with faces or materials in front of the first object (or without any object) with
+ *       the serial and the parallel parser, both have to put them into an implicit object named "default".
+ *
+ *   assignment_04_bench flag [vertices] [repeats]
+ *       Animates a flag grid with the given number of vertices (the shipped flag has 399) with every cpu kernel the
+ *       cpu supports and checks the positions against flagDisplacement and the normals against flagNormal at several
+ *       simulation times (see flagKernelTolerance).
+ *
+ *   assignment_04_bench flag-normals [vertices]
+ *       Checks the analytic flag normals of flagNormal and of the cpu kernels against normals from central differences
+ *       of flagDisplacement.
+ *
+ *   assignment_04_bench flag-scaling [max vertices] [repeats]
+ *       Animates flag grids from the 399 vertices of the shipped flag up to max vertices (default 1M) with the fastest
+ *       kernel on 1, 2, 4, ... threads (see animateFlagVertices) and reports the speedup over one thread.
+ *
+ *   assignment_04_bench flag-waves [vertices] [max waves] [repeats]
+ *       Animates a flag grid with wind spectra of 1 up to max waves (default 256, see flagSpectrum) with every cpu kernel
+ *       the cpu supports, checks the positions against flagDisplacement and reports the cost per vertex and per wave.
+ *
+ *   assignment_04_bench flag-cloth [max grid] [budget ms]
+ *       Simulates cloth flags of 20x20 up to max grid x max grid particles (default 256) in the wind of the plane at
+ *       60 frames per second on 1, 2, 4, ... threads, and reports the time per frame against the budget (default 2 ms)
+ *       together with the stretch of the triangle edges. Fails if the cloth does not stay finite or stretches by more
+ *       than clothMaxStretch.
+ */
+namespace detail
+{
+
+/* runs the function repeats times and returns the fastest run in ms, the output of the loader is muted meanwhile */
+double timeMin(unsigned int repeats, const std::function<void()>& function)
+{
+    std::ostringstream muted;
+    std::streambuf* out = std::cout.rdbuf(muted.rdbuf());
+
+    double best = 0.0;
+    for(unsigned int i = 0; i < repeats; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        function();
+        double duration = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        best = (i == 0) ? duration : std::min(best, duration);
+    }
+
+    std::cout.rdbuf(out);
+    return best;
+}
+
+/* shifts the indices of one face corner (v, v/vt, v//vn or v/vt/vn) */
+std::string shiftCorner(const std::string& corner, const unsigned long (&shift)[3])
+{
+    std::string result;
+    std::size_t begin = 0;
+    for(int i = 0; i < 3 && begin <= corner.size(); i++)
+    {
+        std::size_t end = std::min(corner.find('/', begin), corner.size());
+        if(end > begin)
+        {
+            result += std::to_string(std::stoul(corner.substr(begin, end - begin)) + shift[i]);
+        }
+        if(end < corner.size())
+        {
+            result += '/';
+        }
+        begin = end + 1;
+    }
+
+    return result;
+}
+
+/* writes the objects of the OBJ file copies times into the output file, the material file is referenced once */
+void objRepeat(const std::string& filepath, const std::string& output, unsigned int copies)
+{
+    std::ifstream in(filepath);
+    if(!in.is_open())
+    {
+        throw std::runtime_error("[Bench] Couldn't open OBJ file at " + filepath);
+    }
+
+    std::vector<std::string> lines;
+    unsigned long counts[3] = {0, 0, 0};
+    for(std::string line; std::getline(in, line);)
+    {
+        counts[0] += line.rfind("v ", 0) == 0;
+        counts[1] += line.rfind("vt ", 0) == 0;
+        counts[2] += line.rfind("vn ", 0) == 0;
+        lines.push_back(line);
+    }
+
+    std::ofstream out(output, std::ios::binary);
+    for(unsigned int copy = 0; copy < copies; copy++)
+    {
+        const unsigned long shift[3] = {counts[0] * copy, counts[1] * copy, counts[2] * copy};
+        for(const auto& line : lines)
+        {
+            if(copy == 0)
+            {
+                out << line << '\n';
+            }
+            else if(line.rfind("f ", 0) == 0)
+            {
+                std::istringstream corners(line.substr(2));
+                out << 'f';
+                for(std::string corner; corners >> corner;)
+                {
+                    out << ' ' << shiftCorner(corner, shift);
+                }
+                out << '\n';
+            }
+            else if(line.rfind("o ", 0) == 0)
+            {
+                out << line << '_' << copy << '\n';
+            }
+            else if(line.rfind("mtllib ", 0) != 0)
+            {
+                out << line << '\n';
+            }
+        }
+    }
+}
+
+bool identical(const std::vector<ModelData>& a, const std::vector<ModelData>& b)
+{
+    if(a.size() != b.size())
+    {
+        return false;
+    }
+
+    for(std::size_t i = 0; i < a.size(); i++)
+    {
+        const ModelData& x = a[i];
+        const ModelData& y = b[i];
+        if(x.name != y.name || x.indices != y.indices || x.vertices.size() != y.vertices.size() ||
+           x.material.size() != y.material.size() ||
+           std::memcmp(x.vertices.data(), y.vertices.data(), x.vertices.size() * sizeof(Vertex)) != 0)
+        {
+            return false;
+        }
+
+        for(std::size_t m = 0; m < x.material.size(); m++)
+        {
+            const Material& p = x.material[m];
+            const Material& q = y.material[m];
+            if(p.name != q.name || p.id != q.id || p.indexOffset != q.indexOffset || p.indexCount != q.indexCount ||
+               p.shininess != q.shininess || std::memcmp(&p.ambient, &q.ambient, sizeof(Vector3D)) != 0 ||
+               std::memcmp(&p.diffuse, &q.diffuse, sizeof(Vector3D)) != 0 ||
+               std::memcmp(&p.specular, &q.specular, sizeof(Vector3D)) != 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * The stringstream OBJ parser the loader started with, kept as the reference for the in place parser. Faces are not
+ * welded, every corner is a vertex of its own. Material ids and the material of each vertex are filled in like
+ * modelParse does, so that the output can be compared (see unweld).
+ */
+void legacyTokenize(std::string const &str, const char delim, std::vector<std::string> &out)
+{
+    size_t start;
+    size_t end = 0;
+
+    while( (start = str.find_first_not_of(delim, end)) != std::string::npos )
+    {
+        end = str.find(delim, start);
+        out.push_back(str.substr(start, end - start));
+    }
+}
+
+struct LegacyIndex
+{
+    enum eType
+    {
+        V = 1,
+        VN = 2,
+        VT = 4,
+
+        V_VN = V | VN,
+        V_VT_VN = V | VN | VT
+    };
+
+    eType type = V;
+    unsigned int v = 0;
+    unsigned int vt = 0;
+    unsigned int vn = 0;
+
+    friend std::stringstream& operator >>(std::stringstream& in, LegacyIndex& index)
+    {
+        std::string data;
+        in >> data;
+
+        std::vector<std::string> tokens;
+        legacyTokenize(data, '/', tokens);
+
+        if(tokens.empty())
+        {
+            return in;
+        }
+
+        index.v = std::stoi( tokens[0] );
+
+        if(tokens.size() == 2)
+        {
+            index.vn = std::stoi( tokens[1] );
+            index.type = V_VN;
+        }
+        else if(tokens.size() == 3)
+        {
+            index.vt = std::stoi( tokens[1] );
+            index.vn = std::stoi( tokens[2] );
+            index.type = V_VT_VN;
+        }
+
+        return in;
+    }
+};
+
+std::map<std::string, Material> legacyMaterialLoad(const std::string &filepath)
+{
+    std::ifstream materialFile(filepath);
+    if(!materialFile.is_open())
+    {
+        throw std::runtime_error("[Bench] Couldn't open material file at " + filepath);
+    }
+
+    std::map<std::string, Material> materials;
+    Material* current = nullptr;
+
+    std::string line;
+    while(std::getline(materialFile, line))
+    {
+        std::stringstream ss(line);
+
+        std::string code;
+        ss >> code;
+
+        if(code == "newmtl")
+        {
+            Material material;
+            ss >> material.name;
+
+            auto it = materials.find(material.name);
+            material.id = it != materials.end() ? it->second.id : static_cast<unsigned int>(materials.size());
+
+            materials[material.name] = material;
+            current = &materials[material.name];
+        }
+        else if(code == "Ns" && current)
+        {
+            float ns = 1.0f;
+            ss >> ns;
+
+            current->shininess = ns;
+        }
+        else if(code == "Ka" && current)
+        {
+            ss >> current->ambient.x >> current->ambient.y >> current->ambient.z;
+        }
+        else if(code == "Kd" && current)
+        {
+            ss >> current->diffuse.x >> current->diffuse.y >> current->diffuse.z;
+        }
+        else if(code == "Ks" && current)
+        {
+            ss >> current->specular.x >> current->specular.y >> current->specular.z;
+        }
+        else if(code == "Ke" && current)
+        {
+            ss >> current->emission.x >> current->emission.y >> current->emission.z;
+        }
+    }
+
+    return materials;
+}
+
+std::vector<ModelData> legacyParse(const std::string &filepath)
+{
+    std::ifstream objFile(filepath);
+    if(!objFile.is_open())
+    {
+        throw std::runtime_error("[Bench] Couldn't open OBJ file at " + filepath);
+    }
+
+    std::vector<ModelData> models;
+
+    std::map<std::string, Material> materials;
+    std::vector<Vector3D> vertices;
+    std::vector<Vector3D> normals;
+    std::vector<Vector2D> uvs;
+    unsigned int currentMaterial = 0;
+
+    /* faces and materials in front of the first object open an implicit object, like modelParse */
+    auto current = [&models]() -> ModelData&
+    {
+        if(models.empty())
+        {
+            models.emplace_back().name = "default";
+        }
+        return models.back();
+    };
+    auto finishMaterial = [&models]()
+    {
+        if(!models.empty() && !models.back().material.empty())
+        {
+            auto& material = models.back().material.back();
+            material.indexCount = models.back().vertices.size() - material.indexOffset;
+        }
+    };
+
+    std::string line;
+    while(std::getline(objFile, line))
+    {
+        std::stringstream ss(line);
+
+        std::string code;
+        ss >> code;
+
+        if(code == "")
+        {
+            continue;
+        }
+        else if(code == "o")
+        {
+            finishMaterial();
+
+            ModelData& model = models.emplace_back();
+            ss >> model.name;
+        }
+        else if(code == "v")
+        {
+            auto& v = vertices.emplace_back();
+            ss >> v.x >> v.y >> v.z;
+        }
+        else if(code == "vt")
+        {
+            auto& vt = uvs.emplace_back();
+            ss >> vt.x >> vt.y;
+        }
+        else if(code == "vn")
+        {
+            auto& vn = normals.emplace_back();
+            ss >> vn.x >> vn.y >> vn.z;
+        }
+        else if(code == "f")
+        {
+            ModelData& model = current();
+
+            LegacyIndex _idx[3];
+            ss >> _idx[0] >> _idx[1] >> _idx[2];
+
+            for(int i = 0; i < 3; i++)
+            {
+                model.indices.emplace_back(model.vertices.size());
+
+                Vertex& vertex = model.vertices.emplace_back();
+                vertex.pos = vertices[_idx[i].v - 1];
+                vertex.material = currentMaterial;
+
+                if(_idx[i].type == LegacyIndex::V_VN)
+                {
+                    vertex.normal = normals[_idx[i].vn - 1];
+                }
+                else if(_idx[i].type == LegacyIndex::V_VT_VN)
+                {
+                    vertex.normal = normals[_idx[i].vn - 1];
+                    vertex.uv = uvs[_idx[i].vt - 1];
+                }
+            }
+        }
+        else if(code == "mtllib")
+        {
+            std::string file;
+            ss >> file;
+            materials = legacyMaterialLoad( filepath.substr(0, filepath.find_last_of("\\/")) + "/" + file );
+        }
+        else if(code == "usemtl")
+        {
+            ModelData& model = current();
+            std::string name;
+            ss >> name;
+
+            finishMaterial();
+
+            /* unknown materials get a default material with its own id */
+            auto it = materials.find(name);
+            if(it == materials.end())
+            {
+                Material unknown{};
+                unknown.name = name;
+                unknown.id = static_cast<unsigned int>(materials.size());
+                it = materials.emplace(name, unknown).first;
+            }
+
+            auto& material = model.material.emplace_back( it->second );
+            material.indexOffset = model.vertices.size();
+            currentMaterial = material.id;
+        }
+    }
+
+    finishMaterial();
+    return models;
+}
+
+/* the objects with one vertex per face corner, as the legacy parser creates them */
+std::vector<ModelData> unweld(const std::vector<ModelData>& models)
+{
+    std::vector<ModelData> result = models;
+    for(size_t m = 0; m < models.size(); m++)
+    {
+        result[m].vertices.clear();
+        for(unsigned int i = 0; i < models[m].indices.size(); i++)
+        {
+            result[m].vertices.push_back(models[m].vertices[models[m].indices[i]]);
+            result[m].indices[i] = i;
+        }
+    }
+
+    return result;
+}
+
+int benchParseLegacy(unsigned int repeats)
+{
+    std::cout << "[Bench] Parsing the shipped OBJ files with the legacy stringstream parser and modelParse, best of "
+              << repeats << " runs" << std::endl;
+
+    bool failed = false;
+    std::cout << std::setw(40) << "file" << std::setw(12) << "legacy ms" << std::setw(12) << "serial ms"
+              << std::setw(12) << "parallel ms" << std::setw(10) << "speedup" << "  result" << std::endl;
+    for(const char* filepath : {"assets/plane/cartoon-plane.obj", "assets/plane/flag_uibk.obj",
+                                "assets/planet/cute-little-planet.obj"})
+    {
+        std::vector<ModelData> legacy, serial, parallel;
+        double legacyMs = timeMin(repeats, [&]() { legacy = legacyParse(filepath); });
+        double serialMs = timeMin(repeats, [&]() { serial = modelParse(filepath, 1); });
+        double parallelMs = timeMin(repeats, [&]() { parallel = modelParse(filepath); });
+
+        bool same = identical(legacy, unweld(serial)) && identical(legacy, unweld(parallel));
+        failed |= !same;
+
+        std::cout << std::setw(40) << filepath << std::setw(12) << std::fixed << std::setprecision(2) << legacyMs
+                  << std::setw(12) << serialMs << std::setw(12) << parallelMs << std::setw(10)
+                  << legacyMs / std::min(serialMs, parallelMs) << "  " << (same ? "identical" : "DIFFERENT") << std::endl;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/*
+ * Writes a triangulated grid of size x size quads as OBJ file. The faces of the first half of the rows get the
+ * prefix, the others the infix in front of them, e.g. objects and materials in front of the first object.
+ */
+void objGrid(const std::string& output, unsigned int size, const std::string& prefix, const std::string& infix)
+{
+    std::ofstream out(output);
+    if(!out.is_open())
+    {
+        throw std::runtime_error("[Bench] Couldn't write OBJ file at " + output);
+    }
+
+    out << "vn 0 1 0\n";
+    for(unsigned int y = 0; y <= size; y++)
+    {
+        for(unsigned int x = 0; x <= size; x++)
+        {
+            out << "v " << x << " 0 " << y << "\n";
+        }
+    }
+
+    out << prefix;
+    for(unsigned int y = 0; y < size; y++)
+    {
+        if(y == size / 2)
+        {
+            out << infix;
+        }
+
+        for(unsigned int x = 0; x < size; x++)
+        {
+            unsigned int v = y * (size + 1) + x + 1;
+            out << "f " << v << "//1 " << v + 1 << "//1 " << v + size + 2 << "//1\n";
+            out << "f " << v << "//1 " << v + size + 2 << "//1 " << v + size + 1 << "//1\n";
+        }
+    }
+}
+
+int benchParseImplicit()
+{
+    struct Case
+    {
+        const char* name;
+        const char* prefix;
+        const char* infix;
+    };
+    const Case cases[] = {
+        { "no objects", "", "" },
+        { "faces before the first object", "", "o second\n" },
+        { "material before the first object", "usemtl red\n", "o second\nusemtl blue\n" },
+        { "material before faces without objects", "usemtl red\n", "usemtl blue\n" },
+    };
+
+    std::string path = (std::filesystem::temp_directory_path() / "assignment_04_implicit.obj").string();
+    unsigned int threads = std::max(2u, jobsThreads());
+    std::cout << "[Bench] Parsing OBJ files with faces or materials in front of the first object, serial, on "
+              << threads << " threads and with the legacy parser" << std::endl;
+
+    bool failed = false;
+    for(const auto& c : cases)
+    {
+        /* large enough to be split into several chunks */
+        objGrid(path, 160, c.prefix, c.infix);
+
+        std::vector<ModelData> serial = modelParse(path, 1);
+        std::vector<ModelData> parallel = modelParse(path, threads);
+        std::vector<ModelData> legacy = legacyParse(path);
+
+        bool same = !serial.empty() && serial.front().name == "default" && identical(serial, parallel)
+                    && identical(legacy, unweld(serial));
+        failed |= !same;
+
+        std::cout << std::setw(40) << c.name << std::setw(4) << serial.size() << " objects  "
+                  << (same ? "identical" : "DIFFERENT") << std::endl;
+    }
+    std::filesystem::remove(path);
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int benchParse(const std::string& filepath, unsigned int copies, unsigned int repeats)
+{
+    std::string path = filepath;
+    if(copies > 1)
+    {
+        path = filepath.substr(0, filepath.find_last_of('.')) + ".bench.obj";
+        objRepeat(filepath, path, copies);
+    }
+
+    auto bytes = std::filesystem::file_size(path);
+    std::cout << "[Bench] Parsing " << path << " (" << bytes / (1024 * 1024.0) << " MiB), best of " << repeats
+              << " runs, " << jobsThreads() << " threads available" << std::endl;
+
+    std::vector<ModelData> reference;
+    double serial = timeMin(repeats, [&]() { reference = modelParse(path, 1); });
+
+    bool failed = false;
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(12) << "MiB/s" << std::setw(10) << "speedup"
+              << "  result" << std::endl;
+    for(unsigned int threads = 1; ; threads = std::min(threads * 2, jobsThreads()))
+    {
+        std::vector<ModelData> result;
+        double ms = threads == 1 ? serial : timeMin(repeats, [&]() { result = modelParse(path, threads); });
+        bool same = threads == 1 || identical(reference, result);
+        failed |= !same;
+
+        std::cout << std::setw(8) << threads << std::setw(12) << std::fixed << std::setprecision(2) << ms
+                  << std::setw(12) << bytes / (1024 * 1024.0) / (ms / 1000.0) << std::setw(10) << serial / ms
+                  << "  " << (threads == 1 ? "reference" : same ? "identical" : "DIFFERENT") << std::endl;
+
+        if(threads == jobsThreads())
+        {
+            break;
+        }
+    }
+
+    if(copies > 1)
+    {
+        std::filesystem::remove(path);
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* grid of about count vertices over the extents of the shipped flag (y in [-2, 2], z in [-8, 0]) */
+std::vector<Vertex> flagGrid(std::size_t count)
+{
+    std::size_t columns = std::max<std::size_t>(2, static_cast<std::size_t>(std::sqrt(count / 2.0)));
+    std::size_t rows = std::max<std::size_t>(2, count / columns);
+
+    std::vector<Vertex> vertices(rows * columns);
+    for(std::size_t row = 0; row < rows; row++)
+    {
+        for(std::size_t column = 0; column < columns; column++)
+        {
+            Vertex& vertex = vertices[row * columns + column];
+            vertex.pos = {0.0f, -2.0f + 4.0f * column / (columns - 1), -8.0f * row / (rows - 1)};
+        }
+    }
+
+    return vertices;
+}
+
+int benchFlag(std::size_t count, unsigned int repeats)
+{
+    const float minPosZ = -8.0f;
+    FlagVertices vertices = flagVertices(flagGrid(count));
+
+    FlagSim sim;
+    float amplitudes = 0.0f;
+    float slopes = 0.0f;
+    for(const auto& params : sim.parameter)
+    {
+        amplitudes += std::abs(params.amplitude);
+        slopes += std::abs(params.amplitude * params.omega);
+    }
+
+    std::cout << "[Bench] Animating a flag with " << vertices.count << " vertices, best of " << repeats << " runs, "
+              << "errors per unit of summed wave amplitude (" << amplitudes << ", times omega " << slopes
+              << " for the normals)" << std::endl;
+
+    bool failed = false;
+    std::cout << std::setw(8) << "kernel" << std::setw(12) << "ms" << std::setw(14) << "Mvertices/s" << std::setw(10)
+              << "speedup" << std::setw(12) << "x error" << std::setw(14) << "normal error" << "  result" << std::endl;
+    double scalar = 0.0;
+    for(int k = 0; k < static_cast<int>(eFlagKernel::KERNEL_COUNT); k++)
+    {
+        eFlagKernel kernel = static_cast<eFlagKernel>(k);
+        if(!flagKernelSupported(kernel))
+        {
+            std::cout << std::setw(8) << flagKernelName(kernel) << "  not supported by the cpu" << std::endl;
+            continue;
+        }
+
+        /* the error is checked at the start and after long running simulations, where the wave arguments are large */
+        float error = 0.0f;
+        float normalError = 0.0f;
+        for(float time : {0.0f, 10.0f, 1000.0f, 20000.0f})
+        {
+            sim.accumTime = time;
+            flagKernelRun(kernel, vertices, flagWaves(sim), minPosZ, 0, vertices.count);
+            for(std::size_t i = 0; i < vertices.count; i++)
+            {
+                float reference = flagDisplacement(sim, {vertices.y[i], vertices.z[i]}, minPosZ);
+                error = std::max(error, std::abs(vertices.x[i] - reference) / amplitudes);
+
+                Vector3D normal = flagNormal(sim, {vertices.y[i], vertices.z[i]}, minPosZ);
+                Vector3D difference = Vector3D(vertices.nx[i], vertices.ny[i], vertices.nz[i]) - normal;
+                normalError = std::max({normalError, std::abs(difference.x) / slopes, std::abs(difference.y) / slopes,
+                                        std::abs(difference.z) / slopes});
+            }
+        }
+        bool passed = error <= flagKernelTolerance && normalError <= flagKernelTolerance;
+        failed |= !passed;
+
+        sim.accumTime = 10.0f;
+        std::vector<FlagWave> waves = flagWaves(sim);
+        double ms = timeMin(repeats, [&]() { flagKernelRun(kernel, vertices, waves, minPosZ, 0, vertices.count); });
+        scalar = kernel == eFlagKernel::SCALAR ? ms : scalar;
+
+        std::cout << std::setw(8) << flagKernelName(kernel) << std::setw(12) << std::fixed << std::setprecision(3) << ms
+                  << std::setw(14) << std::setprecision(1) << vertices.count / 1000.0 / ms << std::setw(10)
+                  << std::setprecision(2) << scalar / ms << std::setw(12) << std::scientific << std::setprecision(2)
+                  << error << std::setw(14) << normalError << std::defaultfloat << "  " << (passed ? "ok" : "TOO LARGE")
+                  << std::endl;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* angle between two normals in radians, from the length of their cross product so that small angles stay precise */
+double normalAngle(const Vector3D& a, const Vector3D& b)
+{
+    double x = static_cast<double>(a.y) * b.z - static_cast<double>(a.z) * b.y;
+    double y = static_cast<double>(a.z) * b.x - static_cast<double>(a.x) * b.z;
+    double z = static_cast<double>(a.x) * b.y - static_cast<double>(a.y) * b.x;
+    double sine = std::sqrt(x * x + y * y + z * z);
+    double cosine = static_cast<double>(a.x) * b.x + static_cast<double>(a.y) * b.y + static_cast<double>(a.z) * b.z;
+    return std::atan2(sine, cosine);
+}
+
+/* normal from central differences of flagDisplacement */
+Vector3D finiteDifferenceNormal(const FlagSim& sim, Vector2D position, float minPosZ, float step)
+{
+    float dy = (flagDisplacement(sim, position + Vector2D(step, 0.0f), minPosZ) -
+                flagDisplacement(sim, position - Vector2D(step, 0.0f), minPosZ)) / (2.0f * step);
+    float dz = (flagDisplacement(sim, position + Vector2D(0.0f, step), minPosZ) -
+                flagDisplacement(sim, position - Vector2D(0.0f, step), minPosZ)) / (2.0f * step);
+    return normalize(Vector3D(1.0f, -dy, -dz));
+}
+
+int benchFlagNormals(std::size_t count)
+{
+    /* the differences are taken in float, the step balances the rounding error against the truncation error */
+    const float minPosZ = -8.0f;
+    const float step = 1e-2f;
+    const double tolerance = 1e-3;
+    FlagVertices vertices = flagVertices(flagGrid(count));
+
+    std::cout << "[Bench] Comparing the analytic normals of a flag with " << vertices.count << " vertices to central "
+              << "differences of flagDisplacement (step " << step << "), max angle in radians" << std::endl;
+
+    bool failed = false;
+    std::cout << std::setw(8) << "time" << std::setw(12) << "flagNormal";
+    for(int k = 0; k < static_cast<int>(eFlagKernel::KERNEL_COUNT); k++)
+    {
+        if(flagKernelSupported(static_cast<eFlagKernel>(k)))
+        {
+            std::cout << std::setw(12) << flagKernelName(static_cast<eFlagKernel>(k));
+        }
+    }
+    std::cout << "  result" << std::endl;
+
+    /* larger times round the wave arguments too coarsely for differences with a small step */
+    FlagSim sim;
+    for(float time : {0.0f, 1.0f, 10.0f, 100.0f})
+    {
+        sim.accumTime = time;
+        std::vector<Vector3D> reference(vertices.count);
+        double analytic = 0.0;
+        for(std::size_t i = 0; i < vertices.count; i++)
+        {
+            Vector2D position = {vertices.y[i], vertices.z[i]};
+            reference[i] = finiteDifferenceNormal(sim, position, minPosZ, step);
+            analytic = std::max(analytic, normalAngle(flagNormal(sim, position, minPosZ), reference[i]));
+        }
+        bool passed = analytic <= tolerance;
+
+        std::cout << std::setw(8) << std::fixed << std::setprecision(1) << time << std::setw(12) << std::scientific
+                  << std::setprecision(2) << analytic;
+        for(int k = 0; k < static_cast<int>(eFlagKernel::KERNEL_COUNT); k++)
+        {
+            eFlagKernel kernel = static_cast<eFlagKernel>(k);
+            if(!flagKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            flagKernelRun(kernel, vertices, flagWaves(sim), minPosZ, 0, vertices.count);
+            double angle = 0.0;
+            for(std::size_t i = 0; i < vertices.count; i++)
+            {
+                angle = std::max(angle, normalAngle(Vector3D(vertices.nx[i], vertices.ny[i], vertices.nz[i]), reference[i]));
+            }
+            passed &= angle <= tolerance;
+            std::cout << std::setw(12) << angle;
+        }
+        std::cout << std::defaultfloat << "  " << (passed ? "ok" : "TOO LARGE") << std::endl;
+        failed |= !passed;
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+int benchFlagScaling(std::size_t maxVertices, unsigned int repeats)
+{
+    eFlagKernel kernel = flagKernelBest();
+    std::cout << "[Bench] Animating flags into a vertex buffer with the " << flagKernelName(kernel) << " kernel, best of "
+              << repeats << " runs, " << jobsThreads() << " threads available" << std::endl;
+
+    std::cout << std::setw(10) << "vertices" << std::setw(8) << "threads" << std::setw(12) << "ms" << std::setw(14)
+              << "Mvertices/s" << std::setw(10) << "speedup" << std::endl;
+    for(std::size_t count : {std::size_t(399), std::size_t(4000), std::size_t(40000), std::size_t(400000), std::size_t(1000000)})
+    {
+        if(count > maxVertices)
+        {
+            break;
+        }
+
+        Flag flag;
+        flag.minPosZ = -8.0f;
+        flag.vertices = flagGrid(count);
+        flag.positions = flagVertices(flag.vertices);
+        std::vector<Vertex> buffer(flag.vertices.size());
+
+        FlagSim sim;
+        sim.accumTime = 10.0f;
+
+        double single = 0.0;
+        for(unsigned int threads = 1; ; threads = std::min(threads * 2, jobsThreads()))
+        {
+            double ms = timeMin(repeats, [&]() { animateFlagVertices(flag, sim, buffer.data(), kernel, threads); });
+            single = threads == 1 ? ms : single;
+
+            std::cout << std::setw(10) << flag.vertices.size() << std::setw(8) << threads << std::setw(12) << std::fixed
+                      << std::setprecision(3) << ms << std::setw(14) << std::setprecision(1)
+                      << flag.vertices.size() / 1000.0 / ms << std::setw(10) << std::setprecision(2) << single / ms
+                      << std::endl;
+
+            if(threads == jobsThreads())
+            {
+                break;
+            }
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+int benchFlagWaves(std::size_t count, unsigned int maxWaves, unsigned int repeats)
+{
+    const float minPosZ = -8.0f;
+    FlagVertices vertices = flagVertices(flagGrid(count));
+
+    std::cout << "[Bench] Animating a flag with " << vertices.count << " vertices and wind spectra of growing size, best of "
+              << repeats << " runs" << std::endl;
+
+    std::cout << std::setw(8) << "waves" << std::setw(8) << "kernel" << std::setw(12) << "ms" << std::setw(14)
+              << "ns/vertex" << std::setw(18) << "ns/vertex/wave" << std::setw(12) << "x error" << "  result" << std::endl;
+
+    bool failed = false;
+    for(unsigned int waveCount : {1u, 3u, 8u, 16u, 32u, 64u, 128u, 256u})
+    {
+        if(waveCount > maxWaves)
+        {
+            break;
+        }
+
+        FlagSpectrum spectrum;
+        spectrum.count = waveCount;
+        FlagSim sim;
+        flagSimSetWaves(sim, flagSpectrum(spectrum));
+        sim.accumTime = 10.0f;
+        std::vector<FlagWave> waves = flagWaves(sim);
+        float amplitudes = 0.0f;
+        for(const auto& wave : waves)
+        {
+            amplitudes += std::abs(wave.amplitude);
+        }
+
+        for(int k = 0; k < static_cast<int>(eFlagKernel::KERNEL_COUNT); k++)
+        {
+            eFlagKernel kernel = static_cast<eFlagKernel>(k);
+            if(!flagKernelSupported(kernel))
+            {
+                continue;
+            }
+
+            flagKernelRun(kernel, vertices, waves, minPosZ, 0, vertices.count);
+            float error = 0.0f;
+            for(std::size_t i = 0; i < vertices.count; i++)
+            {
+                float reference = flagDisplacement(sim, {vertices.y[i], vertices.z[i]}, minPosZ);
+                error = std::max(error, std::abs(vertices.x[i] - reference) / amplitudes);
+            }
+            bool passed = error <= flagKernelTolerance;
+            failed |= !passed;
+
+            double ms = timeMin(repeats, [&]() { flagKernelRun(kernel, vertices, waves, minPosZ, 0, vertices.count); });
+            double perVertex = ms * 1e6 / vertices.count;
+
+            std::cout << std::setw(8) << waveCount << std::setw(8) << flagKernelName(kernel) << std::setw(12) << std::fixed
+                      << std::setprecision(3) << ms << std::setw(14) << std::setprecision(2) << perVertex << std::setw(18)
+                      << perVertex / waveCount << std::setw(12) << std::scientific << std::setprecision(2) << error
+                      << std::defaultfloat << "  " << (passed ? "ok" : "TOO LARGE") << std::endl;
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/* grid of size x size particles over the extents of the shipped flag, two triangles per cell, pinned at z = 0 */
+Cloth clothGrid(std::size_t size, std::vector<Vertex>& vertices)
+{
+    vertices.resize(size * size);
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> pinned;
+    for(std::size_t row = 0; row < size; row++)
+    {
+        for(std::size_t column = 0; column < size; column++)
+        {
+            Vertex& vertex = vertices[row * size + column];
+            vertex.pos = {0.0f, -2.0f + 4.0f * column / (size - 1), -8.0f * row / (size - 1)};
+            vertex.normal = {1.0f, 0.0f, 0.0f, 0.0f};
+
+            unsigned int index = static_cast<unsigned int>(row * size + column);
+            if(row == 0)
+            {
+                pinned.push_back(index);
+            }
+            if(row + 1 < size && column + 1 < size)
+            {
+                unsigned int below = index + static_cast<unsigned int>(size);
+                indices.insert(indices.end(), {index, below, index + 1, index + 1, below, below + 1});
+            }
+        }
+    }
+
+    return clothCreate(vertices, indices, pinned, Vector3D(0.0f, 0.0f, -1.0f));
+}
+
+bool clothFinite(const Cloth& cloth)
+{
+    for(std::size_t i = 0; i < cloth.count; i++)
+    {
+        if(!std::isfinite(cloth.x[i]) || !std::isfinite(cloth.y[i]) || !std::isfinite(cloth.z[i]))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* largest stretch of the triangle edges the cloth bench accepts at any resolution (see clothStretch) */
+const float clothMaxStretch = 0.1f;
+
+int benchFlagCloth(std::size_t maxGrid, double budget)
+{
+    const float dt = 1.0f / 60.0f;
+    const unsigned int warmup = 60;
+    const unsigned int frames = 60;
+    const Vector3D wind = {0.0f, 0.0f, -20.0f};
+    const Vector3D gravity = {0.0f, -9.81f, 0.0f};
+
+    std::cout << "[Bench] Simulating cloth flags with at least " << ClothSettings().minSubsteps << " substeps per frame, "
+              << frames << " frames of " << std::fixed << std::setprecision(2) << dt * 1000.0f << " ms after " << warmup
+              << " frames of warmup, budget " << budget << " ms, stretch at most " << clothMaxStretch << ", " << jobsThreads()
+              << " threads available" << std::endl;
+
+    std::cout << std::setw(10) << "grid" << std::setw(12) << "particles" << std::setw(13) << "constraints"
+              << std::setw(8) << "colors" << std::setw(10) << "substeps" << std::setw(8) << "threads" << std::setw(12) << "ms/frame" << std::setw(8)
+              << "budget" << std::setw(10) << "stretch" << std::endl;
+
+    bool failed = false;
+    for(std::size_t size : {std::size_t(20), std::size_t(32), std::size_t(64), std::size_t(128), std::size_t(256)})
+    {
+        if(size > maxGrid)
+        {
+            break;
+        }
+
+        std::vector<Vertex> rest;
+        Cloth cloth = clothGrid(size, rest);
+        std::vector<Vertex> buffer(rest.size());
+
+        for(unsigned int threads = 1; ; threads = std::min(threads * 2, jobsThreads()))
+        {
+            clothReset(cloth);
+            for(unsigned int frame = 0; frame < warmup; frame++)
+            {
+                clothStep(cloth, wind, gravity, dt, threads);
+            }
+
+            /* one frame is the step and the write of the vertices, like flagClothStep */
+            double ms = timeMin(1, [&]()
+            {
+                for(unsigned int frame = 0; frame < frames; frame++)
+                {
+                    clothStep(cloth, wind, gravity, dt, threads);
+                    clothWriteVertices(cloth, rest, buffer.data(), threads);
+                }
+            }) / frames;
+
+            bool finite = clothFinite(cloth);
+            float stretch = clothStretch(cloth);
+            bool stiff = finite && stretch <= clothMaxStretch;
+            failed |= !stiff;
+
+            std::cout << std::setw(10) << (std::to_string(size) + "x" + std::to_string(size)) << std::setw(12)
+                      << cloth.count << std::setw(13) << cloth.constraints.a.size() << std::setw(8)
+                      << cloth.constraints.colors.size() - 1 << std::setw(10) << cloth.substeps << std::setw(8) << threads << std::setw(12) << std::fixed
+                      << std::setprecision(3) << ms << std::setw(8) << (ms <= budget ? "ok" : "over") << std::setw(10)
+                      << std::setprecision(4) << stretch << (!finite ? "  NOT FINITE" : stiff ? "" : "  STRETCHED")
+                      << std::endl;
+
+            if(threads == jobsThreads())
+            {
+                break;
+            }
+        }
+    }
+
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}
+
+int main(int argc, char **argv)
+{
+    std::string command = argc > 1 ? argv[1] : "";
+
+    int result = EXIT_SUCCESS;
+    try
+    {
+        if(command == "parse")
+        {
+            std::string filepath = argc > 2 ? argv[2] : "assets/planet/cute-little-planet.obj";
+            unsigned int copies = argc > 3 ? std::stoul(argv[3]) : 1;
+            unsigned int repeats = argc > 4 ? std::stoul(argv[4]) : 5;
+            result = detail::benchParse(filepath, copies, repeats);
+        }
+        else if(command == "parse-legacy")
+        {
+            unsigned int repeats = argc > 2 ? std::stoul(argv[2]) : 5;
+            result = detail::benchParseLegacy(repeats);
+        }
+        else if(command == "parse-implicit")
+        {
+            result = detail::benchParseImplicit();
+        }
+        else if(command == "flag")
+        {
+            std::size_t vertices = argc > 2 ? std::stoul(argv[2]) : 399;
+            unsigned int repeats = argc > 3 ? std::stoul(argv[3]) : 20;
+            result = detail::benchFlag(vertices, repeats);
+        }
+        else if(command == "flag-normals")
+        {
+            std::size_t vertices = argc > 2 ? std::stoul(argv[2]) : 399;
+            result = detail::benchFlagNormals(vertices);
+        }
+        else if(command == "flag-scaling")
+        {
+            std::size_t vertices = argc > 2 ? std::stoul(argv[2]) : 1000000;
+            unsigned int repeats = argc > 3 ? std::stoul(argv[3]) : 10;
+            result = detail::benchFlagScaling(vertices, repeats);
+        }
+        else if(command == "flag-waves")
+        {
+            std::size_t vertices = argc > 2 ? std::stoul(argv[2]) : 4000;
+            unsigned int waves = argc > 3 ? std::stoul(argv[3]) : 256;
+            unsigned int repeats = argc > 4 ? std::stoul(argv[4]) : 20;
+            result = detail::benchFlagWaves(vertices, waves, repeats);
+        }
+        else if(command == "flag-cloth")
+        {
+            std::size_t grid = argc > 2 ? std::stoul(argv[2]) : 256;
+            double budget = argc > 3 ? std::stod(argv[3]) : 2.0;
+            result = detail::benchFlagCloth(grid, budget);
+        }
+        else
+        {
+            std::cerr << "Usage: assignment_04_bench parse [OBJ file] [copies] [repeats]" << std::endl
+                      << "       assignment_04_bench parse-legacy [repeats]" << std::endl
+                      << "       assignment_04_bench parse-implicit" << std::endl
+                      << "       assignment_04_bench flag [vertices] [repeats]" << std::endl
+                      << "       assignment_04_bench flag-normals [vertices]" << std::endl
+                      << "       assignment_04_bench flag-scaling [max vertices] [repeats]" << std::endl
+                      << "       assignment_04_bench flag-waves [vertices] [max waves] [repeats]" << std::endl
+                      << "       assignment_04_bench flag-cloth [max grid] [budget ms]" << std::endl;
+            result = EXIT_FAILURE;
+        }
+    }
+    catch(const std::exception &error)
+    {
+        std::cerr << error.what() << std::endl;
+        result = EXIT_FAILURE;
+    }
+
+    jobsShutdown();
+    return result;
+}